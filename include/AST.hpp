@@ -36,4 +36,14 @@ struct ASTNode {
  */
 void printAST(const ASTNode* node, int indent = 0);
 
+/**
+ * @brief Formats a tree on one line, for comparing parses.
+ *
+ * Each node becomes symbol[matched](children...); a null tree is "~".
+ *
+ * @param node The root node to format
+ * @return The formatted tree
+ */
+std::string formatAST(const ASTNode* node);
+
 #endif
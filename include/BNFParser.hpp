@@ -2,10 +2,57 @@
 #define BNF_PARSER_HPP
 
 #include "Grammar.hpp"
+#include "CompiledGrammar.hpp"
+#include "GrammarHandle.hpp"
 #include "AST.hpp"
+#include "SemanticActions.hpp"
+#include "ParseMemo.hpp"
 #include <string>
-#include <map>
-#include <bitset>
+#include <vector>
+
+class IncrementalParser;
+class BranchProfile;
+
+/**
+ * @brief Location of a rule match found by BNFParser::search.
+ */
+struct SearchMatch {
+    size_t start;   ///< Offset of the match
+    size_t length;  ///< Length of the match (never 0)
+};
+
+/**
+ * @brief Memo use of one rule, reported by BNFParser::memoReport.
+ */
+struct MemoRuleStats {
+    std::string rule;        ///< Rule name
+    unsigned long lookups;   ///< Times the rule was looked up in the memo
+    unsigned long hits;      ///< Lookups that the memo answered
+    unsigned long stored;    ///< Results recorded in the memo
+};
+
+/**
+ * @brief Cost of one call, filled by BNFParser when collectStats() is on.
+ *
+ * Meant for spotting inputs that are pathological for a grammar: a parse
+ * can succeed and still evaluate far more expressions, or discard far more
+ * nodes, than the input is long.
+ */
+struct ParseStats {
+    unsigned long expressions;       ///< Expressions evaluated
+    unsigned long nodesCreated;      ///< AST nodes allocated
+    unsigned long nodesDiscarded;    ///< AST nodes allocated and then deleted during the call
+    unsigned int maxDepth;           ///< Deepest nesting of expressions evaluated
+    unsigned long backtrackedBytes;  ///< Bytes matched and then given up (read again or abandoned)
+
+    ParseStats() { clear(); }
+
+    /** @brief Zeroes every count. */
+    void clear() {
+        expressions = nodesCreated = nodesDiscarded = backtrackedBytes = 0;
+        maxDepth = 0;
+    }
+};
 
 /**
  * @brief Parser for BNF grammars that generates Abstract Syntax Trees.
@@ -13,15 +60,45 @@
  * Takes a grammar and input text, then attempts to parse the input according
  * to the grammar rules, producing an AST representing the parsed structure.
  * Uses recursive descent parsing with backtracking for alternatives.
+ *
+ * Parsing runs over a CompiledGrammar built from the grammar on first use
+ * and rebuilt whenever rules have been added since. A parser built from a
+ * GrammarHandle::Snapshot instead uses the snapshot's compiled grammar and
+ * keeps that version pinned for its lifetime.
+ *
+ * When the grammar has a skip rule, runs of its bytes are skipped before
+ * every literal, class and token outside token rules. Skipped bytes belong
+ * to no node: node text starts at the first token, and trailing skipped
+ * bytes are not counted as consumed unless a token follows them.
  */
 class BNFParser {
 public:
+    /**
+     * @brief Which rules parses memoize (see memoize()).
+     */
+    enum MemoMode {
+        MEMO_OFF,        ///< No memo (default)
+        MEMO_REENTRANT,  ///< Rules the compiled grammar marks reentrant
+        MEMO_LISTED,     ///< Rules given to memoizeRules()
+        MEMO_ALL         ///< Every rule
+    };
+
     /**
      * @brief Constructs a parser for the given grammar.
      * @param g The grammar containing the parsing rules
      */
     BNFParser(const Grammar& g);
 
+    /**
+     * @brief Constructs a parser for a published grammar version.
+     *
+     * Parsers are cheap to build this way (nothing is compiled), so a worker
+     * can take a fresh snapshot per request to pick up new versions.
+     *
+     * @param snapshot Pinned version; must be valid()
+     */
+    explicit BNFParser(const GrammarHandle::Snapshot& snapshot);
+
     /**
      * @brief Destructor for cleanup.
      */
@@ -38,145 +115,592 @@ public:
 				const std::string& input,
 				size_t& consumed) const;
 
+    /**
+     * @brief Parses input that must match the rule as a whole.
+     *
+     * Inputs shorter than the rule's minimum or longer than its maximum
+     * length are rejected without parsing. During the parse, every node
+     * that has to end at the end of input (the root, the last element of
+     * such a sequence, the branches of such an alternative, ...) fails as
+     * soon as its maximum length cannot reach the end or its match stops
+     * short, so prefix matches are abandoned before their enclosing nodes
+     * are built. The result is the tree parse() would return.
+     *
+     * @param ruleName Name of the grammar rule to use as starting point
+     * @param input The text to parse
+     * @return Pointer to the root AST node, or nullptr unless the rule matched all of input
+     */
+    ASTNode* parseFull(const std::string& ruleName,
+                       const std::string& input) const;
+
+    /**
+     * @brief Checks that input matches the rule as a whole, without building a tree.
+     *
+     * Same pruning as parseFull(), in recognition mode.
+     *
+     * @param ruleName Name of the grammar rule to use as starting point
+     * @param input The text to check
+     * @return true if parseFull() would return a tree
+     */
+    bool matchFull(const std::string& ruleName,
+                   const std::string& input) const;
+
+    /**
+     * @brief Checks that the rule matches a prefix of input, without building a tree.
+     *
+     * Succeeds exactly when parse() does, including matches whose tree is
+     * empty (parse() returns null for those).
+     *
+     * @param ruleName Name of the grammar rule to use as starting point
+     * @param input The text to check
+     * @param consumed Output parameter for the number of characters matched
+     * @return true if the rule matched
+     */
+    bool match(const std::string& ruleName,
+               const std::string& input,
+               size_t& consumed) const;
+
+    /**
+     * @brief Finds the matches of a rule anywhere in the input.
+     *
+     * Scans left to right. At each offset whose byte is in the rule's FIRST
+     * set the rule is tried (in recognition mode, so no nodes are built).
+     * A non-empty match is reported and the scan resumes after it, so the
+     * results are the leftmost, non-overlapping matches, each as long as
+     * parse() would make it. Offsets that cannot start a match are skipped
+     * with ByteSet::find.
+     *
+     * @param ruleName Name of the grammar rule to search for
+     * @param input The text to search
+     * @param matches Output: the matches in input order (cleared first)
+     * @return Number of matches
+     */
+    size_t search(const std::string& ruleName,
+                  const std::string& input,
+                  std::vector<SearchMatch>& matches) const;
+
+    /**
+     * @brief Parses input with the first of several start rules that matches.
+     *
+     * Gives the result of calling parse() with each rule in turn until one
+     * returns a tree, without rescanning the input per rule:
+     * - Rules whose FIRST set excludes the first significant byte (and that
+     *   cannot match the empty string) are never tried. The candidates for
+     *   each byte come from a table built once per rule list and grammar.
+     * - With several candidates, each is recognized without building nodes,
+     *   and only the first one that matches is parsed into a tree. Rule
+     *   results at each position are shared between the candidates, so
+     *   common sub-rules are matched once.
+     *
+     * @param ruleNames Start rules in priority order
+     * @param input The text to parse
+     * @param consumed Output parameter for the number of characters consumed
+     * @param which Output: index in ruleNames of the rule that matched, or ruleNames.size()
+     * @return Pointer to the root AST node, or nullptr if no rule matched
+     */
+    ASTNode* parseAny(const std::vector<std::string>& ruleNames,
+                      const std::string& input,
+                      size_t& consumed,
+                      size_t& which) const;
+
+    /**
+     * @brief Parses input and folds semantic action values instead of building a tree.
+     *
+     * No AST nodes are allocated. Matches of rules with actions are recorded
+     * during the parse and dropped again when their branch is rolled back;
+     * once the parse has succeeded the surviving matches run their actions
+     * bottom-up. If the start rule has an action its value is the result,
+     * otherwise the last top-level value is.
+     *
+     * @param ruleName Name of the grammar rule to use as starting point
+     * @param input The text to parse
+     * @param actions Actions by rule name
+     * @param result Output parameter for the folded value
+     * @param consumed Output parameter for the number of characters consumed
+     * @return true if parsing succeeded, false otherwise
+     */
+    bool parseWithActions(const std::string& ruleName,
+                          const std::string& input,
+                          const SemanticActions& actions,
+                          SemanticValue& result,
+                          size_t& consumed) const;
+
+    /**
+     * @brief Fills a ParseStats during each later call.
+     *
+     * Every call to parse(), parseFull(), matchFull(), search(), parseAny()
+     * or parseWithActions() clears the stats and counts its own work into
+     * them. Bytes count as backtracked when a match that consumed them is
+     * undone: a sequence failing after some elements, a losing or superseded
+     * alternative branch, a predicate's lookahead, a full-match node that
+     * stops short, or a recognition pass that is parsed again into a tree.
+     *
+     * @param stats Stats to fill (must outlive its use), or null to stop counting
+     */
+    void collectStats(ParseStats* stats);
+
+    /**
+     * @brief Counts which branch wins each alternative during later parses.
+     *
+     * Use on a sample corpus, then compile with the profile (orderBranches(),
+     * or GrammarHandle::publish()) so the common branches are tried first.
+     *
+     * @param profile Profile to add to, or null to stop recording
+     */
+    void recordBranches(BranchProfile* profile);
+
+    /**
+     * @brief Recompiles the grammar with alternatives ordered by a profile.
+     *
+     * Parses return the same results: ties still go to the branch written
+     * first. The work changes, because branches whose maximum length cannot
+     * beat the best match so far are skipped, and the best match is now
+     * usually found first. Has no effect on a parser built from a snapshot.
+     *
+     * @param profile Profile to order by (must outlive the parser), or null for the written order
+     */
+    void orderBranches(const BranchProfile* profile);
+
+    /**
+     * @brief Compiles only the start rules this parser is used with.
+     *
+     * From now on the parser compiles the hot rules and the rules they
+     * reach (see CompiledGrammar). Each new start rule a call uses adds the
+     * rules it reaches that are not compiled yet to the same compilation
+     * (CompiledGrammar::addStartRule()). Results do not change. For grammars with many rules
+     * of which the parser uses few. Branch profiles are not applied to
+     * such compilations. Has no effect on a parser built from a snapshot
+     * (see GrammarHandle::publishLazy()).
+     *
+     * @param hotRules Start rules to compile on next use
+     */
+    void compileLazily(const std::vector<std::string>& hotRules);
+
+    /**
+     * @brief Lets this parser reorder alternatives by the wins it has seen.
+     *
+     * The parser counts the winning branch of every alternative and, every
+     * `interval` parses, re-sorts each alternative's try order by those
+     * counts, then halves them so the order follows recent input. Results
+     * do not change (see orderBranches()). The counts and orders belong to
+     * this parser, not to the compiled grammar, so parsers on other threads
+     * sharing a published version neither see nor contend on them.
+     *
+     * @param interval Parses between re-sorts, or 0 to turn adaptation off
+     */
+    void adaptBranches(unsigned int interval);
+
+    /**
+     * @brief Which branch of an alternative this parser tries i-th.
+     * @param node Compiled index of an alternative node
+     * @param i Try position
+     * @return Position of the branch as written
+     */
+    unsigned int branchTriedAt(unsigned int node, unsigned int i) const;
+
+    /**
+     * @brief Chooses which rules parse(), parseFull(), matchFull() and search() memoize.
+     *
+     * A memoized rule's result (failure, or where its match ends) is kept
+     * per input position for the rest of the call, so trying the rule there
+     * again costs one lookup. In a parse that builds a tree, an alternative
+     * with more than one viable branch is first recognized (memoized rules
+     * make the losing branches cheap) and then only its winning branch is
+     * built. Results do not change.
+     *
+     * Memoizing pays only for rules that are tried again at the same
+     * position: MEMO_REENTRANT picks those from the grammar's structure (see
+     * CompiledGrammar). To pick them from a workload instead, parse a sample
+     * with MEMO_ALL, read memoReport(), and pass the rules with hits to
+     * memoizeRules(). Not used during incremental reparsing.
+     *
+     * @param mode Rules to memoize
+     */
+    void memoize(MemoMode mode);
+
+    /**
+     * @brief Memoizes the given rules only (MEMO_LISTED).
+     * @param ruleNames Rules to memoize; unknown names are ignored
+     */
+    void memoizeRules(const std::vector<std::string>& ruleNames);
+
+    /**
+     * @brief Reports memo use per rule since the last reset.
+     *
+     * Counts accumulate over calls and are reset when the grammar is
+     * recompiled or the memoized rules change. Rules never looked up are
+     * left out. A memoized rule with few hits per lookup costs more than it
+     * saves.
+     *
+     * @param stats Output: one entry per rule looked up, in rule order (cleared first)
+     */
+    void memoReport(std::vector<MemoRuleStats>& stats) const;
+
+    /**
+     * @brief Resets the counts reported by memoReport().
+     */
+    void resetMemoStats();
+
+    /**
+     * @brief Returns the compiled form of the grammar, compiling it if needed.
+     */
+    const CompiledGrammar& compiledGrammar() const;
+
 private:
-    struct FirstInfo {
-        std::bitset<256> chars;
-        bool nullable;
-        FirstInfo() : nullable(false) {}
+    const CompiledGrammar& compiledFor(const std::string& ruleName) const;
+
+    friend class IncrementalParser;
+
+    typedef CompiledGrammar::Node Node;
+
+    /**
+     * @brief A deferred action: one match of a rule that has an action.
+     * Records are appended when the rule completes, so a record's
+     * descendants are the `descendants` records right before it.
+     */
+    struct ActionRecord {
+        unsigned int rule;       ///< Compiled rule index
+        size_t start;            ///< Match start
+        size_t end;              ///< Match end (exclusive)
+        size_t descendants;      ///< Records in this match's subtree
+    };
+
+    struct BoundAction {
+        SemanticAction action;
+        void* userData;
+    };
+
+    /**
+     * @brief Start rule candidates by first byte, for parseAny.
+     */
+    struct DispatchTable {
+        const CompiledGrammar* grammar;        ///< Grammar the table was built for
+        unsigned long revision;                ///< Its revision
+        std::vector<std::string> names;        ///< Start rules it was built for
+        std::vector<unsigned int> rules;       ///< Rule index per name (NO_RULE if unknown)
+        std::vector<unsigned int> offsets;     ///< Candidates of byte b: [offsets[b], offsets[b + 1]); 256 is end of input
+        std::vector<unsigned int> candidates;  ///< Indexes into names, ascending per byte
+
+        DispatchTable() : grammar(0), revision(0) {}
+    };
+
+    /**
+     * @brief Per-parser try order of alternatives, for adaptBranches.
+     * Both vectors are indexed like the compiled edge array.
+     */
+    struct AdaptiveOrder {
+        unsigned int interval;              ///< Parses between re-sorts (0: off)
+        unsigned int parses;                ///< Parses since the last re-sort
+        std::vector<unsigned int> order;    ///< Child index tried at each position
+        std::vector<unsigned int> wins;     ///< Recent wins per child
+
+        AdaptiveOrder() : interval(0), parses(0) {}
+    };
+
+    /**
+     * @brief Rules memoized by this parser, and their memo counts.
+     * Both vectors are indexed by compiled rule.
+     */
+    struct MemoSelection {
+        MemoMode mode;                        ///< Selected mode
+        std::vector<std::string> names;       ///< Rules given to memoizeRules
+        const CompiledGrammar* grammar;       ///< Grammar `rules` was built for (null: rebuild)
+        unsigned long revision;               ///< Its revision
+        std::vector<unsigned char> rules;     ///< Whether each rule is memoized
+        std::vector<MemoRuleStats> stats;     ///< Memo use per rule
+
+        MemoSelection() : mode(MEMO_OFF), grammar(0), revision(0) {}
     };
 
     const Grammar& grammar;  ///< Reference to the grammar rules
-    mutable std::map<Expression*, FirstInfo> firstCache; ///< FIRST-set memo
+    mutable const CompiledGrammar* compiled;  ///< Compiled grammar (owned unless pinned)
+    GrammarHandle::Snapshot* pinned;          ///< Published version in use, if any (owned)
+    mutable unsigned long compiledRevision;   ///< Grammar revision it was built from
+    bool lazy;                                ///< Compile only the start rules used (compileLazily())
+    mutable std::vector<std::string> lazyRules;  ///< Start rules compiled so far
+    mutable size_t furthest;                  ///< Furthest offset inspected (exclusive)
+    mutable unsigned int recognizing;         ///< Depth of node-less matching (transparent rules)
+    mutable unsigned int lexical;             ///< Depth of token matching (no skipping)
+    mutable bool anchored;                    ///< Current node must end at the end of input (full match)
+    mutable IncrementalParser* incremental;   ///< Active incremental session, if any
+    mutable const std::vector<BoundAction>* actionTable;  ///< Actions by rule index during parseWithActions
+    mutable std::vector<ActionRecord> trail;  ///< Matches whose actions are pending
+    mutable ParseMemo* memo;                  ///< Rule results shared between parses, if any
+    mutable ParseMemo dispatchMemo;           ///< Memo used by parseAny
+    mutable DispatchTable dispatch;           ///< Table of the last parseAny rule list
+    const BranchProfile* branchOrder;         ///< Profile alternatives are compiled in the order of
+    BranchProfile* recorder;                  ///< Profile receiving alternative wins, if any
+    mutable AdaptiveOrder adaptive;           ///< Try order learned by this parser
+    mutable ParseMemo parseMemo;              ///< Memo used by parses when memoize() is on
+    mutable MemoSelection memoized;           ///< Rules memoize() selected
+    mutable bool memoEvery;                   ///< Active memo covers every rule, not just the selected ones
+    mutable unsigned int winner;              ///< Child index of the last alternative's best branch
+    mutable unsigned int replaying;           ///< Depth of building a branch already recognized (wins not recorded)
+    ParseStats* parseStats;                   ///< Stats filled by each call, if any
+    mutable unsigned int depth;               ///< Expressions currently being evaluated
+
+    /**
+     * @brief Drops pending actions recorded after the given trail size.
+     */
+    inline void rollbackActions(size_t mark) const {
+        if (trail.size() > mark) trail.resize(mark);
+    }
 
     /**
-     * @brief Removes surrounding quotes from a string.
-     * @param s The string to process
-     * @return String with quotes removed if present
+     * @brief Records that input up to (excluding) the given offset was inspected.
+     * An offset of input.size() + 1 means the end of input was observed.
      */
-    std::string stripQuotes(const std::string& s) const;
+    inline void touch(size_t end) const {
+        if (end > furthest) furthest = end;
+    }
+
+    /**
+     * @brief Skips bytes of the grammar's skip set unless inside a token.
+     * @return Offset of the next significant byte
+     */
+    inline size_t skipSpace(const std::string& input, size_t pos) const {
+        const ByteSet* skip = compiled->skipSet();
+        if (!skip || lexical) return pos;
+        size_t next = skip->span(input.data(), pos, input.size());
+        touch(next + 1);
+        return next;
+    }
+
+    /**
+     * @brief Start of the text of a node that matched [start, end).
+     * Skipped bytes before its first token are not part of it.
+     */
+    inline size_t spanStart(const std::string& input, size_t start, size_t end) const {
+        const ByteSet* skip = compiled->skipSet();
+        if (!skip || lexical || start == end) return start;
+        return skip->span(input.data(), start, end);
+    }
+
+    /**
+     * @brief Allocates an AST node, counting it in the stats.
+     */
+    inline ASTNode* newNode(const std::string& symbol) const {
+        if (parseStats) ++parseStats->nodesCreated;
+        return new ASTNode(symbol);
+    }
+
+    /**
+     * @brief Counts bytes whose match was undone.
+     */
+    inline void backtracked(size_t bytes) const {
+        if (parseStats) parseStats->backtrackedBytes += bytes;
+    }
+
+    /**
+     * @brief Clears the stats at the start of a call.
+     */
+    inline void beginStats() const {
+        depth = 0;
+        if (parseStats) parseStats->clear();
+    }
+
+    /**
+     * @brief Deletes a subtree built during this parse.
+     * @param node Subtree to delete (may be null)
+     */
+    void discardNode(ASTNode* node) const;
+
+    BNFParser(const BNFParser&);
+    BNFParser& operator=(const BNFParser&);
+
+    /**
+     * @brief Resets the adaptive try order to the compiled order.
+     */
+    void resetAdaptiveOrder() const;
+
+    /**
+     * @brief Gives alternatives from a node on their compiled order; earlier ones keep theirs.
+     */
+    void extendAdaptiveOrder(unsigned int firstNode) const;
+
+    /**
+     * @brief Re-sorts the adaptive try order by recent wins and decays them.
+     */
+    void reorderAdaptive() const;
+
+    /**
+     * @brief Counts a parse and re-sorts the adaptive order when due.
+     */
+    inline void adaptiveTick() const {
+        if (adaptive.interval && ++adaptive.parses >= adaptive.interval) reorderAdaptive();
+    }
+
+    /**
+     * @brief Clears a memo and makes it the active one for a call.
+     * @param cg Compiled grammar of the call
+     * @param table Memo to use
+     * @param every Whether to memoize every rule instead of the selected ones
+     */
+    void beginMemo(const CompiledGrammar& cg, ParseMemo& table, bool every) const;
+
+    /**
+     * @brief Returns the dispatch table for a list of start rules, rebuilding it if needed.
+     */
+    const DispatchTable& dispatchTable(const CompiledGrammar& cg,
+                                       const std::vector<std::string>& ruleNames) const;
+
+    /**
+     * @brief Parses from a start rule, as a prefix or as the whole input.
+     * @param ruleName Name of the start rule
+     * @param input The input text
+     * @param full Whether the match has to cover all of input
+     * @param consumed Output parameter for the number of characters consumed
+     * @param root Output parameter for the root AST node (null on failure)
+     * @return true if parsing succeeded, false otherwise
+     */
+    bool parseRoot(const std::string& ruleName,
+                   const std::string& input,
+                   bool full,
+                   size_t& consumed,
+                   ASTNode*& root) const;
 
     /**
      * @brief Recursively parses an expression and builds AST nodes.
-     * @param expr The expression to parse
+     * @param id Index of the compiled node to parse
      * @param input The input text
      * @param pos Current position in input (updated during parsing)
      * @param outNode Output parameter for the generated AST node
      * @return true if parsing succeeded, false otherwise
      */
-    bool parseExpression(Expression* expr,
+    bool parseExpression(unsigned int id,
                          const std::string& input,
                          size_t& pos,
                          ASTNode*& outNode) const;
 
+    /**
+     * @brief Parses a node according to its kind (called by parseExpression).
+     * @param n The compiled node to parse
+     * @param input The input text
+     * @param pos Current position in input (updated during parsing)
+     * @param outNode Output parameter for the generated AST node
+     * @return true if parsing succeeded, false otherwise
+     */
+    bool parseNode(const Node& n,
+                   const std::string& input,
+                   size_t& pos,
+                   ASTNode*& outNode) const;
+
     /**
      * @brief Parses terminal expressions (quoted strings).
-     * @param expr The terminal expression to parse
+     * @param n The compiled terminal node to parse
      * @param input The input text
      * @param pos Current position in input (updated during parsing)
      * @param outNode Output parameter for the generated AST node
      * @return true if parsing succeeded, false otherwise
      */
-    bool parseTerminal(Expression* expr,
+    bool parseTerminal(const Node& n,
                        const std::string& input,
                        size_t& pos,
                        ASTNode*& outNode) const;
 
     /**
      * @brief Parses symbol expressions (non-terminal references).
-     * @param expr The symbol expression to parse
+     * @param n The compiled symbol node to parse
      * @param input The input text
      * @param pos Current position in input (updated during parsing)
      * @param outNode Output parameter for the generated AST node
      * @return true if parsing succeeded, false otherwise
      */
-    bool parseSymbol(Expression* expr,
+    bool parseSymbol(const Node& n,
                      const std::string& input,
                      size_t& pos,
                      ASTNode*& outNode) const;
 
     /**
      * @brief Parses sequence expressions (ordered list of sub-expressions).
-     * @param expr The sequence expression to parse
+     * @param n The compiled sequence node to parse
      * @param input The input text
      * @param pos Current position in input (updated during parsing)
      * @param outNode Output parameter for the generated AST node
      * @return true if parsing succeeded, false otherwise
      */
-    bool parseSequence(Expression* expr,
+    bool parseSequence(const Node& n,
                        const std::string& input,
                        size_t& pos,
                        ASTNode*& outNode) const;
 
     /**
      * @brief Parses alternative expressions (choice between sub-expressions).
-     * @param expr The alternative expression to parse
+     * @param n The compiled alternative node to parse
      * @param input The input text
      * @param pos Current position in input (updated during parsing)
      * @param outNode Output parameter for the generated AST node
      * @return true if parsing succeeded, false otherwise
      */
-    bool parseAlternative(Expression* expr,
+    bool parseAlternative(const Node& n,
                           const std::string& input,
                           size_t& pos,
                           ASTNode*& outNode) const;
 
     /**
      * @brief Parses optional expressions (zero or one occurrence).
-     * @param expr The optional expression to parse
+     * @param n The compiled optional node to parse
      * @param input The input text
      * @param pos Current position in input (updated during parsing)
      * @param outNode Output parameter for the generated AST node
      * @return true if parsing succeeded, false otherwise
      */
-    bool parseOptional(Expression* expr,
+    bool parseOptional(const Node& n,
                        const std::string& input,
                        size_t& pos,
                        ASTNode*& outNode) const;
 
     /**
      * @brief Parses repetition expressions (zero or more occurrences).
-     * @param expr The repetition expression to parse
+     * @param n The compiled repetition node to parse
      * @param input The input text
      * @param pos Current position in input (updated during parsing)
      * @param outNode Output parameter for the generated AST node
      * @return true if parsing succeeded, false otherwise
      */
-    bool parseRepeat(Expression* expr,
+    bool parseRepeat(const Node& n,
                      const std::string& input,
                      size_t& pos,
                      ASTNode*& outNode) const;
 
+    /**
+     * @brief Evaluates an and/not predicate without consuming input or building nodes.
+     * @param n The compiled predicate node
+     * @param input The input text
+     * @param pos Current position in input (never changed)
+     * @param outNode Output parameter, never set
+     * @return true if the predicate holds, false otherwise
+     */
+    bool parsePredicate(const Node& n,
+                        const std::string& input,
+                        size_t& pos,
+                        ASTNode*& outNode) const;
+
     /**
      * @brief Parses character range expressions.
-     * @param expr The character range expression to parse
+     * @param n The compiled character range node to parse
      * @param input The input text
      * @param pos Current position in input (updated during parsing)
      * @param outNode Output parameter for the generated AST node
      * @return true if parsing succeeded, false otherwise
      */
-    bool parseCharRange(Expression* expr,
+    bool parseCharRange(const Node& n,
                         const std::string& input,
                         size_t& pos,
                         ASTNode*& outNode) const;
 
     /**
      * @brief Parses character class expressions.
-     * @param expr The character class expression to parse
+     * @param n The compiled character class node to parse
      * @param input The input text
      * @param pos Current position in input (updated during parsing)
      * @param outNode Output parameter for the generated AST node
      * @return true if parsing succeeded, false otherwise
      */
-    bool parseCharClass(Expression* expr,
+    bool parseCharClass(const Node& n,
                         const std::string& input,
                         size_t& pos,
                         ASTNode*& outNode) const;
-
-    // FIRST-set computation with memoization
-    const FirstInfo& computeFirst(Expression* expr) const;
-    void mergeFirst(FirstInfo& dst, const FirstInfo& src) const;
-    void addChar(FirstInfo& fi, unsigned char c) const;
-    std::string terminalFirstString(Expression* expr) const;
 };
 
 #endif
@@ -28,6 +28,8 @@ struct Token {
         TOK_PIPE,       ///< Pipe operator |
         TOK_ELLIPSIS,   ///< Ellipsis ... for ranges
         TOK_CARET,      ///< Caret ^ for exclusion
+        TOK_AMPERSAND,  ///< And-predicate &
+        TOK_BANG,       ///< Not-predicate !
         TOK_HEX,        ///< Hexadecimal literal 0xNN
         TOK_WORD,       ///< Simple word token
         TOK_END         ///< End of input marker
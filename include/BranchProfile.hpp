@@ -0,0 +1,57 @@
+#ifndef BRANCH_PROFILE_HPP
+#define BRANCH_PROFILE_HPP
+
+#include <vector>
+#include <iosfwd>
+#include <cstddef>
+
+/**
+ * @brief How often each branch of each alternative won, over a sample corpus.
+ *
+ * Alternatives are identified by their compiled node index and branches by
+ * their position in the grammar as written. Compilation is deterministic,
+ * so a profile applies to any compilation of the same rules added in the
+ * same order, including one in another process (see save() and load()).
+ *
+ * A parser records into a profile with BNFParser::recordBranches(). A
+ * CompiledGrammar built with a profile tries the branches of each
+ * alternative most frequent first (see CompiledGrammar::branchRank()).
+ */
+class BranchProfile {
+public:
+    BranchProfile();
+
+    /**
+     * @brief Counts one win of a branch.
+     * @param node Compiled index of the alternative node
+     * @param branch Position of the winning branch as written
+     */
+    void record(unsigned int node, unsigned int branch);
+
+    /** @brief Number of wins of a branch. */
+    unsigned long wins(unsigned int node, unsigned int branch) const;
+
+    /** @brief Total number of wins recorded. */
+    unsigned long total() const { return recorded; }
+
+    /** @brief Forgets every count. */
+    void clear();
+
+    /**
+     * @brief Writes the profile as text, one line per alternative node:
+     * the node index followed by the win count of each branch.
+     */
+    void save(std::ostream& out) const;
+
+    /**
+     * @brief Adds the counts of a saved profile.
+     * @return false if the text is malformed (counts read so far are kept)
+     */
+    bool load(std::istream& in);
+
+private:
+    std::vector<std::vector<unsigned long> > counts;  ///< Wins by node, then branch
+    unsigned long recorded;
+};
+
+#endif
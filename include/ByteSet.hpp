@@ -0,0 +1,59 @@
+#ifndef BYTE_SET_HPP
+#define BYTE_SET_HPP
+
+#include <bitset>
+#include <cstddef>
+
+/**
+ * @brief A set of bytes with fast scans for runs of members and for the
+ * next member.
+ *
+ * Membership is a 256-entry table. The set is also kept as a list of
+ * contiguous byte ranges when it has at most MAX_VECTOR_RANGES of them
+ * (whitespace is 3, identifier starts 2-3). When SSE2 is available, span()
+ * and find() then test 16 input bytes at a time against every range
+ * instead of one byte per iteration. A single-byte set uses memchr.
+ */
+class ByteSet {
+public:
+    static const unsigned int MAX_VECTOR_RANGES = 8;
+
+    /** @brief Constructs an empty set. */
+    ByteSet();
+
+    /** @brief Constructs the set of the bits set in a bitmap. */
+    explicit ByteSet(const std::bitset<256>& bits);
+
+    bool test(unsigned char c) const { return table[c] != 0; }
+    bool empty() const { return count == 0; }
+
+    /** @brief Number of bytes in the set. */
+    unsigned int size() const { return count; }
+
+    /**
+     * @brief Skips a run of member bytes.
+     * @param data Buffer to scan
+     * @param pos Offset to start at
+     * @param end Offset to stop at
+     * @return Offset of the first non-member byte at or after pos, or end
+     */
+    size_t span(const char* data, size_t pos, size_t end) const;
+
+    /**
+     * @brief Finds the next member byte.
+     * @param data Buffer to scan
+     * @param pos Offset to start at
+     * @param end Offset to stop at
+     * @return Offset of the first member byte at or after pos, or end
+     */
+    size_t find(const char* data, size_t pos, size_t end) const;
+
+private:
+    unsigned char table[256];
+    unsigned char low[MAX_VECTOR_RANGES];    ///< Range starts, valid when ranges <= MAX_VECTOR_RANGES
+    unsigned char width[MAX_VECTOR_RANGES];  ///< Range end minus start
+    unsigned int ranges;                     ///< Number of contiguous ranges
+    unsigned int count;
+};
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef COMPILED_GRAMMAR_HPP
+#define COMPILED_GRAMMAR_HPP
+
+#include <string>
+#include <vector>
+#include <bitset>
+#include <map>
+#include <set>
+#include "Grammar.hpp"
+#include "ByteSet.hpp"
+
+class TokenScanner;
+class BranchProfile;
+
+/**
+ * @brief Compact, read-only form of a Grammar used by the parser.
+ *
+ * Every Expression carries a bitmap, a range, a string and a child vector
+ * whatever its type. A compiled grammar lowers the expression graph into
+ * fixed-size nodes that only hold the payload of their own kind:
+ *
+ * - EXPR_TERMINAL: offset and length in a shared literal pool
+ * - EXPR_SYMBOL: resolved rule index and name index
+ * - EXPR_CHAR_RANGE: start and end byte
+ * - EXPR_CHAR_CLASS: index of the bitmap in a deduplicated side table
+ * - EXPR_OPTIONAL / EXPR_REPEAT / predicates: index of the single child
+ * - EXPR_SEQUENCE / EXPR_ALTERNATIVE: offset and count in the shared edge array
+ *
+ * Nodes are numbered in preorder, rule by rule, and every node's children
+ * are stored contiguously in one edge array in the same order, so walking a
+ * rule moves forward through both arrays instead of chasing a separately
+ * allocated child vector per node.
+ *
+ * FIRST sets are computed once at construction and stored in the same
+ * bitmap table, so identical classes and FIRST sets share one entry.
+ * Nodes shared by the expression interner stay shared.
+ *
+ * FOLLOW sets (the bytes that can come right after a node, plus whether the
+ * end of input can) are derived from the FIRST sets on request, for the
+ * start rules the caller names; the parser does not need them, so they are
+ * not kept.
+ *
+ * The minimum and maximum number of bytes every node can match are computed
+ * at the same time. The minimum is also kept in the node itself (saturated to
+ * 16 bits, which keeps it a valid lower bound) so the parser can reject a
+ * node that cannot fit in the remaining input without touching another table.
+ *
+ * Every token rule ("@<name> ::= ...") gets a TokenScanner, built last.
+ * The grammar's skip rule, if any, is reduced to the ByteSet it matches.
+ *
+ * For every rule the longest literal that every match must contain is
+ * extracted (terminals of sequences, literals shared by all alternatives),
+ * so search can skip text that does not contain it.
+ *
+ * Rules that can be tried twice at the same position are marked reentrant:
+ * rules in the common prefix of two alternative branches that can start
+ * with the same byte, or of an optional or repetition body and the element
+ * after it (the body's failed attempt is followed by that element). These
+ * are the rules worth memoizing.
+ *
+ * A grammar can also be compiled for a few start rules only, leaving out
+ * every rule parses from them cannot reach (see the second constructor).
+ * Such a compilation can take more start rules later (addStartRule()):
+ * only the rules not compiled yet are lowered and analyzed, after the
+ * existing ones.
+ *
+ * Given a BranchProfile, the branches of each profiled alternative are
+ * stored most frequent winner first. Each edge then keeps the branch's
+ * position as written, which the parser uses to break ties, so the order
+ * never changes a result.
+ */
+class CompiledGrammar {
+public:
+    /**
+     * @brief Node kinds; all but NODE_FAIL mirror Expression::Type.
+     */
+    enum Kind {
+        NODE_SEQUENCE    = Expression::EXPR_SEQUENCE,
+        NODE_ALTERNATIVE = Expression::EXPR_ALTERNATIVE,
+        NODE_OPTIONAL    = Expression::EXPR_OPTIONAL,
+        NODE_REPEAT      = Expression::EXPR_REPEAT,
+        NODE_SYMBOL      = Expression::EXPR_SYMBOL,
+        NODE_TERMINAL    = Expression::EXPR_TERMINAL,
+        NODE_CHAR_RANGE  = Expression::EXPR_CHAR_RANGE,
+        NODE_CHAR_CLASS  = Expression::EXPR_CHAR_CLASS,
+        NODE_AND         = Expression::EXPR_AND_PREDICATE,
+        NODE_NOT         = Expression::EXPR_NOT_PREDICATE,
+        NODE_FAIL        ///< Missing expression; never matches
+    };
+
+    /**
+     * @brief Node flags.
+     */
+    enum Flag {
+        FLAG_NULLABLE    = 1, ///< Node can match the empty string
+        FLAG_TRANSPARENT = 4, ///< Never produces an AST node (transparent symbol or predicate)
+        FLAG_TOKEN       = 8  ///< Symbol referencing a token rule
+    };
+
+    /**
+     * @brief A compiled expression node (16 bytes).
+     */
+    struct Node {
+        unsigned char kind;    ///< One of Kind
+        unsigned char flags;   ///< Combination of Flag
+        unsigned short minLen; ///< Minimum match length, saturated at 0xFFFF
+        unsigned int a;        ///< First payload word (see class comment)
+        unsigned int b;        ///< Second payload word (see class comment)
+        unsigned int first;    ///< Bitmap index of the node's FIRST set
+    };
+
+    /**
+     * @brief A compiled rule.
+     */
+    struct RuleInfo {
+        unsigned int root;     ///< Root node index
+        unsigned int name;     ///< Index in the name table
+        bool transparent;      ///< Matched without building nodes
+        bool token;            ///< Matched by a TokenScanner as a single leaf
+        bool reentrant;        ///< Can be tried again at a position it was tried at
+    };
+
+    static const unsigned int NO_RULE;    ///< Rule index of unresolved symbols
+    static const unsigned int UNBOUNDED;  ///< Length of repetitions and recursion
+
+    /**
+     * @brief Compiles the current rules of a grammar.
+     * @param g Grammar to compile; not referenced after construction
+     * @param profile Branch wins to order alternatives by (optional, not referenced after construction)
+     */
+    explicit CompiledGrammar(const Grammar& g, const BranchProfile* profile = 0);
+
+    /**
+     * @brief Compiles only the rules parses from some start rules can reach.
+     *
+     * The start rules, every rule they refer to directly or indirectly, and
+     * the skip rule are compiled and analyzed as if they were the whole
+     * grammar; findRule() does not know the others. Results of parses from
+     * these rules are the same as with the whole grammar.
+     *
+     * @param g Grammar to compile; not referenced after construction
+     * @param startRules Names of the start rules (unknown names are ignored)
+     */
+    CompiledGrammar(const Grammar& g, const std::vector<std::string>& startRules);
+
+    /**
+     * @brief Copies a compilation, token scanners included.
+     *
+     * The copy can be extended with addStartRule() while other threads
+     * keep using the original.
+     */
+    CompiledGrammar(const CompiledGrammar& other);
+
+    /**
+     * @brief Deletes the token scanners.
+     */
+    ~CompiledGrammar();
+
+    /**
+     * @brief Adds a start rule to a compilation for some start rules.
+     *
+     * The rule and the rules it reaches that are not compiled yet get the
+     * next rule indices and nodes; existing rules and nodes keep theirs,
+     * with their tables, and only their reentrant marks can change. The
+     * grammar must be the one compiled, unchanged since, and no other
+     * thread may use this compilation meanwhile.
+     *
+     * @param g Grammar the compilation was made from
+     * @param rule Name of the start rule
+     * @return Whether the rule is compiled (false if the grammar has no such rule)
+     */
+    bool addStartRule(const Grammar& g, const std::string& rule);
+
+    /**
+     * @brief Looks up a rule by name.
+     * @param name Rule name, including angle brackets
+     * @return Rule index, or NO_RULE if the grammar has no such rule
+     */
+    unsigned int findRule(const std::string& name) const;
+
+    const Node& node(unsigned int id) const { return nodes[id]; }
+    const RuleInfo& rule(unsigned int id) const { return rules[id]; }
+    const std::string& name(unsigned int id) const { return names[id]; }
+    const std::bitset<256>& bitmap(unsigned int id) const { return bitmaps[id]; }
+
+    /** @brief Number of children of a sequence or alternative node. */
+    unsigned int childCount(const Node& n) const { return n.b; }
+
+    /** @brief i-th child of a sequence or alternative node. */
+    unsigned int child(const Node& n, unsigned int i) const { return edges[n.a + i]; }
+
+    /** @brief Position as written of the i-th child of an alternative node. */
+    unsigned int branchRank(const Node& n, unsigned int i) const { return ranks.empty() ? i : ranks[n.a + i]; }
+
+    /** @brief Pointer to the bytes of a terminal node (n.b bytes long). */
+    const char* literal(const Node& n) const { return literals.data() + n.a; }
+
+    /** @brief FIRST set of a node. */
+    const std::bitset<256>& first(const Node& n) const { return bitmaps[n.first]; }
+
+    /** @brief Whether a node can match the empty string. */
+    static bool nullable(const Node& n) { return (n.flags & FLAG_NULLABLE) != 0; }
+
+    /**
+     * @brief Computes the FOLLOW sets of all nodes in one pass.
+     * @param startRules Indices of the rules parses start from; the end of input follows them
+     * @param follow Receives the bytes that can follow each node in some derivation
+     * @param atEnd Receives whether the end of input can follow each node
+     */
+    void followSets(const std::vector<unsigned int>& startRules,
+                    std::vector<std::bitset<256> >& follow, std::vector<bool>& atEnd) const;
+
+    /**
+     * @brief Shortest match of a node in bytes.
+     * @return UNBOUNDED if the node can never match
+     */
+    unsigned int minLength(unsigned int id) const { return minLengths[id]; }
+
+    /**
+     * @brief Longest match of a node in bytes.
+     * @return UNBOUNDED if the node contains a repetition or recursion that consumes input
+     */
+    unsigned int maxLength(unsigned int id) const { return maxLengths[id]; }
+
+    /**
+     * @brief Scanner of a token rule.
+     * @return The scanner, or null if the rule is not a token
+     */
+    const TokenScanner* scanner(unsigned int rule) const { return scanners[rule]; }
+
+    /**
+     * @brief Longest literal contained in every match of a rule.
+     * @return The literal, or an empty string if none is known
+     */
+    const std::string& requiredLiteral(unsigned int rule) const { return requiredLiterals[rule]; }
+
+    /**
+     * @brief Bytes skipped between tokens.
+     * @return The set, or null if the grammar has no (valid) skip rule
+     */
+    const ByteSet* skipSet() const { return skipBytes.empty() ? 0 : &skipBytes; }
+
+    size_t nodeCount() const { return nodes.size(); }
+    size_t ruleCount() const { return rules.size(); }
+    size_t bitmapCount() const { return bitmaps.size(); }
+    size_t edgeCount() const { return edges.size(); }
+
+    /**
+     * @brief Approximate heap footprint of the compiled tables in bytes.
+     */
+    size_t memoryUsage() const;
+
+private:
+    CompiledGrammar& operator=(const CompiledGrammar&);
+
+    /**
+     * @brief Dependency graph of the node analyses, split into strongly connected components.
+     *
+     * A node depends on its children and a symbol on its rule's root; the
+     * operand of a predicate is left out since it matches no bytes either
+     * way. Components come dependencies first, so every analysis can finish
+     * one component before it reads it from the next. Only nodes from base
+     * on are split; node-indexed vectors are indexed from base.
+     */
+    struct Components {
+        unsigned int base;                    ///< First node analyzed; earlier nodes are final
+        std::vector<unsigned int> depStart;   ///< Offset of each node's dependencies in deps, plus the end
+        std::vector<unsigned int> deps;       ///< Nodes each node is computed from
+        std::vector<unsigned int> userStart;  ///< Offset of each node's users in users, plus the end
+        std::vector<unsigned int> users;      ///< Nodes computed from each node
+        std::vector<unsigned int> members;    ///< Nodes grouped by component, dependencies first
+        std::vector<unsigned int> bounds;     ///< Offset of each component in members, plus the end
+        std::vector<unsigned int> component;  ///< Component of each node
+
+        /** @brief Whether a node belongs to a component. */
+        bool contains(unsigned int id, unsigned int comp) const {
+            return id >= base && component[id - base] == comp;
+        }
+    };
+
+    void compile(const Grammar& g, const std::set<const Rule*>* only, const BranchProfile* profile);
+    void addRuleInfo(const Rule* src);
+    void extend(const std::vector<const Rule*>& sources, unsigned int firstRule);
+    unsigned int lower(const Expression* expr);
+    unsigned int addNode(Kind kind, unsigned int a, unsigned int b);
+    unsigned int internBitmap(const std::bitset<256>& bits);
+    unsigned int symbolName(const std::string& name, unsigned int& ruleIndex);
+    void findComponents(Components& c, unsigned int base) const;
+    bool cyclic(const Components& c, unsigned int comp) const;
+    void computeFirstSets(const Components& c);
+    bool updateFirst(unsigned int id, unsigned int base, std::vector<std::bitset<256> >& first,
+                     std::vector<bool>& nullable) const;
+    const std::bitset<256>& firstSoFar(unsigned int id, unsigned int base,
+                                       const std::vector<std::bitset<256> >& first) const;
+    bool nullableSoFar(unsigned int id, unsigned int base, const std::vector<bool>& nullable) const;
+    void computeLengths(const Components& c);
+    bool updateMinLength(unsigned int id);
+    unsigned int maxLengthOf(unsigned int id, const Components& c, unsigned int inside) const;
+    void buildScanners(unsigned int firstRule);
+    bool singleBytes(unsigned int id, std::bitset<256>& bits, unsigned int depth) const;
+    void computeRequiredLiterals(unsigned int firstRule);
+    void computeReentrant(unsigned int firstNode);
+    bool overlap(unsigned int a, unsigned int b) const;
+    bool markSharedPrefix(unsigned int a, unsigned int b, unsigned int depth);
+    void markSymbols(unsigned int id);
+    void orderBranches(const BranchProfile& profile);
+    void collectRequired(unsigned int id, std::vector<std::vector<std::string> >& found,
+                         std::vector<unsigned char>& state) const;
+
+    std::vector<Node> nodes;
+    std::vector<RuleInfo> rules;
+    std::vector<std::string> names;                  ///< Rule and unresolved symbol names
+    std::vector<std::bitset<256> > bitmaps;          ///< Deduplicated classes and FIRST sets
+    std::vector<unsigned int> edges;                 ///< Child indices of all composite nodes
+    std::vector<unsigned int> ranks;                 ///< Position as written of each edge (empty: unordered)
+    std::string literals;                            ///< Terminal literal pool
+    std::vector<unsigned int> minLengths;            ///< Exact minimum length per node
+    std::vector<unsigned int> maxLengths;            ///< Maximum length per node
+    std::vector<TokenScanner*> scanners;             ///< Scanner per rule (owned; null for non-tokens)
+    ByteSet skipBytes;                               ///< Bytes of the skip rule (empty: no skipping)
+    std::vector<std::string> requiredLiterals;       ///< Longest required literal per rule
+
+    std::map<std::string, unsigned int> nameIndex;   ///< Rule index by name
+    std::map<std::string, unsigned int> unknownNames; ///< Name index of unresolved symbols
+
+    // Kept by compilations for some start rules, for addStartRule()
+    std::map<std::string, unsigned int> bitmapIndex;
+    std::map<const Expression*, unsigned int> lowered;
+    std::vector<std::vector<std::string> > requiredFound;  ///< Required literals per node
+    std::vector<unsigned char> requiredState;              ///< collectRequired() progress per node
+    unsigned int failNode;
+};
+
+#endif // COMPILED_GRAMMAR_HPP
@@ -46,6 +46,8 @@ struct Expression {
      * - EXPR_TERMINAL: a terminal token/value.
      * - EXPR_CHAR_RANGE: a character range (e.g., 'a' ... 'z').
      * - EXPR_CHAR_CLASS: a character class (e.g., ( 'a' ... 'z' '0' '9' )).
+     * - EXPR_AND_PREDICATE: succeeds if the child matches, consuming nothing (&A).
+     * - EXPR_NOT_PREDICATE: succeeds if the child does not match, consuming nothing (!A).
      */
     enum Type {
         EXPR_SEQUENCE,
@@ -55,7 +57,9 @@ struct Expression {
         EXPR_SYMBOL,
         EXPR_TERMINAL,
         EXPR_CHAR_RANGE,
-        EXPR_CHAR_CLASS
+        EXPR_CHAR_CLASS,
+        EXPR_AND_PREDICATE,
+        EXPR_NOT_PREDICATE
     };
 
     // The node type.
@@ -1,31 +1,32 @@
 #ifndef EXPRESSION_INTERNER_HPP
 #define EXPRESSION_INTERNER_HPP
 
-#include <map>
-#include <string>
 #include <vector>
 #include "Expression.hpp"
 
-struct ExpressionKey {
-    int type;
-    std::string value;
-    int rangeStart;
-    int rangeEnd;
-    std::string bitmapBits;
-    std::vector<size_t> childrenIds;
-
-    ExpressionKey();
-    explicit ExpressionKey(const Expression* expr);
-    bool operator<(const ExpressionKey& other) const;
-};
-
+// Keeps one expression per structure. Children are interned before their
+// parents, so two expressions have the same structure exactly when their
+// fields and child pointers are equal; lookups hash those directly.
 class ExpressionInterner {
 public:
     ExpressionInterner();
     Expression* intern(Expression* expr, bool allocatedWithArena);
 
+    // Number of distinct expressions kept
+    size_t size() const { return order.size(); }
+
+    // Distinct expressions in the order they were kept; children come
+    // before their parents
+    const std::vector<Expression*>& expressions() const { return order; }
+
 private:
-    std::map<ExpressionKey, Expression*> table;
+    static size_t hash(const Expression* expr);
+    static bool same(const Expression* a, const Expression* b);
+    void grow();
+
+    std::vector<Expression*> slots;  // Open addressing by hash (0 = empty)
+    std::vector<size_t> hashes;      // Hash of each slot's expression
+    std::vector<Expression*> order;  // Expressions kept, oldest first
 };
 
 #endif // EXPRESSION_INTERNER_HPP
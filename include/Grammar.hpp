@@ -3,6 +3,8 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <set>
 #include "Expression.hpp"
 #include "BNFTokenizer.hpp"
 #include "ExpressionInterner.hpp"
@@ -17,6 +19,8 @@
 struct Rule {
 	std::string name;       ///< Name of the rule (left-hand side)
 	Expression* rootExpr;   ///< Root expression node (right-hand side)
+	bool transparent;       ///< Matched without an AST node ("~<name> ::= ...")
+	bool token;             ///< Lexical token matched by a compiled scanner ("@<name> ::= ...")
 
 	/**
 	 * @brief Constructs an empty rule.
@@ -51,10 +55,40 @@ public:
 
 	/**
 	 * @brief Adds a new rule from textual BNF format.
+	 *
+	 * A '~' before the name ("~<letter> ::= ...") marks the rule as
+	 * transparent: references to it still match, but add no AST node and
+	 * their text becomes part of the parent's match.
+	 *
+	 * An '@' before the name ("@<ident> ::= ...") marks the rule as a
+	 * lexical token: it is matched as a whole by a table-driven scanner and
+	 * produces a single leaf node, without nodes for the rules it uses.
+	 * Both prefixes can be combined.
+	 *
 	 * @param ruleText Rule in format "name ::= expression"
 	 */
 	void addRule(const std::string& ruleText);
 
+	/**
+	 * @brief Adds many rules, parsing their texts on several threads.
+	 *
+	 * The grammar ends up as if addRule() had been called on each text in
+	 * order. Each thread parses a contiguous slice of the texts into a
+	 * grammar of its own (allocating from an arena of its own when this
+	 * grammar has one, and interning into an interner of its own when this
+	 * grammar has one). The parsed rules are then appended in text order
+	 * and indexed by name, and each thread's distinct expressions are
+	 * interned into this grammar's interner. That last step is serial.
+	 *
+	 * Without thread support (BNF_NO_THREADS) the texts are parsed on the
+	 * calling thread.
+	 *
+	 * @param ruleTexts Rules in format "name ::= expression"
+	 * @param threads Parsing threads, at most one per text; 0 picks one per
+	 *        online processor, keeping slices large enough to be worth a thread
+	 */
+	void addRules(const std::vector<std::string>& ruleTexts, unsigned int threads = 0);
+
 	/**
 	 * @brief Retrieves a rule by name.
 	 * @param name The name of the rule to find
@@ -62,6 +96,67 @@ public:
 	 */
 	Rule* getRule(const std::string& name) const;
 
+	/**
+	 * @brief Collects the rules parses from some start rules can reach.
+	 *
+	 * That is the start rules, the rules they refer to, the rules those
+	 * refer to, and so on, with names resolved as by getRule(). Names
+	 * without a rule are ignored.
+	 *
+	 * @param startRules Names of the start rules
+	 * @param reached Output: the rules reached are added to it
+	 */
+	void reachableRules(const std::vector<std::string>& startRules, std::set<const Rule*>& reached) const;
+
+	/**
+	 * @brief Adds copies of the rules another grammar's start rules reach.
+	 *
+	 * For building a small grammar out of a large shared one: rules the
+	 * start rules cannot reach are left out, and so are rules hidden by an
+	 * earlier rule of the same name. The source's skip rule is copied with
+	 * the rules it reaches and becomes this grammar's skip rule, so parses
+	 * from the start rules give the same results as with the source.
+	 * Rules keep the source's order.
+	 *
+	 * Copies are made like addRule() makes rules, from this grammar's arena
+	 * if it has one and interned if it has an interner. Expressions the
+	 * source shares through its interner are copied once per use unless
+	 * this grammar interns too.
+	 *
+	 * @param source Grammar to copy from; not referenced afterwards
+	 * @param startRules Names of the start rules
+	 */
+	void addReachableRules(const Grammar& source, const std::vector<std::string>& startRules);
+
+	/**
+	 * @brief Returns all rules in insertion order.
+	 */
+	const std::vector<Rule*>& getRules() const { return rules; }
+
+	/**
+	 * @brief Declares the rule whose bytes are skipped between tokens.
+	 *
+	 * The rule must match exactly one byte (a character class, a range,
+	 * one-byte literals, or alternatives of those). Outside token rules the
+	 * parser then skips any run of such bytes before every literal, class
+	 * and token, without creating nodes. Token rules ("@<name>") are
+	 * matched as written.
+	 *
+	 * @param name Rule name, including angle brackets; empty disables skipping
+	 */
+	void setSkipRule(const std::string& name);
+
+	/**
+	 * @brief Returns the skip rule name (empty when skipping is off).
+	 */
+	const std::string& getSkipRule() const { return skipRule; }
+
+	/**
+	 * @brief Returns a counter that changes whenever rules are added or the skip rule changes.
+	 * Lets derived artifacts (e.g. a CompiledGrammar) detect staleness.
+	 */
+	unsigned long getRevision() const { return revision; }
+
 	/**
 	 * @brief Attach an arena to allocate rules/expressions. Optional.
 	 * When set, created nodes should be allocated from the arena.
@@ -77,6 +172,13 @@ private:
 	Rule* createRule();
 	Expression* createExpr(Expression::Type type);
 	Expression* internIfEnabled(Expression* expr);
+	Expression* copyExpr(const Expression* expr);
+	Rule* parseRule(const std::string& ruleText);
+	void appendRule(Rule* r);
+
+	struct LoadSlice;
+	static void* loadSlice(void* slice);
+	void linkSlice(LoadSlice& slice);
 
 	/**
 	 * @brief Parses alternatives separated by '|' operators.
@@ -93,7 +195,8 @@ private:
 	Expression* parseSequence(BNFTokenizer& tz);
 
 	/**
-	 * @brief Parses terms with repetition {} or optional [] modifiers.
+	 * @brief Parses terms with repetition {} or optional [] modifiers,
+	 * or a term prefixed with a predicate operator (& or !).
 	 * @param tz Tokenizer to read from
 	 * @return Expression representing the term
 	 */
@@ -121,7 +224,11 @@ private:
 	unsigned char tokenToChar(const Token& t) const;
 
 	std::vector<Rule*> rules;   ///< Collection of grammar rules
+	std::map<std::string, Rule*> ruleIndex;  ///< First rule added with each name
 	Arena* arena;               ///< Optional arena for allocations (nullable)
 	ExpressionInterner* interner; ///< Optional interner for deduplication
+	std::vector<Arena*> loadArenas; ///< Arenas addRules() parsed into (owned)
+	unsigned long revision;     ///< Bumped by every addRule and setSkipRule
+	std::string skipRule;       ///< Rule whose bytes are skipped between tokens
 };
 #endif
@@ -0,0 +1,173 @@
+#ifndef GRAMMAR_HANDLE_HPP
+#define GRAMMAR_HANDLE_HPP
+
+#include "Grammar.hpp"
+#include "CompiledGrammar.hpp"
+#include <vector>
+#include <string>
+#include <pthread.h>
+
+/**
+ * @brief Publishes grammar versions to parsers running on other threads.
+ *
+ * Each published Grammar is compiled once and becomes an immutable version.
+ * Readers pin the current version with a Snapshot and parse against it
+ * (BNFParser has a constructor taking a Snapshot). Publishing a new
+ * version swaps one pointer: snapshots taken afterwards see the new
+ * version, and snapshots already held keep the old one valid.
+ *
+ * Replaced versions are retired rather than deleted. A retired version is
+ * deleted by a later publish() or reclaim() once no snapshot references
+ * it. Reclamation waits until no reader is between loading the current
+ * pointer and taking its reference, so a version is never freed under a
+ * reader that is still pinning it.
+ *
+ * A version published with publishLazy() starts out compiled for a few
+ * start rules. The first parse from a rule it does not cover adds that
+ * rule and the rules it reaches to a copy of the compilation, which then
+ * replaces it.
+ *
+ * Taking and releasing snapshots is lock-free (GCC __sync builtins).
+ * Writers (publish, reclaim) are serialized by a spin lock. Extending a
+ * lazy version takes the version's mutex instead, so threads that miss
+ * meanwhile sleep rather than spin.
+ */
+class BranchProfile;
+
+class GrammarHandle {
+private:
+    struct Version {
+        Grammar* grammar;
+        CompiledGrammar* volatile compiled;
+        unsigned long number;
+        volatile int refs;     ///< Snapshots pinning this version
+        bool lazy;             ///< Compiled for the hot rules until a parse needs more
+        std::vector<CompiledGrammar*> superseded;     ///< Earlier compilations parsers may still use
+        pthread_mutex_t extending;                    ///< Serializes extend()
+
+        Version(Grammar* g, const BranchProfile* profile, unsigned long n);
+        Version(Grammar* g, const std::vector<std::string>& hotRules, unsigned long n);
+        ~Version();
+
+        const CompiledGrammar* current() const;
+        const CompiledGrammar* extend(const std::string& rule);
+    };
+
+public:
+    /**
+     * @brief A pinned grammar version; copies pin the same version.
+     */
+    class Snapshot {
+    public:
+        /** @brief Pins the handle's current version (none if nothing is published). */
+        explicit Snapshot(const GrammarHandle& handle);
+        Snapshot(const Snapshot& other);
+        Snapshot& operator=(const Snapshot& other);
+        ~Snapshot();
+
+        /** @brief Whether a version is pinned. */
+        bool valid() const { return version != 0; }
+
+        /** @brief The pinned grammar (valid() must be true). */
+        const Grammar& grammar() const { return *version->grammar; }
+
+        /**
+         * @brief The pinned grammar's compiled form (valid() must be true).
+         *
+         * For a lazily published version, this covers the start rules
+         * reached so far and can be replaced by compiledFor().
+         */
+        const CompiledGrammar& compiled() const { return *version->current(); }
+
+        /**
+         * @brief The compiled form to parse a start rule with.
+         *
+         * The same as compiled(), unless the version was published lazily
+         * and the rule is not compiled yet. A copy of the current
+         * compilation is then extended with the rule and the rules it
+         * reaches (see CompiledGrammar::addStartRule()) and replaces it.
+         * Earlier compilations stay valid as long as the version is pinned.
+         *
+         * @param rule Name of the start rule
+         */
+        const CompiledGrammar& compiledFor(const std::string& rule) const;
+
+        /** @brief Whether the version compiles start rules as they are reached. */
+        bool lazy() const { return version && version->lazy; }
+
+        /** @brief Number of the pinned version (0 if none). */
+        unsigned long number() const { return version ? version->number : 0; }
+
+    private:
+        Version* version;
+    };
+
+    /** @brief Constructs a handle with no published version. */
+    GrammarHandle();
+
+    /**
+     * @brief Deletes every version; no Snapshot may outlive the handle.
+     */
+    ~GrammarHandle();
+
+    /**
+     * @brief Compiles a grammar and makes it the current version.
+     *
+     * The handle takes ownership of the grammar, which must not be changed
+     * afterwards. Compilation happens before the swap, so readers never wait
+     * for it.
+     *
+     * @param g Heap-allocated grammar
+     * @param profile Branch wins to order alternatives by (optional; see CompiledGrammar)
+     * @return Number of the new version (1 for the first)
+     */
+    unsigned long publish(Grammar* g, const BranchProfile* profile = 0);
+
+    /**
+     * @brief Makes a grammar the current version, compiling rules as parses need them.
+     *
+     * Only the hot rules, the rules they reach and the skip rule are compiled
+     * now. The first parse from any other start rule compiles that rule and
+     * the rules it newly reaches (see Snapshot::compiledFor()), on whichever
+     * thread gets there first; the others wait for it. Snapshots share the
+     * compilation, so it is grown in a copy rather than in place.
+     * For grammars with many rules of which a workload starts from a known few.
+     *
+     * Branch profiles number alternatives as in a full compilation, so lazy
+     * versions take none.
+     *
+     * @param g Heap-allocated grammar
+     * @param hotRules Start rules to compile now
+     * @return Number of the new version
+     */
+    unsigned long publishLazy(Grammar* g, const std::vector<std::string>& hotRules);
+
+    /**
+     * @brief Deletes retired versions that are no longer pinned.
+     * @return Number of versions deleted
+     */
+    size_t reclaim();
+
+    /** @brief Number of the current version (0 if none). */
+    unsigned long currentNumber() const;
+
+    /** @brief Number of replaced versions not yet deleted. */
+    size_t retiredCount() const;
+
+private:
+    GrammarHandle(const GrammarHandle&);
+    GrammarHandle& operator=(const GrammarHandle&);
+
+    void lock() const;
+    void unlock() const;
+    unsigned long install(Version* next);
+    size_t reclaimLocked();
+
+    Version* volatile current;
+    mutable volatile int entering;     ///< Readers between loading current and pinning it
+    mutable volatile int writer;       ///< Writer spin lock
+    std::vector<Version*> retired;
+    unsigned long published;
+};
+
+#endif
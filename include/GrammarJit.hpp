@@ -0,0 +1,108 @@
+#ifndef GRAMMAR_JIT_HPP
+#define GRAMMAR_JIT_HPP
+
+#include "Grammar.hpp"
+#include "GrammarHandle.hpp"
+#include "BNFParser.hpp"
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/**
+ * @brief Native x86-64 recognizer for the rules of a grammar that no longer changes.
+ *
+ * At construction every rule of the compiled grammar is translated into a
+ * machine-code function in an mmap'd buffer, which is then made executable
+ * (and no longer writable):
+ *
+ * - Literals are compared inline, up to 8 bytes per instruction.
+ * - Character ranges become a subtract and one unsigned compare; classes
+ *   and FIRST-set lookahead a bit test in a 256-bit table.
+ * - Alternatives with at least three branches whose FIRST sets are
+ *   disjoint (and none nullable) jump through a 256-entry table on the
+ *   next byte. Other alternatives try each branch the lookahead allows and
+ *   keep the longest match, as the interpreter does.
+ * - Rule references are native calls; the input, its length and the
+ *   position live in registers for the whole match.
+ *
+ * The code only recognizes: match() gives what BNFParser::match() gives,
+ * without building a tree. Rules the translator does not handle fall back
+ * to a BNFParser on the same grammar, as does everything when the grammar
+ * has a skip rule or the build has no JIT (not Linux x86-64, or built
+ * with BNF_NO_JIT). A rule also falls back when it uses one that does.
+ *
+ * The grammar must not change while the JIT is in use; build it from a
+ * GrammarHandle::Snapshot to have that guaranteed. With a lazily published
+ * version, only the rules compiled when the JIT is built are translated.
+ */
+class GrammarJit {
+public:
+    /**
+     * @brief Translates the rules of a grammar.
+     * @param g Grammar to translate; must outlive the JIT and not change
+     */
+    explicit GrammarJit(const Grammar& g);
+
+    /**
+     * @brief Translates the rules of a published grammar version.
+     * @param snapshot Pinned version; must be valid()
+     */
+    explicit GrammarJit(const GrammarHandle::Snapshot& snapshot);
+
+    /**
+     * @brief Releases the code buffer.
+     */
+    ~GrammarJit();
+
+    /**
+     * @brief Whether native code was generated at all.
+     */
+    bool available() const { return code != 0; }
+
+    /**
+     * @brief Whether a rule runs as native code.
+     */
+    bool native(const std::string& rule) const;
+
+    /**
+     * @brief Why a rule is not native.
+     * @return The reason, or an empty string for native and unknown rules
+     */
+    std::string fallbackReason(const std::string& rule) const;
+
+    /**
+     * @brief Checks that the rule matches a prefix of input (see BNFParser::match).
+     * @param rule Name of the rule
+     * @param input The text to check
+     * @param consumed Output parameter for the number of characters matched
+     * @return true if the rule matched
+     */
+    bool match(const std::string& rule, const std::string& input, size_t& consumed) const;
+
+    /**
+     * @brief Checks that the rule matches all of input (see BNFParser::matchFull).
+     */
+    bool matchFull(const std::string& rule, const std::string& input) const;
+
+    /** @brief Bytes of generated code and tables. */
+    size_t codeSize() const { return codeBytes; }
+
+    /** @brief The interpreter used for rules that are not native. */
+    const BNFParser& interpreter() const { return parser; }
+
+private:
+    GrammarJit(const GrammarJit&);
+    GrammarJit& operator=(const GrammarJit&);
+
+    void build();
+
+    BNFParser parser;                  ///< Fallback, and source of the compiled grammar
+    const CompiledGrammar* compiled;   ///< Compilation the code was generated from
+    unsigned char* code;               ///< Executable buffer (null if nothing was generated)
+    size_t codeBytes;                  ///< Size of the buffer
+    size_t entryStub;                  ///< Offset of the function that enters rule code
+    std::vector<size_t> ruleOffsets;   ///< Offset of each rule's function (-1 if not native)
+    std::vector<std::string> reasons;  ///< Why each rule is not native
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef GRAMMAR_LINTER_HPP
+#define GRAMMAR_LINTER_HPP
+
+#include "Grammar.hpp"
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+/**
+ * @brief A grammar structure that makes parsing slow on some inputs.
+ */
+struct LintWarning {
+    enum Kind {
+        NESTED_REPETITION,     ///< Inner repetition can match what follows it in the outer body
+        OVERLAPPING_BRANCHES,  ///< Alternative under a repetition whose branches share first bytes
+        RECURSIVE_BRANCHES     ///< Alternative whose overlapping branches both recurse
+    };
+
+    Kind kind;
+    std::string rule;      ///< Rule the structure is written in
+    std::string message;   ///< Human-readable description
+};
+
+/**
+ * @brief Static checks for grammar structures with super-linear parse time.
+ *
+ * The linter walks the compiled form of the grammar (one node per
+ * expression) and reports:
+ *
+ * - Nested repetitions whose inner body can match the text that follows it
+ *   inside the outer body, such as `{ { <a> } <a> }`. A backtracking
+ *   matcher tries every way of splitting the text between them
+ *   (exponential). BNFParser's repetitions are greedy, so here the inner
+ *   repetition takes all of it and what follows can only match text it
+ *   could not take.
+ * - Alternatives under a repetition whose branches can start with the same
+ *   byte. Every iteration tries each of them; if one that fails can scan
+ *   unboundedly far, the repetition is quadratic.
+ * - Alternatives whose branches can start with the same byte and both
+ *   reach a rule of the same recursion cycle. The shared prefix is parsed
+ *   once per branch at every nesting level, so the work grows as
+ *   branches^depth.
+ *
+ * Each rule gets a worst-case estimate, including the rules it uses.
+ */
+class GrammarLinter {
+public:
+    enum Complexity {
+        LINEAR,
+        QUADRATIC,
+        EXPONENTIAL
+    };
+
+    /**
+     * @brief Checks every rule of a grammar.
+     * @param g Grammar to check; not referenced after construction
+     */
+    explicit GrammarLinter(const Grammar& g);
+
+    const std::vector<LintWarning>& warnings() const { return found; }
+
+    /**
+     * @brief Worst-case parse time of a rule in the input length.
+     * @return The estimate (LINEAR for unknown rules)
+     */
+    Complexity complexity(const std::string& rule) const;
+
+    /** @brief Text form of an estimate, such as "O(n^2)". */
+    static const char* describe(Complexity c);
+
+    /**
+     * @brief Writes one line per warning, then every rule that is not linear.
+     */
+    void print(std::ostream& out) const;
+
+private:
+    std::vector<LintWarning> found;
+    std::vector<std::string> ruleNames;
+    std::vector<Complexity> estimates;
+};
+
+#endif
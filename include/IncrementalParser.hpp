@@ -0,0 +1,130 @@
+#ifndef INCREMENTAL_PARSER_HPP
+#define INCREMENTAL_PARSER_HPP
+
+#include "BNFParser.hpp"
+#include "AST.hpp"
+#include <string>
+#include <map>
+#include <utility>
+
+/**
+ * @brief A single text edit applied to a previously parsed document.
+ *
+ * Replaces deletedLength bytes at offset with insertedText.
+ */
+struct TextEdit {
+    size_t offset;            ///< Byte offset where the edit starts
+    size_t deletedLength;     ///< Number of bytes removed at offset
+    std::string insertedText; ///< Text inserted at offset
+
+    /**
+     * @brief Constructs an edit.
+     * @param off Offset of the edit
+     * @param del Number of bytes deleted at off
+     * @param ins Text inserted at off
+     */
+    TextEdit(size_t off, size_t del, const std::string& ins);
+};
+
+/**
+ * @brief Re-parses a document after small edits by reusing unaffected subtrees.
+ *
+ * Keeps the previous tree together with the start offset and lookahead
+ * extent of every symbol node it contains. The lookahead extent covers every
+ * byte (and end-of-input check) the symbol's parse inspected, including
+ * failed alternatives. After an edit, symbol subtrees whose extent lies
+ * entirely before the edit, or entirely after the deleted range, are handed
+ * back to the parser as memoized results at their (shifted) position instead
+ * of being parsed again. The resulting tree is identical to a full parse of
+ * the edited text.
+ */
+class IncrementalParser {
+public:
+    /**
+     * @brief Constructs an incremental parser for one start rule.
+     * @param p Parser used for every (re)parse; must outlive this object
+     * @param ruleName Name of the start rule
+     */
+    IncrementalParser(const BNFParser& p, const std::string& ruleName);
+
+    /**
+     * @brief Destructor; releases the current tree.
+     */
+    ~IncrementalParser();
+
+    /**
+     * @brief Parses a complete document, replacing any previous state.
+     * @param input Document text
+     * @param consumed Output parameter for the number of characters consumed
+     * @return Root of the tree (owned by this object), or nullptr on failure
+     */
+    const ASTNode* parse(const std::string& input, size_t& consumed);
+
+    /**
+     * @brief Applies an edit to the current document and re-parses it.
+     * @param edit Edit relative to the current text()
+     * @param consumed Output parameter for the number of characters consumed
+     * @return Root of the new tree (owned by this object), or nullptr on failure
+     */
+    const ASTNode* reparse(const TextEdit& edit, size_t& consumed);
+
+    /**
+     * @brief Returns the current tree, or nullptr if the last parse failed.
+     */
+    const ASTNode* tree() const { return root; }
+
+    /**
+     * @brief Returns the current document text.
+     */
+    const std::string& text() const { return input; }
+
+    /**
+     * @brief Returns how many symbol subtrees the last reparse reused.
+     */
+    size_t reusedCount() const { return reused; }
+
+private:
+    friend class BNFParser;
+
+    /// Position data recorded for every symbol node of the current tree.
+    struct Extent {
+        size_t start;      ///< Start offset when the node was created
+        size_t length;     ///< Consumed bytes, including skipped ones before the text
+        size_t lookahead;  ///< Inspected bytes, relative to start
+        long shift;        ///< Offset applied to the node's subtree since
+    };
+
+    /// A reusable subtree of the previous tree.
+    struct Candidate {
+        ASTNode* node;     ///< Subtree root
+        ASTNode* parent;   ///< Parent in the previous tree (nullptr for root)
+        size_t index;      ///< Index in parent->children
+    };
+
+    typedef std::map<std::pair<std::string, size_t>, Candidate> CandidateMap;
+
+    IncrementalParser(const IncrementalParser&);
+    IncrementalParser& operator=(const IncrementalParser&);
+
+    // Hooks called by BNFParser while this object is the active session.
+    ASTNode* adopt(const std::string& symbol, size_t pos,
+                   size_t& end, size_t& lookahead);
+    void record(const ASTNode* node, size_t start, size_t end, size_t extent);
+    void forget(const ASTNode* node);
+
+    void collect(ASTNode* node, ASTNode* parent, size_t index,
+                 long shift, const TextEdit& edit);
+    void discard(ASTNode* node);
+    const ASTNode* run(size_t& consumed);
+
+    const BNFParser& parser;
+    std::string rule;
+    std::string input;
+    ASTNode* root;
+    ASTNode* previous;                           ///< Tree being replaced
+    std::map<const ASTNode*, Extent> extents;    ///< Per symbol node
+    CandidateMap candidates;                     ///< Reusable subtrees
+    size_t reused;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef LITERAL_FINDER_HPP
+#define LITERAL_FINDER_HPP
+
+#include <string>
+#include <cstddef>
+
+/**
+ * @brief Substring search for one fixed literal.
+ *
+ * With SSE2, 16 candidate positions are probed at a time by comparing the
+ * literal's first byte at each position and its last byte at the matching
+ * offset; only positions where both agree are compared in full. Without
+ * SSE2 the first byte is located with memchr. A one-byte literal is always
+ * a plain memchr.
+ */
+class LiteralFinder {
+public:
+    /** @brief Constructs a finder for a literal (an empty one never matches). */
+    explicit LiteralFinder(const std::string& literal);
+
+    const std::string& literal() const { return needle; }
+
+    /**
+     * @brief Finds the next occurrence of the literal.
+     * @param data Buffer to search
+     * @param pos Offset to start at
+     * @param end Offset to stop at; occurrences must end at or before it
+     * @return Offset of the first occurrence at or after pos, or end
+     */
+    size_t find(const char* data, size_t pos, size_t end) const;
+
+private:
+    std::string needle;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef PARSE_MEMO_HPP
+#define PARSE_MEMO_HPP
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * @brief Results of rules already tried at an input position.
+ *
+ * Maps (rule, position, context) to whether the rule matched there and
+ * where the match ended. The context holds the parser state a rule's
+ * result depends on besides the position (inside a token, must reach the
+ * end of input). Entries live in an open-addressing table that
+ * only grows. clear() bumps a generation number instead of touching the
+ * table, so reusing one memo for many short inputs costs nothing per input.
+ */
+class ParseMemo {
+public:
+    enum Result {
+        UNKNOWN,   ///< Rule not tried at this position yet
+        FAILED,    ///< Rule did not match
+        MATCHED    ///< Rule matched; end holds the position after the match
+    };
+
+    static const unsigned int CONTEXTS = 4;  ///< Number of distinct contexts
+
+    ParseMemo();
+
+    /** @brief Forgets every entry (keeps the table). */
+    void clear();
+
+    /**
+     * @brief Looks up the result of a rule at a position.
+     * @param rule Rule index
+     * @param pos Input offset the rule was tried at
+     * @param context Parser state it was tried in (below CONTEXTS)
+     * @param end Output: end of the match if MATCHED
+     */
+    Result find(unsigned int rule, size_t pos, unsigned int context, size_t& end) const;
+
+    /**
+     * @brief Records the result of a rule at a position.
+     */
+    void store(unsigned int rule, size_t pos, unsigned int context, bool matched, size_t end);
+
+    /** @brief Number of entries since the last clear(). */
+    size_t size() const { return used; }
+
+private:
+    struct Entry {
+        size_t pos;
+        size_t end;
+        unsigned int key;         ///< rule * CONTEXTS + context
+        unsigned int generation;  ///< Entry is live when equal to the memo's
+        bool matched;
+    };
+
+    size_t slot(unsigned int key, size_t pos) const;
+    void grow();
+
+    std::vector<Entry> slots;
+    size_t used;
+    unsigned int generation;
+};
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef SEMANTIC_ACTIONS_HPP
+#define SEMANTIC_ACTIONS_HPP
+
+#include <string>
+#include <map>
+#include <cstddef>
+
+/**
+ * @brief Value produced by a semantic action.
+ *
+ * Numbers, enums and timestamps fit in the integer; anything richer can be
+ * returned through the object pointer, which the library never touches.
+ */
+struct SemanticValue {
+    long integer;   ///< Numeric result
+    void* object;   ///< User-owned result, or null
+
+    SemanticValue();
+    explicit SemanticValue(long i);
+};
+
+/**
+ * @brief What an action sees when its rule matched.
+ */
+struct ActionMatch {
+    const std::string* input;     ///< Whole input being parsed
+    size_t start;                 ///< Offset of the rule's match
+    size_t length;                ///< Length of the rule's match
+    const SemanticValue* values;  ///< Values of the nearest descendant rules with actions, in input order
+    size_t count;                 ///< Number of values
+
+    /** @brief Pointer to the first matched byte (not NUL-terminated). */
+    const char* begin() const { return input->data() + start; }
+
+    /** @brief Copy of the matched text. */
+    std::string text() const { return input->substr(start, length); }
+};
+
+/**
+ * @brief Callback run for a matched rule; returns the rule's value.
+ * @param match Span of the rule and the values its children produced
+ * @param userData Pointer given when the action was registered
+ */
+typedef SemanticValue (*SemanticAction)(const ActionMatch& match, void* userData);
+
+/**
+ * @brief Set of actions attached to rules by name.
+ *
+ * Used with BNFParser::parseWithActions. Values fold upward: a rule without
+ * an action passes its children's values through to the nearest ancestor
+ * with one. Actions are deferred until the parse has succeeded and only run
+ * for matches that are part of the final result, so a branch that is later
+ * rolled back never runs its actions.
+ */
+class SemanticActions {
+public:
+    /**
+     * @brief Attaches an action to a rule, replacing any previous one.
+     * @param ruleName Rule name, including angle brackets
+     * @param action Callback to run
+     * @param userData Passed to every call of the action
+     */
+    void on(const std::string& ruleName, SemanticAction action, void* userData = 0);
+
+    /**
+     * @brief Looks up the action of a rule.
+     * @return The action, or null if the rule has none
+     */
+    SemanticAction find(const std::string& ruleName, void*& userData) const;
+
+    /** @brief Whether no action has been attached. */
+    bool empty() const { return actions.empty(); }
+
+private:
+    struct Entry {
+        SemanticAction action;
+        void* userData;
+    };
+    std::map<std::string, Entry> actions;
+};
+
+#endif
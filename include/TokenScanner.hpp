@@ -0,0 +1,95 @@
+#ifndef TOKEN_SCANNER_HPP
+#define TOKEN_SCANNER_HPP
+
+#include <string>
+#include <vector>
+#include <bitset>
+#include <cstddef>
+
+class CompiledGrammar;
+
+/**
+ * @brief Table-driven scanner for one lexical token rule.
+ *
+ * The rule (with the rules it references inlined) is turned into a position
+ * (Glushkov) automaton: one state per byte-consuming leaf plus a start
+ * state, with a 256-entry transition row per state. Matching is then one
+ * table lookup per input byte and reports the longest accepting prefix.
+ *
+ * The table is only built when the automaton is deterministic, i.e. every
+ * state has at most one successor per byte. In that case there is a single
+ * way to read any input, so the greedy, non-backtracking choices of the
+ * interpreter and the longest accepting prefix coincide. Rules that are
+ * recursive, contain predicates or empty literals, or are not deterministic
+ * (for example 'a' | 'ab') get no table; the parser then recognizes them
+ * with the interpreter instead.
+ */
+class TokenScanner {
+public:
+    static const size_t NO_MATCH;  ///< Returned by match() when the token does not match
+    static const size_t BATCH_LANES = 8;  ///< Inputs matchBatch() steps at once
+
+    /**
+     * @brief Builds the scanner of a rule of a compiled grammar.
+     * @param cg Compiled grammar; not referenced after construction
+     * @param rule Rule index in cg
+     */
+    TokenScanner(const CompiledGrammar& cg, unsigned int rule);
+
+    /** @brief Whether a transition table was built. */
+    bool deterministic() const { return !table.empty(); }
+
+    /** @brief Why no table was built (empty when deterministic). */
+    const std::string& fallbackReason() const { return reason; }
+
+    /** @brief Number of automaton states, including the start state. */
+    size_t stateCount() const { return accepting.size(); }
+
+    /** @brief Heap footprint of the transition table in bytes. */
+    size_t memoryUsage() const { return table.capacity() * sizeof(unsigned short) + accepting.size() / 8; }
+
+    /**
+     * @brief Matches the token at a position.
+     * @param input Input text
+     * @param pos Offset to match at
+     * @param inspected Output: offset just past the last byte examined,
+     *        or input.size() + 1 if the end of input was reached
+     * @return Length of the longest match, or NO_MATCH
+     */
+    size_t match(const std::string& input, size_t pos, size_t& inspected) const;
+
+    /**
+     * @brief Matches the token at the start of each of a batch of inputs.
+     *
+     * Gives the same lengths as match() at offset 0, but steps BATCH_LANES
+     * inputs through the table together, so the table load of one input
+     * does not wait for the previous input's. Worth it for many short
+     * inputs; a scanner that is not deterministic() matches none.
+     *
+     * @param inputs Inputs to match
+     * @param lengths Output: per input, the length of the longest match, or NO_MATCH
+     */
+    void matchBatch(const std::vector<std::string>& inputs, std::vector<size_t>& lengths) const;
+
+private:
+    struct Fragment {
+        bool nullable;
+        std::vector<unsigned int> first;
+        std::vector<unsigned int> last;
+    };
+
+    bool build(const CompiledGrammar& cg, unsigned int id, Fragment& out);
+    unsigned int addPosition(const std::bitset<256>& bits);
+    void link(const std::vector<unsigned int>& from, const std::vector<unsigned int>& to);
+    bool fillRow(size_t state, const std::vector<unsigned int>& targets);
+
+    std::vector<std::bitset<256> > classes;             ///< Byte set of each state (0 = start)
+    std::vector<std::vector<unsigned int> > follow;     ///< Successor states
+    std::vector<unsigned int> ruleStack;                ///< Rules being inlined (recursion check)
+
+    std::vector<unsigned short> table;   ///< state * 256 + byte -> next state (0 = none)
+    std::vector<bool> accepting;         ///< Accepting flag per state
+    std::string reason;
+};
+
+#endif
@@ -42,3 +42,12 @@ void printAST(const ASTNode* node, int indent) {
     for (size_t i = 0; i < node->children.size(); ++i)
         printAST(node->children[i], indent + 1);
 }
+
+// One-line form: symbol[matched](children...)
+std::string formatAST(const ASTNode* node) {
+    if (!node) return "~";
+    std::string out = node->symbol + "[" + node->matched + "](";
+    for (size_t i = 0; i < node->children.size(); ++i)
+        out += formatAST(node->children[i]);
+    return out + ")";
+}
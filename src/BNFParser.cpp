@@ -1,121 +1,219 @@
 #include "../include/BNFParser.hpp"
 #include "../include/Expression.hpp"
+#include "../include/IncrementalParser.hpp"
+#include "../include/TokenScanner.hpp"
+#include "../include/LiteralFinder.hpp"
+#include "../include/BranchProfile.hpp"
 #include "../include/Debug.hpp"
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 // BNFParser implementation
 BNFParser::BNFParser(const Grammar& g)
-    : grammar(g)
+    : grammar(g), compiled(0), pinned(0), compiledRevision(0), lazy(false), furthest(0),
+      recognizing(0), lexical(0), anchored(false), incremental(0), actionTable(0), memo(0),
+      branchOrder(0), recorder(0), memoEvery(false), winner(0), replaying(0), parseStats(0), depth(0)
 {
 }
 
-BNFParser::~BNFParser() {}
+BNFParser::BNFParser(const GrammarHandle::Snapshot& snapshot)
+    : grammar(snapshot.grammar()), compiled(&snapshot.compiled()),
+      pinned(new GrammarHandle::Snapshot(snapshot)), compiledRevision(0), lazy(false), furthest(0),
+      recognizing(0), lexical(0), anchored(false), incremental(0), actionTable(0), memo(0),
+      branchOrder(0), recorder(0), memoEvery(false), winner(0), replaying(0), parseStats(0), depth(0)
+{
+}
 
-void BNFParser::mergeFirst(FirstInfo& dst, const FirstInfo& src) const {
-    dst.chars |= src.chars;
-    dst.nullable = dst.nullable || src.nullable;
+BNFParser::~BNFParser() {
+    if (pinned) delete pinned;
+    else delete compiled;
 }
 
-void BNFParser::addChar(FirstInfo& fi, unsigned char c) const {
-    fi.chars.set(static_cast<size_t>(c));
+// Counts the subtree's nodes before deleting it
+static unsigned long subtreeSize(const ASTNode* node) {
+    unsigned long size = 1;
+    for (size_t i = 0; i < node->children.size(); ++i)
+        if (node->children[i]) size += subtreeSize(node->children[i]);
+    return size;
 }
 
-std::string BNFParser::terminalFirstString(Expression* expr) const {
-    std::string literal = stripQuotes(expr->value);
-    return literal;
+void BNFParser::discardNode(ASTNode* node) const {
+    if (!node) return;
+    if (incremental) incremental->forget(node);
+    if (parseStats) parseStats->nodesDiscarded += subtreeSize(node);
+    delete node;
 }
 
-const BNFParser::FirstInfo& BNFParser::computeFirst(Expression* expr) const {
-    std::map<Expression*, FirstInfo>::iterator it = firstCache.find(expr);
-    if (it != firstCache.end()) return it->second;
+const CompiledGrammar& BNFParser::compiledGrammar() const {
+    // A published version never changes
+    if (pinned) return *compiled;
+    if (!compiled || compiledRevision != grammar.getRevision()) {
+        DEBUG_MSG("BNFParser: compiling grammar revision " << grammar.getRevision());
+        delete compiled;
+        compiled = 0;
+        if (lazy) compiled = new CompiledGrammar(grammar, lazyRules);
+        else compiled = new CompiledGrammar(grammar, branchOrder);
+        compiledRevision = grammar.getRevision();
+        if (adaptive.interval) resetAdaptiveOrder();
+    }
+    return *compiled;
+}
 
-    FirstInfo fi;
-    switch (expr->type) {
-        case Expression::EXPR_TERMINAL: {
-            std::string lit = terminalFirstString(expr);
-            if (!lit.empty()) {
-                addChar(fi, static_cast<unsigned char>(lit[0]));
-            } else {
-                fi.nullable = true;
-            }
-            break;
-        }
-        case Expression::EXPR_SYMBOL: {
-            Rule* rr = grammar.getRule(expr->value);
-            if (rr && rr->rootExpr) {
-                fi = computeFirst(rr->rootExpr);
-            }
-            break;
-        }
-        case Expression::EXPR_SEQUENCE: {
-            fi.nullable = true;
-            for (size_t i = 0; i < expr->children.size(); ++i) {
-                const FirstInfo& childFirst = computeFirst(expr->children[i]);
-                mergeFirst(fi, childFirst);
-                if (!childFirst.nullable) {
-                    fi.nullable = false;
-                    break;
-                }
-            }
-            break;
-        }
-        case Expression::EXPR_ALTERNATIVE: {
-            for (size_t i = 0; i < expr->children.size(); ++i) {
-                const FirstInfo& childFirst = computeFirst(expr->children[i]);
-                mergeFirst(fi, childFirst);
-            }
-            break;
-        }
-        case Expression::EXPR_OPTIONAL: {
-            fi.nullable = true;
-            if (!expr->children.empty()) {
-                const FirstInfo& childFirst = computeFirst(expr->children[0]);
-                mergeFirst(fi, childFirst);
-            }
-            break;
-        }
-        case Expression::EXPR_REPEAT: {
-            fi.nullable = true;
-            if (!expr->children.empty()) {
-                const FirstInfo& childFirst = computeFirst(expr->children[0]);
-                mergeFirst(fi, childFirst);
-            }
-            break;
-        }
-        case Expression::EXPR_CHAR_RANGE: {
-            unsigned char start = expr->charRange.start;
-            unsigned char end = expr->charRange.end;
-            for (unsigned int c = start; c <= end; ++c) {
-                addChar(fi, static_cast<unsigned char>(c));
-                if (c == 255) break; // avoid overflow
-            }
-            fi.nullable = false;
-            break;
-        }
-        case Expression::EXPR_CHAR_CLASS: {
-            fi.nullable = false;
-            for (size_t i = 0; i < 256; ++i) {
-                if (expr->classMatches(static_cast<unsigned char>(i))) fi.chars.set(i);
-            }
-            break;
+// The compiled grammar to start from a rule with. A lazy compilation that
+// does not have the rule yet gets it: this parser's own compilation is
+// extended in place, a shared one is replaced (see GrammarHandle).
+const CompiledGrammar& BNFParser::compiledFor(const std::string& ruleName) const {
+    const CompiledGrammar& cg = compiledGrammar();
+    if (cg.findRule(ruleName) != CompiledGrammar::NO_RULE) return cg;
+    if (!(pinned ? pinned->lazy() : lazy) || !grammar.getRule(ruleName)) return cg;
+
+    if (pinned) {
+        compiled = &pinned->compiledFor(ruleName);
+        // Rule and node numbers changed
+        if (adaptive.interval) resetAdaptiveOrder();
+    } else {
+        DEBUG_MSG("BNFParser: compiling for " << ruleName);
+        unsigned int firstNode = static_cast<unsigned int>(cg.nodeCount());
+        lazyRules.push_back(ruleName);
+        // Owned, so no one else reads it
+        const_cast<CompiledGrammar*>(compiled)->addStartRule(grammar, ruleName);
+        if (adaptive.interval) extendAdaptiveOrder(firstNode);
+    }
+    // Rule tables are sized by rule count
+    memoized.grammar = 0;
+    dispatch.grammar = 0;
+    return *compiled;
+}
+
+void BNFParser::compileLazily(const std::vector<std::string>& hotRules) {
+    if (pinned) return;
+    lazy = true;
+    lazyRules = hotRules;
+    // Recompile on next use
+    delete compiled;
+    compiled = 0;
+}
+
+void BNFParser::orderBranches(const BranchProfile* profile) {
+    if (pinned) return;
+    branchOrder = profile;
+    // Recompile on next use
+    delete compiled;
+    compiled = 0;
+}
+
+void BNFParser::collectStats(ParseStats* stats) {
+    parseStats = stats;
+}
+
+void BNFParser::recordBranches(BranchProfile* profile) {
+    recorder = profile;
+}
+
+void BNFParser::adaptBranches(unsigned int interval) {
+    adaptive.interval = interval;
+    if (interval) resetAdaptiveOrder();
+    else {
+        adaptive.order.clear();
+        adaptive.wins.clear();
+    }
+}
+
+unsigned int BNFParser::branchTriedAt(unsigned int node, unsigned int i) const {
+    const CompiledGrammar& cg = compiledGrammar();
+    const Node& n = cg.node(node);
+    unsigned int c = adaptive.interval ? adaptive.order[n.a + i] : i;
+    return cg.branchRank(n, c);
+}
+
+void BNFParser::resetAdaptiveOrder() const {
+    adaptive.parses = 0;
+    adaptive.order.clear();
+    adaptive.wins.clear();
+    extendAdaptiveOrder(0);
+}
+
+// Written order for the alternatives from firstNode on; earlier ones keep
+// what was learned
+void BNFParser::extendAdaptiveOrder(unsigned int firstNode) const {
+    const CompiledGrammar& cg = compiledGrammar();
+    adaptive.order.resize(cg.edgeCount(), 0);
+    adaptive.wins.resize(cg.edgeCount(), 0);
+    for (unsigned int id = firstNode; id < cg.nodeCount(); ++id) {
+        const Node& n = cg.node(id);
+        if (n.kind != CompiledGrammar::NODE_ALTERNATIVE) continue;
+        for (unsigned int i = 0; i < n.b; ++i) adaptive.order[n.a + i] = i;
+    }
+}
+
+// Most wins first; children that won equally often keep the compiled order
+void BNFParser::reorderAdaptive() const {
+    adaptive.parses = 0;
+    std::vector<std::pair<long, unsigned int> > sorted;
+    for (unsigned int id = 0; id < compiled->nodeCount(); ++id) {
+        const Node& n = compiled->node(id);
+        if (n.kind != CompiledGrammar::NODE_ALTERNATIVE || n.b < 2) continue;
+        sorted.clear();
+        for (unsigned int i = 0; i < n.b; ++i) {
+            sorted.push_back(std::make_pair(-static_cast<long>(adaptive.wins[n.a + i]), i));
+            adaptive.wins[n.a + i] /= 2;
         }
-        default:
-            break;
+        std::sort(sorted.begin(), sorted.end());
+        for (unsigned int i = 0; i < n.b; ++i) adaptive.order[n.a + i] = sorted[i].second;
     }
+    DEBUG_MSG("BNFParser: re-sorted alternatives by recent wins");
+}
 
-    std::pair<std::map<Expression*, FirstInfo>::iterator, bool> inserted = firstCache.insert(std::make_pair(expr, fi));
-    return inserted.first->second;
+void BNFParser::memoize(MemoMode mode) {
+    memoized.mode = mode;
+    memoized.grammar = 0;
 }
 
-// Remove surrounding quotes from terminal strings
-std::string BNFParser::stripQuotes(const std::string& s) const{
-    if (s.size() >= 2 && ((s[0] == '\'' && s[s.size()-1] == '\'') ||
-                          (s[0] == '"'  && s[s.size()-1] == '"')))
-    {
-        return s.substr(1, s.size() - 2);
+void BNFParser::memoizeRules(const std::vector<std::string>& ruleNames) {
+    memoized.names = ruleNames;
+    memoize(MEMO_LISTED);
+}
+
+void BNFParser::memoReport(std::vector<MemoRuleStats>& stats) const {
+    stats.clear();
+    for (size_t r = 0; r < memoized.stats.size(); ++r) {
+        if (memoized.stats[r].lookups) stats.push_back(memoized.stats[r]);
     }
-    return s;
+}
+
+void BNFParser::resetMemoStats() {
+    for (size_t r = 0; r < memoized.stats.size(); ++r) {
+        memoized.stats[r].lookups = 0;
+        memoized.stats[r].hits = 0;
+        memoized.stats[r].stored = 0;
+    }
+}
+
+// The selection is rebuilt for each new compiled grammar, since rule
+// indexes may change with it.
+void BNFParser::beginMemo(const CompiledGrammar& cg, ParseMemo& table, bool every) const {
+    if (memoized.grammar != &cg || memoized.revision != compiledRevision) {
+        memoized.grammar = &cg;
+        memoized.revision = compiledRevision;
+        memoized.rules.assign(cg.ruleCount(), 0);
+        memoized.stats.resize(cg.ruleCount());
+        for (unsigned int r = 0; r < cg.ruleCount(); ++r) {
+            MemoRuleStats& st = memoized.stats[r];
+            st.rule = cg.name(cg.rule(r).name);
+            st.lookups = st.hits = st.stored = 0;
+            if (memoized.mode == MEMO_REENTRANT) memoized.rules[r] = cg.rule(r).reentrant;
+        }
+        if (memoized.mode == MEMO_LISTED) {
+            for (size_t k = 0; k < memoized.names.size(); ++k) {
+                unsigned int r = cg.findRule(memoized.names[k]);
+                if (r != CompiledGrammar::NO_RULE) memoized.rules[r] = 1;
+            }
+        }
+    }
+    table.clear();
+    memo = &table;
+    memoEvery = every || memoized.mode == MEMO_ALL;
 }
 
 // Main parsing entry point - parses input according to the specified rule
@@ -124,221 +222,774 @@ ASTNode* BNFParser::parse(const std::string& ruleName,
                           size_t& consumed) const
 {
     DEBUG_MSG("Starting parse for rule: " + ruleName + " with input: '" + input + "'");
+    ASTNode* root = 0;
+    parseRoot(ruleName, input, false, consumed, root);
+    return root;
+}
+
+// Whole-input parse; the length bounds of the rule reject most mismatches up front
+ASTNode* BNFParser::parseFull(const std::string& ruleName,
+                              const std::string& input) const
+{
+    size_t consumed = 0;
+    ASTNode* root = 0;
+    parseRoot(ruleName, input, true, consumed, root);
+    return root;
+}
+
+// Prefix match without a tree
+bool BNFParser::match(const std::string& ruleName,
+                      const std::string& input,
+                      size_t& consumed) const
+{
+    ASTNode* ignored = 0;
+    ++recognizing;
+    bool ok = parseRoot(ruleName, input, false, consumed, ignored);
+    --recognizing;
+    return ok;
+}
+
+// Whole-input match without a tree
+bool BNFParser::matchFull(const std::string& ruleName,
+                          const std::string& input) const
+{
+    size_t consumed = 0;
+    ASTNode* ignored = 0;
+    ++recognizing;
+    bool ok = parseRoot(ruleName, input, true, consumed, ignored);
+    --recognizing;
+    return ok;
+}
+
+// Shared by parse, parseFull and matchFull. In full mode the root has to
+// end at the end of input: outside skipping, the parser is told so and
+// fails every node that must end there but cannot.
+bool BNFParser::parseRoot(const std::string& ruleName,
+                          const std::string& input,
+                          bool full,
+                          size_t& consumed,
+                          ASTNode*& root) const
+{
     consumed = 0;
+    furthest = 0;
+    beginStats();
 
     // Find the requested grammar rule
-    Rule* r = grammar.getRule(ruleName);
-    if (!r) {
+    const CompiledGrammar& cg = compiledFor(ruleName);
+    unsigned int r = cg.findRule(ruleName);
+    if (r == CompiledGrammar::NO_RULE) {
         DEBUG_MSG("Rule not found: " + ruleName);
         std::cerr << "BNFParser::parse: rule not found: " << ruleName << std::endl;
-        return 0;
+        return false;
+    }
+
+    unsigned int start = cg.rule(r).root;
+    bool skipping = cg.skipSet() && !cg.rule(r).token;
+    if (full) {
+        // Skipped bytes come on top of the rule's own length
+        unsigned int maxLen = skipping ? CompiledGrammar::UNBOUNDED : cg.maxLength(start);
+        if (input.size() < cg.minLength(start) || input.size() > maxLen) {
+            DEBUG_MSG("parseFull: input length " << input.size() << " outside ["
+                      << cg.minLength(start) << ", " << cg.maxLength(start) << "]");
+            return false;
+        }
     }
 
+    // A token start rule is matched as written, without skipping
+    lexical = cg.rule(r).token ? 1 : 0;
+    anchored = full && !skipping;
+    adaptiveTick();
+    // Memoized results would hide the lookahead incremental reparsing measures
+    if (memoized.mode != MEMO_OFF && !incremental) beginMemo(cg, parseMemo, false);
+
     // Attempt to parse the input using the rule's expression
     size_t pos = 0;
-    ASTNode* root = 0;
-    bool ok = parseExpression(r->rootExpr, input, pos, root);
+    bool ok = parseExpression(start, input, pos, root);
+    anchored = false;
+    memo = 0;
+    if (ok && full && skipping)
+        pos = cg.skipSet()->span(input.data(), pos, input.size());
+    if (ok && full && pos != input.size()) {
+        DEBUG_MSG("parseFull: only " << pos << " of " << input.size() << " characters matched");
+        backtracked(pos);
+        ok = false;
+    }
 
     if (!ok) {
         DEBUG_MSG("Parse failed for rule: " + ruleName);
-        if (root) delete root;
-        return 0;
+        discardNode(root);
+        root = 0;
+        return false;
     }
 
     consumed = pos;   // Export how much input was consumed by the parser
     DEBUG_MSG("Parse successful, consumed " << consumed << " characters");
+    return true;
+}
+
+// Tries the start rules in order, skipping those the first significant byte
+// rules out. Candidates are recognized with a shared memo until one matches;
+// only that one is parsed into a tree. The last candidate is parsed into a
+// tree directly, since nothing is left to try after it.
+ASTNode* BNFParser::parseAny(const std::vector<std::string>& ruleNames,
+                             const std::string& input,
+                             size_t& consumed,
+                             size_t& which) const
+{
+    consumed = 0;
+    which = ruleNames.size();
+    furthest = 0;
+    beginStats();
+    for (size_t k = 0; k < ruleNames.size(); ++k)
+        compiledFor(ruleNames[k]);
+    const CompiledGrammar& cg = compiledGrammar();
+    const DispatchTable& d = dispatchTable(cg, ruleNames);
+
+    // Token start rules see the first byte as written, others after skipping
+    const ByteSet* skip = cg.skipSet();
+    size_t next = skip ? skip->span(input.data(), 0, input.size()) : 0;
+    unsigned int raw = input.empty() ? 256 : static_cast<unsigned char>(input[0]);
+    unsigned int look = next < input.size() ? static_cast<unsigned char>(input[next]) : 256;
+    size_t i = d.offsets[look], iEnd = d.offsets[look + 1];
+    size_t j = d.offsets[raw], jEnd = d.offsets[raw + 1];
 
+    adaptiveTick();
+    beginMemo(cg, dispatchMemo, true);
+    ASTNode* root = 0;
+    while (true) {
+        // Merge the two candidate lists in priority order
+        while (i < iEnd && cg.rule(d.rules[d.candidates[i]]).token) ++i;
+        while (j < jEnd && !cg.rule(d.rules[d.candidates[j]]).token) ++j;
+        unsigned int c;
+        if (i < iEnd && (j >= jEnd || d.candidates[i] < d.candidates[j])) c = d.candidates[i++];
+        else if (j < jEnd) c = d.candidates[j++];
+        else break;
+        while (i < iEnd && cg.rule(d.rules[d.candidates[i]]).token) ++i;
+        while (j < jEnd && !cg.rule(d.rules[d.candidates[j]]).token) ++j;
+        bool last = i >= iEnd && j >= jEnd;
+
+        const CompiledGrammar::RuleInfo& rule = cg.rule(d.rules[c]);
+        lexical = rule.token ? 1 : 0;
+        size_t pos = 0;
+        if (!last) {
+            ASTNode* ignored = 0;
+            ++recognizing;
+            bool ok = parseExpression(rule.root, input, pos, ignored);
+            --recognizing;
+            if (!ok) continue;
+            backtracked(pos);
+            pos = 0;
+        }
+        if (parseExpression(rule.root, input, pos, root) && root) {
+            DEBUG_MSG("parseAny: " << ruleNames[c] << " matched " << pos << " characters");
+            consumed = pos;
+            which = c;
+            break;
+        }
+        // An empty match gives no tree; the next candidate is tried
+        if (root) backtracked(pos);
+        discardNode(root);
+        root = 0;
+    }
+    memo = 0;
     return root;
 }
 
+const BNFParser::DispatchTable& BNFParser::dispatchTable(const CompiledGrammar& cg,
+                                                         const std::vector<std::string>& ruleNames) const
+{
+    if (dispatch.grammar == &cg && dispatch.revision == compiledRevision && dispatch.names == ruleNames)
+        return dispatch;
+
+    dispatch.grammar = &cg;
+    dispatch.revision = compiledRevision;
+    dispatch.names = ruleNames;
+    dispatch.rules.resize(ruleNames.size());
+    for (size_t k = 0; k < ruleNames.size(); ++k) {
+        dispatch.rules[k] = cg.findRule(ruleNames[k]);
+        if (dispatch.rules[k] == CompiledGrammar::NO_RULE)
+            std::cerr << "BNFParser::parseAny: rule not found: " << ruleNames[k] << std::endl;
+    }
+
+    // A rule is a candidate for the bytes of its FIRST set, and for every
+    // byte and the end of input if it can match the empty string
+    dispatch.offsets.resize(258);
+    dispatch.candidates.clear();
+    for (unsigned int b = 0; b <= 256; ++b) {
+        dispatch.offsets[b] = dispatch.candidates.size();
+        for (size_t k = 0; k < ruleNames.size(); ++k) {
+            if (dispatch.rules[k] == CompiledGrammar::NO_RULE) continue;
+            const Node& root = cg.node(cg.rule(dispatch.rules[k]).root);
+            if (CompiledGrammar::nullable(root) || (b < 256 && cg.first(root).test(b)))
+                dispatch.candidates.push_back(static_cast<unsigned int>(k));
+        }
+    }
+    dispatch.offsets[257] = dispatch.candidates.size();
+    DEBUG_MSG("parseAny: dispatch table for " << ruleNames.size() << " rules, "
+              << dispatch.candidates.size() << " entries");
+    return dispatch;
+}
+
+// Unanchored search: try the rule only where its FIRST set allows a match
+// and, when every match must contain some literal, only close enough
+// before the next occurrence of that literal.
+size_t BNFParser::search(const std::string& ruleName,
+                         const std::string& input,
+                         std::vector<SearchMatch>& matches) const
+{
+    matches.clear();
+    beginStats();
+    const CompiledGrammar& cg = compiledFor(ruleName);
+    unsigned int r = cg.findRule(ruleName);
+    if (r == CompiledGrammar::NO_RULE) {
+        std::cerr << "BNFParser::search: rule not found: " << ruleName << std::endl;
+        return 0;
+    }
+
+    unsigned int root = cg.rule(r).root;
+    ByteSet starts(cg.first(cg.node(root)));
+    size_t minLen = cg.minLength(root);
+    // Skipped bytes come on top of the rule's own length
+    bool skipping = cg.skipSet() && !cg.rule(r).token;
+    size_t maxLen = skipping ? CompiledGrammar::UNBOUNDED : cg.maxLength(root);
+    LiteralFinder required(cg.requiredLiteral(r));
+    size_t litLen = required.literal().size();
+    size_t litPos = 0;
+    bool litKnown = false;
+
+    lexical = cg.rule(r).token ? 1 : 0;
+    adaptiveTick();
+    // Results are kept by absolute position, so they carry over between offsets
+    if (memoized.mode != MEMO_OFF) beginMemo(cg, parseMemo, false);
+    ++recognizing;
+    size_t pos = 0;
+    while (true) {
+        if (litLen) {
+            // A match starting at pos contains an occurrence at or after pos
+            if (!litKnown || litPos < pos) {
+                litPos = required.find(input.data(), pos, input.size());
+                litKnown = true;
+                if (litPos >= input.size()) break;
+            }
+            if (maxLen != CompiledGrammar::UNBOUNDED && litPos + litLen > pos + maxLen)
+                pos = litPos + litLen - maxLen;
+        }
+        pos = starts.find(input.data(), pos, input.size());
+        if (pos >= input.size() || input.size() - pos < minLen) break;
+        if (litLen && litPos < pos) continue;
+
+        furthest = pos;
+        size_t end = pos;
+        ASTNode* ignored = 0;
+        if (parseExpression(root, input, end, ignored) && end > pos) {
+            SearchMatch m;
+            m.start = pos;
+            m.length = end - pos;
+            matches.push_back(m);
+            pos = end;
+        } else {
+            ++pos;
+        }
+    }
+    --recognizing;
+    memo = 0;
+    DEBUG_MSG("search: " << matches.size() << " matches of " << ruleName);
+    return matches.size();
+}
+
+// Recognition-only parse that records matches of rules with actions, then
+// replays the surviving records in completion order.
+bool BNFParser::parseWithActions(const std::string& ruleName,
+                                 const std::string& input,
+                                 const SemanticActions& actions,
+                                 SemanticValue& result,
+                                 size_t& consumed) const
+{
+    consumed = 0;
+    furthest = 0;
+    result = SemanticValue();
+    beginStats();
+
+    const CompiledGrammar& cg = compiledFor(ruleName);
+    unsigned int r = cg.findRule(ruleName);
+    if (r == CompiledGrammar::NO_RULE) {
+        std::cerr << "BNFParser::parse: rule not found: " << ruleName << std::endl;
+        return false;
+    }
+
+    std::vector<BoundAction> table(cg.ruleCount());
+    for (unsigned int i = 0; i < cg.ruleCount(); ++i)
+        table[i].action = actions.find(cg.name(cg.rule(i).name), table[i].userData);
+
+    trail.clear();
+    actionTable = &table;
+    lexical = cg.rule(r).token ? 1 : 0;
+    adaptiveTick();
+    ++recognizing;
+    size_t pos = 0;
+    ASTNode* root = 0;
+    bool ok = parseExpression(cg.rule(r).root, input, pos, root);
+    --recognizing;
+    actionTable = 0;
+    if (!ok) {
+        DEBUG_MSG("parseWithActions: parse failed for rule " << ruleName);
+        trail.clear();
+        return false;
+    }
+    consumed = pos;
+
+    // Each record takes the values left on the stack by its own subtree
+    std::vector<SemanticValue> values;
+    std::vector<size_t> owners;
+    ActionMatch match;
+    match.input = &input;
+    for (size_t i = 0; i < trail.size(); ++i) {
+        const ActionRecord& rec = trail[i];
+        size_t first = i - rec.descendants;
+        size_t k = values.size();
+        while (k > 0 && owners[k - 1] >= first) --k;
+
+        match.start = rec.start;
+        match.length = rec.end - rec.start;
+        match.values = k < values.size() ? &values[k] : 0;
+        match.count = values.size() - k;
+        const BoundAction& b = table[rec.rule];
+        SemanticValue v = b.action(match, b.userData);
+
+        values.resize(k);
+        owners.resize(k);
+        values.push_back(v);
+        owners.push_back(i);
+    }
+    trail.clear();
+
+    if (table[r].action) {
+        match.start = 0;
+        match.length = consumed;
+        match.values = values.empty() ? 0 : &values[0];
+        match.count = values.size();
+        result = table[r].action(match, table[r].userData);
+    } else if (!values.empty()) {
+        result = values.back();
+    }
+    return true;
+}
 
 // Recursive expression parser dispatcher - delegates to specific parsing functions
-bool BNFParser::parseExpression(Expression* expr,
+bool BNFParser::parseExpression(unsigned int id,
                                 const std::string& input,
                                 size_t& pos,
                                 ASTNode*& outNode) const
 {
-    if (!expr) {
-        DEBUG_MSG("parseExpression: null expression");
+    const Node& n = compiled->node(id);
+    DEBUG_MSG("parseExpression: node=" << id << " kind=" << (int)n.kind << " at pos=" << pos);
+    if (parseStats) {
+        ++parseStats->expressions;
+        if (depth >= parseStats->maxDepth) parseStats->maxDepth = depth + 1;
+    }
+
+    // Branches and repetition bodies that cannot fit in the remaining input
+    // fail here instead of byte by byte. The decision depends on where the
+    // input ends, so it counts as having seen the end.
+    if (n.minLen > input.size() - pos) {
+        DEBUG_MSG("parseExpression: needs " << n.minLen << " bytes, " << (input.size() - pos) << " left");
+        touch(input.size() + 1);
+        return false;
+    }
+
+    if (!anchored) {
+        ++depth;
+        bool ok = parseNode(n, input, pos, outNode);
+        --depth;
+        return ok;
+    }
+
+    // Full-match mode: this node has to end where the input ends. Nodes that
+    // cannot stretch that far, and matches that stop short, fail at once, so
+    // no enclosing node is built around them.
+    touch(input.size() + 1);
+    if (compiled->maxLength(id) < input.size() - pos) {
+        DEBUG_MSG("parseExpression: cannot reach the end of input from pos=" << pos);
+        return false;
+    }
+    size_t savedPos = pos;
+    ++depth;
+    bool ok = parseNode(n, input, pos, outNode);
+    --depth;
+    if (!ok) return false;
+    if (pos != input.size()) {
+        DEBUG_MSG("parseExpression: match stops short of the end at pos=" << pos);
+        backtracked(pos - savedPos);
+        discardNode(outNode);
+        outNode = 0;
+        pos = savedPos;
         return false;
     }
+    return true;
+}
 
-    DEBUG_MSG("parseExpression: type=" << expr->type << " at pos=" << pos);
-
-    switch (expr->type) {
-        case Expression::EXPR_TERMINAL:
-            return parseTerminal(expr, input, pos, outNode);
-        case Expression::EXPR_SYMBOL:
-            return parseSymbol(expr, input, pos, outNode);
-        case Expression::EXPR_SEQUENCE:
-            return parseSequence(expr, input, pos, outNode);
-        case Expression::EXPR_ALTERNATIVE:
-            return parseAlternative(expr, input, pos, outNode);
-        case Expression::EXPR_OPTIONAL:
-            return parseOptional(expr, input, pos, outNode);
-        case Expression::EXPR_REPEAT:
-            return parseRepeat(expr, input, pos, outNode);
-        case Expression::EXPR_CHAR_RANGE:
-            return parseCharRange(expr, input, pos, outNode);
-        case Expression::EXPR_CHAR_CLASS:
-            return parseCharClass(expr, input, pos, outNode);
+// Dispatches on the node kind
+bool BNFParser::parseNode(const Node& n,
+                          const std::string& input,
+                          size_t& pos,
+                          ASTNode*& outNode) const
+{
+    switch (n.kind) {
+        case CompiledGrammar::NODE_TERMINAL:
+            return parseTerminal(n, input, pos, outNode);
+        case CompiledGrammar::NODE_SYMBOL:
+            return parseSymbol(n, input, pos, outNode);
+        case CompiledGrammar::NODE_SEQUENCE:
+            return parseSequence(n, input, pos, outNode);
+        case CompiledGrammar::NODE_ALTERNATIVE:
+            return parseAlternative(n, input, pos, outNode);
+        case CompiledGrammar::NODE_OPTIONAL:
+            return parseOptional(n, input, pos, outNode);
+        case CompiledGrammar::NODE_REPEAT:
+            return parseRepeat(n, input, pos, outNode);
+        case CompiledGrammar::NODE_CHAR_RANGE:
+            return parseCharRange(n, input, pos, outNode);
+        case CompiledGrammar::NODE_CHAR_CLASS:
+            return parseCharClass(n, input, pos, outNode);
+        case CompiledGrammar::NODE_AND:
+        case CompiledGrammar::NODE_NOT:
+            return parsePredicate(n, input, pos, outNode);
+        case CompiledGrammar::NODE_FAIL:
+            DEBUG_MSG("parseExpression: null expression");
+            return false;
         default:
-            DEBUG_MSG("parseExpression: unsupported expr type " << expr->type);
+            DEBUG_MSG("parseExpression: unsupported node kind " << (int)n.kind);
             std::cerr << "BNFParser::parseExpression: unsupported expr type\n";
             return false;
     }
 }
 
 // Parse terminal expressions (quoted strings)
-bool BNFParser::parseTerminal(Expression* expr,
+bool BNFParser::parseTerminal(const Node& n,
                               const std::string& input,
                               size_t& pos,
                               ASTNode*& outNode) const
 {
-    std::string literal = stripQuotes(expr->value);
-    DEBUG_MSG("parseTerminal: trying to match '" << literal << "' at pos=" << pos);
+    const char* literal = compiled->literal(n);
+    size_t len = n.b;
+    DEBUG_MSG("parseTerminal: trying to match '" << std::string(literal, len) << "' at pos=" << pos);
 
-    size_t len = literal.size();
     if (len == 0) {
         DEBUG_MSG("parseTerminal: empty literal");
         return false;
     }
 
-    if (pos + len <= input.size() && input.compare(pos, len, literal) == 0) {
-        DEBUG_MSG("parseTerminal: matched '" << literal << "'");
-        ASTNode* node = new ASTNode(literal);
-        node->matched = literal;
-        pos += len;
-        outNode = node;
+    size_t start = skipSpace(input, pos);
+    touch(start + len <= input.size() ? start + len : input.size() + 1);
+    if (start + len <= input.size() && input.compare(start, len, literal, len) == 0) {
+        DEBUG_MSG("parseTerminal: matched '" << std::string(literal, len) << "'");
+        if (!recognizing) {
+            ASTNode* node = newNode(std::string(literal, len));
+            node->matched = node->symbol;
+            outNode = node;
+        }
+        pos = start + len;
         return true;
     }
     
-    DEBUG_MSG("parseTerminal: failed to match '" + literal + "'");
+    DEBUG_MSG("parseTerminal: failed to match '" << std::string(literal, len) << "'");
     return false;
 }
 
 // Parse symbol expressions (non-terminal references)
-bool BNFParser::parseSymbol(Expression* expr,
+bool BNFParser::parseSymbol(const Node& n,
                             const std::string& input,
                             size_t& pos,
                             ASTNode*& outNode) const
 {
-    DEBUG_MSG("parseSymbol: resolving symbol '" << expr->value << "' at pos=" << pos);
+    const std::string& name = compiled->name(n.b);
+    DEBUG_MSG("parseSymbol: resolving symbol '" << name << "' at pos=" << pos);
     
-    Rule* rr = grammar.getRule(expr->value);
-    if (!rr) {
-        DEBUG_MSG("parseSymbol: unknown symbol " << expr->value);
-        std::cerr << "BNFParser::parseSymbol: unknown symbol " << expr->value << std::endl;
+    if (n.a == CompiledGrammar::NO_RULE) {
+        DEBUG_MSG("parseSymbol: unknown symbol " << name);
+        std::cerr << "BNFParser::parseSymbol: unknown symbol " << name << std::endl;
         return false;
     }
     
+    // Transparent rules (and everything under them) are only recognized
+    bool transparent = (n.flags & CompiledGrammar::FLAG_TRANSPARENT) != 0;
+    bool building = !recognizing && !transparent;
+
     size_t savedPos = pos;
+    size_t actionMark = trail.size();
+    if (incremental && building) {
+        size_t end = 0, lookahead = 0;
+        ASTNode* reused = incremental->adopt(name, pos, end, lookahead);
+        if (reused) {
+            DEBUG_MSG("parseSymbol: reusing previous result for " << name);
+            touch(pos + lookahead);
+            pos = end;
+            outNode = reused;
+            return true;
+        }
+    }
+
+    // A result recorded earlier at this position (see memoize() and
+    // parseAny). A failure can always be reused; a match only where no node
+    // has to be built.
+    bool memoizing = memo && (memoEvery || memoized.rules[n.a]);
+    unsigned int context = (lexical ? 1 : 0) | (anchored ? 2 : 0);
+    ParseMemo::Result known = ParseMemo::UNKNOWN;
+    if (memoizing) {
+        size_t end = 0;
+        MemoRuleStats& stats = memoized.stats[n.a];
+        ++stats.lookups;
+        known = memo->find(n.a, pos, context, end);
+        if (known == ParseMemo::FAILED) {
+            ++stats.hits;
+            return false;
+        }
+        if (known == ParseMemo::MATCHED && !building) {
+            ++stats.hits;
+            pos = end;
+            return true;
+        }
+    }
+
+    // Measure how far this rule looks ahead so incremental reparsing knows
+    // which edits can affect its result.
+    size_t outerFurthest = furthest;
+    furthest = pos;
     ASTNode* child = 0;
-    bool ok = parseExpression(rr->rootExpr, input, pos, child);
+    bool ok;
+    // Tokens are matched as a whole: by their scanner's table when it has
+    // one, otherwise by recognizing the rule. Either way they become a leaf.
+    const TokenScanner* scanner = (n.flags & CompiledGrammar::FLAG_TOKEN) ? compiled->scanner(n.a) : 0;
+    size_t start = savedPos;
+    if (scanner) {
+        pos = start = skipSpace(input, pos);
+        ++lexical;
+    }
+    if (scanner && scanner->deterministic()) {
+        size_t inspected = pos;
+        size_t len = scanner->match(input, pos, inspected);
+        touch(inspected);
+        ok = len != TokenScanner::NO_MATCH;
+        if (ok) pos += len;
+    } else {
+        bool leaf = !building || scanner;
+        if (leaf) ++recognizing;
+        ok = parseExpression(compiled->rule(n.a).root, input, pos, child);
+        if (leaf) --recognizing;
+        if (scanner) rollbackActions(actionMark);
+    }
+    if (scanner) {
+        --lexical;
+        // Skipped bytes stay unconsumed before an empty token
+        if (ok && pos == start) pos = start = savedPos;
+    }
+    size_t extent = furthest;
+    if (outerFurthest > furthest) furthest = outerFurthest;
+    if (memoizing && known == ParseMemo::UNKNOWN) {
+        memo->store(n.a, savedPos, context, ok, pos);
+        ++memoized.stats[n.a].stored;
+    }
     if (!ok) {
-        DEBUG_MSG("parseSymbol: failed to parse symbol " << expr->value);
+        DEBUG_MSG("parseSymbol: failed to parse symbol " << name);
+        rollbackActions(actionMark);
         pos = savedPos;
         return false;
     }
 
-    DEBUG_MSG("parseSymbol: successfully parsed symbol " << expr->value);
-    ASTNode* node = new ASTNode(expr->value);
-    if (child) {
-        node->children.push_back(child);
-        node->matched = child->matched;
+    DEBUG_MSG("parseSymbol: successfully parsed symbol " << name);
+    if (!scanner) start = spanStart(input, savedPos, pos);
+    if (actionTable && (*actionTable)[n.a].action) {
+        ActionRecord rec;
+        rec.rule = n.a;
+        rec.start = start;
+        rec.end = pos;
+        rec.descendants = trail.size() - actionMark;
+        trail.push_back(rec);
     }
+    if (!building) return true;
+
+    ASTNode* node = newNode(name);
+    if (child) node->children.push_back(child);
+    node->matched = input.substr(start, pos - start);
+    if (incremental) incremental->record(node, savedPos, pos, extent);
     outNode = node;
     return true;
 }
 
 // Parse sequence expressions (ordered list of sub-expressions)
-bool BNFParser::parseSequence(Expression* expr,
+bool BNFParser::parseSequence(const Node& n,
                               const std::string& input,
                               size_t& pos,
                               ASTNode*& outNode) const
 {
-    DEBUG_MSG("parseSequence: parsing " << expr->children.size() << " elements at pos=" << pos);
+    unsigned int count = compiled->childCount(n);
+    DEBUG_MSG("parseSequence: parsing " << count << " elements at pos=" << pos);
 
     size_t savedPos = pos;
+    size_t actionMark = trail.size();
     std::vector<ASTNode*> tmpChildren;
-    std::string matchedAccum;
+    // Only the last element has to end where the sequence does
+    bool outerAnchored = anchored;
 
-    for (size_t i = 0; i < expr->children.size(); ++i) {
+    for (unsigned int i = 0; i < count; ++i) {
+        unsigned int childId = compiled->child(n, i);
         ASTNode* childNode = 0;
-        bool ok = parseExpression(expr->children[i], input, pos, childNode);
+        anchored = outerAnchored && i + 1 == count;
+        bool ok = parseExpression(childId, input, pos, childNode);
+        anchored = outerAnchored;
         if (!ok) {
             DEBUG_MSG("parseSequence: failed at element " << i);
+            backtracked(pos - savedPos);
             for (size_t j = 0; j < tmpChildren.size(); ++j)
-                delete tmpChildren[j];
+                discardNode(tmpChildren[j]);
+            rollbackActions(actionMark);
             pos = savedPos;
             return false;
         }
-        tmpChildren.push_back(childNode);
-        if (childNode) matchedAccum += childNode->matched;
+        // Transparent symbols leave no trace; other empty results keep their slot
+        if (!recognizing && (childNode || !(compiled->node(childId).flags & CompiledGrammar::FLAG_TRANSPARENT)))
+            tmpChildren.push_back(childNode);
     }
 
-    DEBUG_MSG("parseSequence: successfully parsed all elements, matched='" << matchedAccum << "'");
-    ASTNode* parent = new ASTNode("<seq>");
-    parent->matched = matchedAccum;
-    parent->children.reserve(tmpChildren.size());
-    for (size_t k = 0; k < tmpChildren.size(); ++k)
-        parent->children.push_back(tmpChildren[k]);
+    if (recognizing) return true;
+
+    DEBUG_MSG("parseSequence: successfully parsed all elements");
+    ASTNode* parent = newNode("<seq>");
+    size_t start = spanStart(input, savedPos, pos);
+    parent->matched = input.substr(start, pos - start);
+    parent->children.swap(tmpChildren);
 
     outNode = parent;
     return true;
 }
 
 // Parse alternative expressions (choice between sub-expressions)
-bool BNFParser::parseAlternative(Expression* expr,
+bool BNFParser::parseAlternative(const Node& n,
                                  const std::string& input,
                                  size_t& pos,
                                  ASTNode*& outNode) const
 {
-    DEBUG_MSG("parseAlternative: trying " << expr->children.size() << " alternatives at pos=" << pos);
+    unsigned int count = compiled->childCount(n);
+    DEBUG_MSG("parseAlternative: trying " << count << " alternatives at pos=" << pos);
 
     ASTNode* bestNode = 0;
     size_t bestPos = pos;
+    unsigned int bestRank = 0;
+    unsigned int bestChild = 0;
     bool anyMatch = false;
+    size_t actionMark = trail.size();
 
-    bool hasChar = pos < input.size();
-    unsigned char look = hasChar ? static_cast<unsigned char>(input[pos]) : 0;
+    touch(pos + 1);
+    size_t next = skipSpace(input, pos);
+    bool hasChar = next < input.size();
+    unsigned char look = hasChar ? static_cast<unsigned char>(input[next]) : 0;
+    // Skipped bytes do not count towards a node's maximum length
+    bool bounded = !compiled->skipSet() || lexical;
+    // This parser's learned try order, if it adapts
+    const unsigned int* order = adaptive.interval && count ? &adaptive.order[0] + n.a : 0;
 
-    for (size_t i = 0; i < expr->children.size(); ++i) {
+    // With a memo, find the winner without building nodes, then build only
+    // its branch. The memoized rules make recognizing the losing branches
+    // cheap, and their subtrees are never allocated. Recognition already
+    // counted the wins of every alternative inside, so building does not.
+    if (memo && !recognizing) {
+        unsigned int viable = 0;
+        for (unsigned int i = 0; i < count && viable < 2; ++i) {
+            const Node& bn = compiled->node(compiled->child(n, i));
+            if (CompiledGrammar::nullable(bn) || (hasChar && compiled->first(bn).test(look))) ++viable;
+        }
+        if (viable > 1) {
+            size_t end = pos;
+            ASTNode* ignored = 0;
+            ++recognizing;
+            bool ok = parseAlternative(n, input, end, ignored);
+            --recognizing;
+            if (!ok) return false;
+            if (end == pos) return true;
+            backtracked(end - pos);
+            size_t savedPos = pos;
+            ASTNode* branchNode = 0;
+            ++replaying;
+            bool built = parseExpression(compiled->child(n, winner), input, pos, branchNode);
+            --replaying;
+            if (!built) return false;
+            bestNode = newNode("<alt>");
+            if (branchNode) bestNode->children.push_back(branchNode);
+            size_t start = spanStart(input, savedPos, pos);
+            bestNode->matched = input.substr(start, pos - start);
+            outNode = bestNode;
+            return true;
+        }
+    }
+
+    for (unsigned int i = 0; i < count; ++i) {
+        unsigned int c = order ? order[i] : i;
+        unsigned int branch = compiled->child(n, c);
+        const Node& bn = compiled->node(branch);
         if (hasChar) {
-            const FirstInfo& fi = computeFirst(expr->children[i]);
-            if (!fi.nullable && !fi.chars.test(look)) {
+            if (!CompiledGrammar::nullable(bn) && !compiled->first(bn).test(look)) {
                 DEBUG_MSG("parseAlternative: skipping alt " << i << " due to FIRST mismatch");
                 continue;
             }
-            if (!fi.nullable && fi.chars.none()) {
-                DEBUG_MSG("parseAlternative: skipping alt " << i << " (empty FIRST and not nullable)");
-                continue;
-            }
         } else {
-            const FirstInfo& fi = computeFirst(expr->children[i]);
-            if (!fi.nullable) {
+            if (!CompiledGrammar::nullable(bn)) {
                 DEBUG_MSG("parseAlternative: skipping alt " << i << " at EOF due to non-nullable FIRST");
                 continue;
             }
         }
+        // The longest match wins, and ties go to the branch written first.
+        // Skip branches that cannot be longer or win a tie.
+        unsigned int rank = compiled->branchRank(n, c);
+        if (anyMatch) {
+            size_t bestLen = bestPos - pos;
+            size_t maxLen = bounded ? compiled->maxLength(branch) : CompiledGrammar::UNBOUNDED;
+            if (rank > bestRank && bestPos == input.size()) {
+                DEBUG_MSG("parseAlternative: alternative " << i << " cannot beat a match reaching the end");
+                touch(input.size() + 1);
+                continue;
+            }
+            if (maxLen != CompiledGrammar::UNBOUNDED && (maxLen < bestLen || (maxLen == bestLen && rank > bestRank))) {
+                DEBUG_MSG("parseAlternative: alternative " << i << " cannot match more than " << maxLen << " bytes");
+                continue;
+            }
+        }
         size_t savedPos = pos;
+        size_t branchMark = trail.size();
         ASTNode* branchNode = 0;
-        bool ok = parseExpression(expr->children[i], input, pos, branchNode);
+        bool ok = parseExpression(branch, input, pos, branchNode);
 
         if (ok) {
             DEBUG_MSG("parseAlternative: alternative " << i << " matched, advanced to pos=" << pos);
-            anyMatch = true;
-            if (pos > bestPos) {
-                if (bestNode) delete bestNode;
-                bestNode = new ASTNode("<alt>");
-                bestNode->children.push_back(branchNode);
-                bestNode->matched = branchNode->matched;
+            if (pos > bestPos || (pos == bestPos && pos > savedPos && rank < bestRank)) {
+                backtracked(bestPos - savedPos);
+                discardNode(bestNode);
+                bestNode = 0;
+                // The previous best branch's pending actions are superseded
+                if (branchMark > actionMark)
+                    trail.erase(trail.begin() + actionMark, trail.begin() + branchMark);
+                if (!recognizing) {
+                    bestNode = newNode("<alt>");
+                    if (branchNode) bestNode->children.push_back(branchNode);
+                    size_t start = spanStart(input, savedPos, pos);
+                    bestNode->matched = input.substr(start, pos - start);
+                }
                 bestPos = pos;
+                bestRank = rank;
+                bestChild = c;
             } else {
-                delete branchNode;
+                // Empty matches never become the best node
+                if (pos == bestPos && (!anyMatch || rank < bestRank)) {
+                    bestRank = rank;
+                    bestChild = c;
+                }
+                backtracked(pos - savedPos);
+                discardNode(branchNode);
+                rollbackActions(branchMark);
             }
+            anyMatch = true;
         } else {
             DEBUG_MSG("parseAlternative: alternative " << i << " failed");
+            rollbackActions(branchMark);
         }
         pos = savedPos;
     }
@@ -349,110 +1000,170 @@ bool BNFParser::parseAlternative(Expression* expr,
     }
 
     DEBUG_MSG("parseAlternative: best match advanced to pos=" << bestPos);
+    if (!replaying) {
+        if (recorder) recorder->record(static_cast<unsigned int>(&n - &compiled->node(0)), bestRank);
+        if (order) ++adaptive.wins[n.a + bestChild];
+    }
+    winner = bestChild;
     pos = bestPos;
     outNode = bestNode;
     return true;
 }
 
 // Parse optional expressions (zero or one occurrence)
-bool BNFParser::parseOptional(Expression* expr,
+bool BNFParser::parseOptional(const Node& n,
                               const std::string& input,
                               size_t& pos,
                               ASTNode*& outNode) const
 {
     DEBUG_MSG("parseOptional: attempting optional at pos=" << pos);
 
+    // A non-nullable child can only match if the lookahead starts it
+    const Node& child = compiled->node(n.a);
+    bool startsChild = true;
+    if (!CompiledGrammar::nullable(child)) {
+        touch(pos + 1);
+        size_t next = skipSpace(input, pos);
+        startsChild = next < input.size()
+            && compiled->first(child).test(static_cast<unsigned char>(input[next]));
+    }
+
     size_t savedPos = pos;
+    size_t actionMark = trail.size();
     ASTNode* inside = 0;
-    bool ok = parseExpression(expr->children[0], input, pos, inside);
+    bool ok = startsChild && parseExpression(n.a, input, pos, inside);
     if (!ok) {
         DEBUG_MSG("parseOptional: optional content not found, creating empty node");
+        rollbackActions(actionMark);
         pos = savedPos;
-        ASTNode* node = new ASTNode("<opt>");
-        node->matched = "";
-        outNode = node;
-        return true;
-    }
-    
-    DEBUG_MSG("parseOptional: optional content matched");
-    ASTNode* node = new ASTNode("<opt>");
-    if (inside) {
-        node->children.push_back(inside);
-        node->matched = inside->matched;
+    } else {
+        DEBUG_MSG("parseOptional: optional content matched");
     }
+
+    if (recognizing) return true;
+
+    ASTNode* node = newNode("<opt>");
+    if (inside) node->children.push_back(inside);
+    size_t start = spanStart(input, savedPos, pos);
+    node->matched = input.substr(start, pos - start);
     outNode = node;
     return true;
 }
 
 // Parse repetition expressions (zero or more occurrences)
-bool BNFParser::parseRepeat(Expression* expr,
+bool BNFParser::parseRepeat(const Node& n,
                            const std::string& input,
                            size_t& pos,
                            ASTNode*& outNode) const
 {
     DEBUG_MSG("parseRepeat: starting repetition at pos=" << pos);
 
+    size_t startPos = pos;
     std::vector<ASTNode*> items;
-    std::string matchedAccum;
     int iterations = 0;
+    const std::bitset<256>& bodyFirst = compiled->first(compiled->node(n.a));
+    bool outerAnchored = anchored;
+    anchored = false;
     
     while (true) {
+        // Without a byte from FIRST(body) the body can at best match the
+        // empty string, which ends the repetition anyway
+        touch(pos + 1);
+        size_t next = skipSpace(input, pos);
+        if (next >= input.size() || !bodyFirst.test(static_cast<unsigned char>(input[next]))) {
+            DEBUG_MSG("parseRepeat: lookahead cannot start another iteration");
+            break;
+        }
+
         size_t iterSaved = pos;
+        size_t actionMark = trail.size();
         ASTNode* it = 0;
-        bool ok = parseExpression(expr->children[0], input, pos, it);
+        bool ok = parseExpression(n.a, input, pos, it);
         if (!ok) {
+            rollbackActions(actionMark);
             pos = iterSaved;
             break;
         }
-        if (it && it->matched.empty()) {
-            delete it;
-            pos = iterSaved;
-            break;
-        }
-        if (it) {
-            matchedAccum += it->matched;
-            items.push_back(it);
-            iterations++;
-            DEBUG_MSG("parseRepeat: iteration " << iterations << " matched");
-        } else {
+        if (pos == iterSaved) {
+            discardNode(it);
+            rollbackActions(actionMark);
             break;
         }
+        if (it) items.push_back(it);
+        iterations++;
+        DEBUG_MSG("parseRepeat: iteration " << iterations << " matched");
+        touch(pos + 1);
         if (pos >= input.size()) break;
     }
 
+    anchored = outerAnchored;
     DEBUG_MSG("parseRepeat: completed with " << iterations << " iterations");
-    ASTNode* parent = new ASTNode("<rep>");
-    parent->matched = matchedAccum;
-    for (size_t i = 0; i < items.size(); ++i)
-        parent->children.push_back(items[i]);
+    if (recognizing) return true;
+
+    ASTNode* parent = newNode("<rep>");
+    size_t start = spanStart(input, startPos, pos);
+    parent->matched = input.substr(start, pos - start);
+    parent->children.swap(items);
     outNode = parent;
     return true;
 }
 
+// Evaluate &A / !A: run A in recognition-only mode, then restore the position
+bool BNFParser::parsePredicate(const Node& n,
+                               const std::string& input,
+                               size_t& pos,
+                               ASTNode*& outNode) const
+{
+    (void)outNode;
+    DEBUG_MSG("parsePredicate: " << (n.kind == CompiledGrammar::NODE_AND ? "&" : "!") << " at pos=" << pos);
+
+    size_t savedPos = pos;
+    size_t actionMark = trail.size();
+    ASTNode* ignored = 0;
+    bool outerAnchored = anchored;
+    anchored = false;
+    ++recognizing;
+    bool matched = parseExpression(n.a, input, pos, ignored);
+    --recognizing;
+    anchored = outerAnchored;
+    rollbackActions(actionMark);
+    if (matched) backtracked(pos - savedPos);
+    pos = savedPos;
+
+    bool holds = (n.kind == CompiledGrammar::NODE_AND) ? matched : !matched;
+    DEBUG_MSG("parsePredicate: operand " << (matched ? "matched" : "did not match")
+              << ", predicate " << (holds ? "holds" : "fails"));
+    return holds;
+}
+
 // Parse character range expressions - match one character within the range
-bool BNFParser::parseCharRange(Expression* expr,
+bool BNFParser::parseCharRange(const Node& n,
                                const std::string& input,
                                size_t& pos,
                                ASTNode*& outNode) const
 {
-    if (pos >= input.size()) {
+    size_t at = skipSpace(input, pos);
+    touch(at + 1);
+    if (at >= input.size()) {
         DEBUG_MSG("parseCharRange: reached end of input");
         return false;
     }
     
-    unsigned char ch = static_cast<unsigned char>(input[pos]);
-    unsigned char start = expr->charRange.start;
-    unsigned char end = expr->charRange.end;
+    unsigned char ch = static_cast<unsigned char>(input[at]);
+    unsigned char start = static_cast<unsigned char>(n.a);
+    unsigned char end = static_cast<unsigned char>(n.b);
     
     DEBUG_MSG("parseCharRange: checking if " << (int)ch << " is in range [" 
               << (int)start << ", " << (int)end << "]");
     
     if (ch >= start && ch <= end) {
         DEBUG_MSG("parseCharRange: matched character " << (int)ch);
-        ASTNode* node = new ASTNode("<char-range>");
-        node->matched = std::string(1, ch);
-        pos++;
-        outNode = node;
+        if (!recognizing) {
+            ASTNode* node = newNode("<char-range>");
+            node->matched = std::string(1, ch);
+            outNode = node;
+        }
+        pos = at + 1;
         return true;
     }
     
@@ -461,25 +1172,29 @@ bool BNFParser::parseCharRange(Expression* expr,
 }
 
 // Parse character class expressions - match one character against the class
-bool BNFParser::parseCharClass(Expression* expr,
+bool BNFParser::parseCharClass(const Node& n,
                                const std::string& input,
                                size_t& pos,
                                ASTNode*& outNode) const
 {
-    if (pos >= input.size()) {
+    size_t at = skipSpace(input, pos);
+    touch(at + 1);
+    if (at >= input.size()) {
         DEBUG_MSG("parseCharClass: reached end of input");
         return false;
     }
     
-    unsigned char ch = static_cast<unsigned char>(input[pos]);
-    bool match = expr->classMatches(ch);
+    unsigned char ch = static_cast<unsigned char>(input[at]);
+    bool match = compiled->bitmap(n.a).test(ch);
     
     if (match) {
         DEBUG_MSG("parseCharClass: matched character " << (int)ch);
-        ASTNode* node = new ASTNode("<char-class>");
-        node->matched = std::string(1, ch);
-        pos++;
-        outNode = node;
+        if (!recognizing) {
+            ASTNode* node = newNode("<char-class>");
+            node->matched = std::string(1, ch);
+            outNode = node;
+        }
+        pos = at + 1;
         return true;
     }
     
@@ -63,6 +63,8 @@ Token BNFTokenizer::next() {
     if (c == ')') { pos++; DEBUG_MSG("BNFTokenizer::next: found RPAREN"); return Token(Token::TOK_RPAREN, ")"); }
     if (c == '^') { pos++; DEBUG_MSG("BNFTokenizer::next: found CARET"); return Token(Token::TOK_CARET, "^"); }
     if (c == '|') { pos++; DEBUG_MSG("BNFTokenizer::next: found PIPE"); return Token(Token::TOK_PIPE, "|"); }
+    if (c == '&') { pos++; DEBUG_MSG("BNFTokenizer::next: found AMPERSAND"); return Token(Token::TOK_AMPERSAND, "&"); }
+    if (c == '!') { pos++; DEBUG_MSG("BNFTokenizer::next: found BANG"); return Token(Token::TOK_BANG, "!"); }
 
     // Word (fallback)
     return parseWord();
@@ -0,0 +1,53 @@
+#include "../include/BranchProfile.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+
+BranchProfile::BranchProfile() : recorded(0) {}
+
+void BranchProfile::record(unsigned int node, unsigned int branch) {
+    if (node >= counts.size()) counts.resize(node + 1);
+    std::vector<unsigned long>& c = counts[node];
+    if (branch >= c.size()) c.resize(branch + 1, 0);
+    ++c[branch];
+    ++recorded;
+}
+
+unsigned long BranchProfile::wins(unsigned int node, unsigned int branch) const {
+    if (node >= counts.size() || branch >= counts[node].size()) return 0;
+    return counts[node][branch];
+}
+
+void BranchProfile::clear() {
+    counts.clear();
+    recorded = 0;
+}
+
+void BranchProfile::save(std::ostream& out) const {
+    for (size_t node = 0; node < counts.size(); ++node) {
+        if (counts[node].empty()) continue;
+        out << node;
+        for (size_t b = 0; b < counts[node].size(); ++b)
+            out << ' ' << counts[node][b];
+        out << '\n';
+    }
+}
+
+bool BranchProfile::load(std::istream& in) {
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        std::istringstream fields(line);
+        unsigned int node = 0;
+        if (!(fields >> node)) return false;
+        unsigned long n = 0;
+        for (unsigned int branch = 0; fields >> n; ++branch) {
+            if (node >= counts.size()) counts.resize(node + 1);
+            if (branch >= counts[node].size()) counts[node].resize(branch + 1, 0);
+            counts[node][branch] += n;
+            recorded += n;
+        }
+        if (!fields.eof()) return false;
+    }
+    return true;
+}
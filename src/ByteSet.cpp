@@ -0,0 +1,85 @@
+#include "../include/ByteSet.hpp"
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+ByteSet::ByteSet() : ranges(0), count(0) {
+    std::memset(table, 0, sizeof(table));
+    std::memset(low, 0, sizeof(low));
+    std::memset(width, 0, sizeof(width));
+}
+
+ByteSet::ByteSet(const std::bitset<256>& bits) : ranges(0), count(0) {
+    std::memset(table, 0, sizeof(table));
+    std::memset(low, 0, sizeof(low));
+    std::memset(width, 0, sizeof(width));
+    for (size_t c = 0; c < 256; ++c) {
+        if (!bits.test(c)) continue;
+        table[c] = 1;
+        ++count;
+        if (c > 0 && bits.test(c - 1)) {
+            if (ranges <= MAX_VECTOR_RANGES) ++width[ranges - 1];
+            continue;
+        }
+        if (ranges < MAX_VECTOR_RANGES) low[ranges] = static_cast<unsigned char>(c);
+        ++ranges;
+    }
+}
+
+#if defined(__SSE2__)
+// Lanes of a 16-byte chunk that fall in one of the ranges: a byte is in
+// [low, low + width] exactly when (byte - low) mod 256 <= width.
+static inline unsigned int matchMask(__m128i chunk, const unsigned char* low,
+                                     const unsigned char* width, unsigned int ranges) {
+    __m128i hit = _mm_setzero_si128();
+    for (unsigned int i = 0; i < ranges; ++i) {
+        __m128i d = _mm_sub_epi8(chunk, _mm_set1_epi8(static_cast<char>(low[i])));
+        __m128i in = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(static_cast<char>(width[i]))), d);
+        hit = _mm_or_si128(hit, in);
+    }
+    return static_cast<unsigned int>(_mm_movemask_epi8(hit));
+}
+#endif
+
+size_t ByteSet::span(const char* data, size_t pos, size_t end) const {
+    // Most runs between tokens are empty or a single byte
+    if (pos >= end || !table[static_cast<unsigned char>(data[pos])]) return pos;
+    ++pos;
+
+#if defined(__SSE2__)
+    if (ranges <= MAX_VECTOR_RANGES) {
+        while (pos + 16 <= end) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+            unsigned int mask = matchMask(chunk, low, width, ranges);
+            if (mask != 0xFFFFu) return pos + __builtin_ctz(~mask);
+            pos += 16;
+        }
+    }
+#endif
+
+    while (pos < end && table[static_cast<unsigned char>(data[pos])]) ++pos;
+    return pos;
+}
+
+size_t ByteSet::find(const char* data, size_t pos, size_t end) const {
+    if (pos >= end || count == 0) return end;
+    if (count == 1) {
+        const void* hit = std::memchr(data + pos, low[0], end - pos);
+        return hit ? static_cast<size_t>(static_cast<const char*>(hit) - data) : end;
+    }
+
+#if defined(__SSE2__)
+    if (ranges <= MAX_VECTOR_RANGES) {
+        while (pos + 16 <= end) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+            unsigned int mask = matchMask(chunk, low, width, ranges);
+            if (mask) return pos + __builtin_ctz(mask);
+            pos += 16;
+        }
+    }
+#endif
+
+    while (pos < end && !table[static_cast<unsigned char>(data[pos])]) ++pos;
+    return pos;
+}
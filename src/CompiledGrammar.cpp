@@ -0,0 +1,982 @@
+#include "../include/CompiledGrammar.hpp"
+#include "../include/TokenScanner.hpp"
+#include "../include/BranchProfile.hpp"
+#include "../include/Debug.hpp"
+#include <iostream>
+#include <algorithm>
+#include <deque>
+#include <set>
+
+const unsigned int CompiledGrammar::NO_RULE = 0xFFFFFFFFu;
+const unsigned int CompiledGrammar::UNBOUNDED = 0xFFFFFFFFu;
+
+// Remove surrounding quotes from terminal strings
+static std::string stripQuotes(const std::string& s) {
+    if (s.size() >= 2 && ((s[0] == '\'' && s[s.size()-1] == '\'') ||
+                          (s[0] == '"'  && s[s.size()-1] == '"')))
+    {
+        return s.substr(1, s.size() - 2);
+    }
+    return s;
+}
+
+// Length addition that saturates at UNBOUNDED
+static unsigned int addLength(unsigned int a, unsigned int b) {
+    if (a >= CompiledGrammar::UNBOUNDED - b) return CompiledGrammar::UNBOUNDED;
+    return a + b;
+}
+
+// Pack a bitmap into 32 bytes to use it as a map key
+static std::string bitmapKey(const std::bitset<256>& bits) {
+    std::string key(32, '\0');
+    for (size_t i = 0; i < 256; ++i) {
+        if (bits.test(i))
+            key[i >> 3] = static_cast<char>(key[i >> 3] | (1 << (i & 7)));
+    }
+    return key;
+}
+
+CompiledGrammar::CompiledGrammar(const Grammar& g, const BranchProfile* profile) : failNode(NO_RULE) {
+    compile(g, 0, profile);
+}
+
+CompiledGrammar::CompiledGrammar(const Grammar& g, const std::vector<std::string>& startRules)
+    : failNode(NO_RULE)
+{
+    std::vector<std::string> starts(startRules);
+    // Every parse skips with the skip rule, whatever it starts from
+    if (!g.getSkipRule().empty())
+        starts.push_back(g.getSkipRule());
+    std::set<const Rule*> reached;
+    g.reachableRules(starts, reached);
+    compile(g, &reached, 0);
+}
+
+void CompiledGrammar::compile(const Grammar& g, const std::set<const Rule*>* only, const BranchProfile* profile) {
+    const std::vector<Rule*>& src = g.getRules();
+
+    // Rule indices first so symbols can be resolved while lowering.
+    // Like Grammar::getRule, the first rule with a given name wins.
+    std::vector<const Rule*> ruleSources;
+    for (size_t i = 0; i < src.size(); ++i) {
+        if (!src[i] || nameIndex.count(src[i]->name)) continue;
+        if (only && !only->count(src[i])) continue;
+        addRuleInfo(src[i]);
+        ruleSources.push_back(src[i]);
+    }
+    extend(ruleSources, 0);
+    if (profile) orderBranches(*profile);
+
+    if (!g.getSkipRule().empty()) {
+        unsigned int r = findRule(g.getSkipRule());
+        std::bitset<256> bits;
+        if (r != NO_RULE && singleBytes(rules[r].root, bits, 0))
+            skipBytes = ByteSet(bits);
+        else
+            std::cerr << "CompiledGrammar: skip rule " << g.getSkipRule()
+                      << " must exist and match exactly one byte" << std::endl;
+    }
+
+    // A compilation for some start rules keeps what addStartRule() needs
+    if (!only) {
+        lowered.clear();
+        bitmapIndex.clear();
+        std::vector<std::vector<std::string> >().swap(requiredFound);
+        std::vector<unsigned char>().swap(requiredState);
+    }
+    DEBUG_MSG("CompiledGrammar: " << rules.size() << " rules, " << nodes.size()
+              << " nodes, " << bitmaps.size() << " bitmaps");
+}
+
+// Adds a rule to the rule and name tables; extend() lowers it
+void CompiledGrammar::addRuleInfo(const Rule* src) {
+    unsigned int id = static_cast<unsigned int>(rules.size());
+    nameIndex[src->name] = id;
+    RuleInfo info;
+    info.root = NO_RULE;
+    info.name = static_cast<unsigned int>(names.size());
+    info.transparent = src->transparent;
+    info.token = src->token;
+    info.reentrant = false;
+    names.push_back(src->name);
+    rules.push_back(info);
+}
+
+// Lowers the rules added from firstRule on and analyzes the nodes this
+// adds. Earlier nodes are final, and new nodes never feed back into them,
+// since the rules compiled before were closed under reference.
+void CompiledGrammar::extend(const std::vector<const Rule*>& sources, unsigned int firstRule) {
+    unsigned int firstNode = static_cast<unsigned int>(nodes.size());
+    for (size_t i = 0; i < sources.size(); ++i)
+        rules[firstRule + i].root = lower(sources[i]->rootExpr);
+
+    Components components;
+    findComponents(components, firstNode);
+    computeFirstSets(components);
+    computeLengths(components);
+    computeRequiredLiterals(firstRule);
+    computeReentrant(firstNode);
+    buildScanners(firstRule);
+}
+
+bool CompiledGrammar::addStartRule(const Grammar& g, const std::string& rule) {
+    if (findRule(rule) != NO_RULE) return true;
+    const Rule* start = g.getRule(rule);
+    if (!start) return false;
+
+    // The rules the new start rule reaches that are not compiled yet. A
+    // lowered expression only reaches compiled rules, so the walk stops there.
+    unsigned int firstRule = static_cast<unsigned int>(rules.size());
+    std::vector<const Rule*> sources;
+    std::vector<const Rule*> pending(1, start);
+    std::vector<const Expression*> exprs;
+    std::set<const Expression*> seen;
+    while (!pending.empty()) {
+        const Rule* r = pending.back();
+        pending.pop_back();
+        if (!r || nameIndex.count(r->name)) continue;
+        addRuleInfo(r);
+        sources.push_back(r);
+        exprs.push_back(r->rootExpr);
+        while (!exprs.empty()) {
+            const Expression* expr = exprs.back();
+            exprs.pop_back();
+            if (!expr || lowered.count(expr) || !seen.insert(expr).second) continue;
+            if (expr->type == Expression::EXPR_SYMBOL)
+                pending.push_back(g.getRule(expr->value));
+            exprs.insert(exprs.end(), expr->children.begin(), expr->children.end());
+        }
+    }
+
+    unsigned int before = static_cast<unsigned int>(nodes.size());
+    extend(sources, firstRule);
+    DEBUG_MSG("CompiledGrammar: added " << rule << ", " << sources.size() << " rules, "
+              << nodes.size() - before << " nodes");
+    (void)before;
+    return true;
+}
+
+CompiledGrammar::CompiledGrammar(const CompiledGrammar& other)
+    : nodes(other.nodes), rules(other.rules), names(other.names), bitmaps(other.bitmaps),
+      edges(other.edges), ranks(other.ranks), literals(other.literals),
+      minLengths(other.minLengths), maxLengths(other.maxLengths), scanners(other.scanners.size(), 0),
+      skipBytes(other.skipBytes), requiredLiterals(other.requiredLiterals),
+      nameIndex(other.nameIndex), unknownNames(other.unknownNames), bitmapIndex(other.bitmapIndex),
+      lowered(other.lowered), requiredFound(other.requiredFound), requiredState(other.requiredState),
+      failNode(other.failNode)
+{
+    for (size_t i = 0; i < scanners.size(); ++i) {
+        if (other.scanners[i]) scanners[i] = new TokenScanner(*other.scanners[i]);
+    }
+}
+
+CompiledGrammar::~CompiledGrammar() {
+    for (size_t i = 0; i < scanners.size(); ++i)
+        delete scanners[i];
+}
+
+// One scanner per token rule; rules that cannot be made deterministic keep
+// a scanner without a table and are interpreted instead.
+void CompiledGrammar::buildScanners(unsigned int firstRule) {
+    scanners.resize(rules.size(), static_cast<TokenScanner*>(0));
+    for (unsigned int r = firstRule; r < rules.size(); ++r) {
+        if (rules[r].token)
+            scanners[r] = new TokenScanner(*this, r);
+    }
+}
+
+// Required literals kept per node; more only matter for alternatives
+static const size_t MAX_REQUIRED = 8;
+
+static bool longerLiteral(const std::string& a, const std::string& b) {
+    return a.size() > b.size();
+}
+
+// Sort longest first, drop duplicates and keep the longest few
+static void keepLongest(std::vector<std::string>& lits) {
+    std::stable_sort(lits.begin(), lits.end(), longerLiteral);
+    std::vector<std::string> kept;
+    for (size_t i = 0; i < lits.size() && kept.size() < MAX_REQUIRED; ++i) {
+        if (std::find(kept.begin(), kept.end(), lits[i]) == kept.end())
+            kept.push_back(lits[i]);
+    }
+    lits.swap(kept);
+}
+
+// Per-node results are kept between extend() calls, so rules added later
+// build on those of the rules they use.
+void CompiledGrammar::computeRequiredLiterals(unsigned int firstRule) {
+    requiredFound.resize(nodes.size());
+    requiredState.resize(nodes.size(), 0);
+    requiredLiterals.resize(rules.size());
+    for (unsigned int r = firstRule; r < rules.size(); ++r) {
+        collectRequired(rules[r].root, requiredFound, requiredState);
+        if (!requiredFound[rules[r].root].empty())
+            requiredLiterals[r] = requiredFound[rules[r].root][0];
+    }
+}
+
+// Literals every match of a node contains. A node reached again through
+// recursion contributes nothing, which only weakens the result.
+void CompiledGrammar::collectRequired(unsigned int id, std::vector<std::vector<std::string> >& found,
+                                      std::vector<unsigned char>& state) const {
+    if (state[id]) return;
+    state[id] = 1;
+    const Node& n = nodes[id];
+    std::vector<std::string> out;
+    switch (n.kind) {
+        case NODE_TERMINAL:
+            if (n.b) out.push_back(literals.substr(n.a, n.b));
+            break;
+        case NODE_CHAR_RANGE:
+            if (n.a == n.b) out.push_back(std::string(1, static_cast<char>(n.a)));
+            break;
+        case NODE_CHAR_CLASS:
+            if (bitmaps[n.a].count() == 1) {
+                for (unsigned int c = 0; c < 256; ++c) {
+                    if (bitmaps[n.a].test(c)) out.push_back(std::string(1, static_cast<char>(c)));
+                }
+            }
+            break;
+        case NODE_SYMBOL:
+            if (n.a != NO_RULE) {
+                collectRequired(rules[n.a].root, found, state);
+                out = found[rules[n.a].root];
+            }
+            break;
+        case NODE_SEQUENCE:
+            for (unsigned int i = 0; i < n.b; ++i) {
+                unsigned int c = edges[n.a + i];
+                collectRequired(c, found, state);
+                out.insert(out.end(), found[c].begin(), found[c].end());
+            }
+            break;
+        case NODE_ALTERNATIVE: {
+            // A literal is required if every branch requires it or a literal containing it
+            std::vector<std::string> candidates;
+            for (unsigned int i = 0; i < n.b; ++i) {
+                unsigned int c = edges[n.a + i];
+                collectRequired(c, found, state);
+                candidates.insert(candidates.end(), found[c].begin(), found[c].end());
+            }
+            for (size_t k = 0; k < candidates.size(); ++k) {
+                bool everywhere = true;
+                for (unsigned int i = 0; i < n.b && everywhere; ++i) {
+                    const std::vector<std::string>& branch = found[edges[n.a + i]];
+                    bool contained = false;
+                    for (size_t j = 0; j < branch.size() && !contained; ++j)
+                        contained = branch[j].find(candidates[k]) != std::string::npos;
+                    everywhere = contained;
+                }
+                if (everywhere) out.push_back(candidates[k]);
+            }
+            break;
+        }
+        default:
+            // Optionals and repetitions can match nothing; predicates match outside the span
+            break;
+    }
+    keepLongest(out);
+    found[id].swap(out);
+    state[id] = 2;
+}
+
+// Collect the bytes of an expression that always matches exactly one byte
+bool CompiledGrammar::singleBytes(unsigned int id, std::bitset<256>& bits, unsigned int depth) const {
+    const Node& n = nodes[id];
+    if (depth > rules.size()) return false;  // recursive symbols
+    switch (n.kind) {
+        case NODE_TERMINAL:
+            if (n.b != 1) return false;
+            bits.set(static_cast<unsigned char>(literals[n.a]));
+            return true;
+        case NODE_CHAR_RANGE:
+            for (unsigned int c = n.a; c <= n.b && c < 256; ++c)
+                bits.set(c);
+            return true;
+        case NODE_CHAR_CLASS:
+            bits |= bitmaps[n.a];
+            return true;
+        case NODE_SYMBOL:
+            return n.a != NO_RULE && singleBytes(rules[n.a].root, bits, depth + 1);
+        case NODE_ALTERNATIVE:
+            if (n.b == 0) return false;
+            for (unsigned int i = 0; i < n.b; ++i) {
+                if (!singleBytes(edges[n.a + i], bits, depth)) return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+unsigned int CompiledGrammar::findRule(const std::string& ruleName) const {
+    std::map<std::string, unsigned int>::const_iterator it = nameIndex.find(ruleName);
+    if (it == nameIndex.end()) return NO_RULE;
+    return it->second;
+}
+
+unsigned int CompiledGrammar::addNode(Kind kind, unsigned int a, unsigned int b) {
+    Node n;
+    n.kind = static_cast<unsigned char>(kind);
+    n.flags = 0;
+    n.minLen = 0;
+    n.a = a;
+    n.b = b;
+    n.first = 0;
+    nodes.push_back(n);
+    return static_cast<unsigned int>(nodes.size() - 1);
+}
+
+unsigned int CompiledGrammar::internBitmap(const std::bitset<256>& bits) {
+    std::string key = bitmapKey(bits);
+    std::map<std::string, unsigned int>::iterator it = bitmapIndex.find(key);
+    if (it != bitmapIndex.end()) return it->second;
+    unsigned int id = static_cast<unsigned int>(bitmaps.size());
+    bitmaps.push_back(bits);
+    bitmapIndex.insert(std::make_pair(key, id));
+    return id;
+}
+
+// Resolve a symbol reference; unknown names get their own name entry so the
+// parser can still report them.
+unsigned int CompiledGrammar::symbolName(const std::string& symbol, unsigned int& ruleIndex) {
+    std::map<std::string, unsigned int>::iterator it = nameIndex.find(symbol);
+    if (it != nameIndex.end()) {
+        ruleIndex = it->second;
+        return rules[it->second].name;
+    }
+    ruleIndex = NO_RULE;
+    it = unknownNames.find(symbol);
+    if (it != unknownNames.end()) return it->second;
+    unsigned int id = static_cast<unsigned int>(names.size());
+    names.push_back(symbol);
+    unknownNames[symbol] = id;
+    return id;
+}
+
+// Lower one expression (and its children) into compact nodes. Shared
+// expressions are lowered once.
+unsigned int CompiledGrammar::lower(const Expression* expr) {
+    if (!expr) {
+        if (failNode == NO_RULE) failNode = addNode(NODE_FAIL, 0, 0);
+        return failNode;
+    }
+
+    std::map<const Expression*, unsigned int>::iterator it = lowered.find(expr);
+    if (it != lowered.end()) return it->second;
+
+    unsigned int id = 0;
+    switch (expr->type) {
+        case Expression::EXPR_TERMINAL: {
+            std::string lit = stripQuotes(expr->value);
+            unsigned int offset = static_cast<unsigned int>(literals.size());
+            literals += lit;
+            id = addNode(NODE_TERMINAL, offset, static_cast<unsigned int>(lit.size()));
+            break;
+        }
+        case Expression::EXPR_SYMBOL: {
+            unsigned int ruleIndex = NO_RULE;
+            unsigned int nameId = symbolName(expr->value, ruleIndex);
+            id = addNode(NODE_SYMBOL, ruleIndex, nameId);
+            if (ruleIndex != NO_RULE && rules[ruleIndex].transparent)
+                nodes[id].flags |= FLAG_TRANSPARENT;
+            if (ruleIndex != NO_RULE && rules[ruleIndex].token)
+                nodes[id].flags |= FLAG_TOKEN;
+            break;
+        }
+        case Expression::EXPR_CHAR_RANGE:
+            id = addNode(NODE_CHAR_RANGE, expr->charRange.start, expr->charRange.end);
+            break;
+        case Expression::EXPR_CHAR_CLASS:
+            id = addNode(NODE_CHAR_CLASS, internBitmap(expr->charBitmap), 0);
+            break;
+        case Expression::EXPR_OPTIONAL:
+        case Expression::EXPR_REPEAT:
+        case Expression::EXPR_AND_PREDICATE:
+        case Expression::EXPR_NOT_PREDICATE: {
+            Kind kind = static_cast<Kind>(expr->type);
+            id = addNode(kind, 0, 0);
+            if (kind == NODE_AND || kind == NODE_NOT)
+                nodes[id].flags |= FLAG_TRANSPARENT;
+            lowered[expr] = id;
+            unsigned int childId = lower(expr->children.empty() ? 0 : expr->children[0]);
+            nodes[id].a = childId;
+            return id;
+        }
+        case Expression::EXPR_SEQUENCE:
+        case Expression::EXPR_ALTERNATIVE: {
+            Kind kind = expr->type == Expression::EXPR_SEQUENCE ? NODE_SEQUENCE : NODE_ALTERNATIVE;
+            // Reserve the edge slots before lowering the children so the
+            // edge array follows the same preorder as the nodes.
+            unsigned int offset = static_cast<unsigned int>(edges.size());
+            unsigned int count = static_cast<unsigned int>(expr->children.size());
+            edges.resize(edges.size() + count);
+            id = addNode(kind, offset, count);
+            lowered[expr] = id;
+            for (unsigned int i = 0; i < count; ++i) {
+                unsigned int childId = lower(expr->children[i]);
+                edges[offset + i] = childId;
+            }
+            return id;
+        }
+        default:
+            id = addNode(NODE_FAIL, 0, 0);
+            break;
+    }
+    lowered[expr] = id;
+    return id;
+}
+
+// Tarjan's algorithm with an explicit stack, since rule chains can be far
+// deeper than the call stack. Components are completed dependencies first.
+// Only nodes from base on are split; earlier ones are final.
+void CompiledGrammar::findComponents(Components& c, unsigned int base) const {
+    unsigned int count = static_cast<unsigned int>(nodes.size()) - base;
+    c.base = base;
+    c.depStart.assign(count + 1, 0);
+    c.deps.clear();
+    for (unsigned int k = 0; k < count; ++k) {
+        c.depStart[k] = static_cast<unsigned int>(c.deps.size());
+        const Node& n = nodes[base + k];
+        switch (n.kind) {
+            case NODE_SYMBOL:
+                if (n.a != NO_RULE) c.deps.push_back(rules[n.a].root);
+                break;
+            case NODE_SEQUENCE:
+            case NODE_ALTERNATIVE:
+                c.deps.insert(c.deps.end(), edges.begin() + n.a, edges.begin() + n.a + n.b);
+                break;
+            case NODE_OPTIONAL:
+            case NODE_REPEAT:
+                c.deps.push_back(n.a);
+                break;
+            default:
+                break;
+        }
+    }
+    c.depStart[count] = static_cast<unsigned int>(c.deps.size());
+
+    // Users by counting sort over the dependencies
+    c.userStart.assign(count + 1, 0);
+    for (size_t i = 0; i < c.deps.size(); ++i)
+        if (c.deps[i] >= base) ++c.userStart[c.deps[i] - base + 1];
+    for (unsigned int k = 0; k < count; ++k)
+        c.userStart[k + 1] += c.userStart[k];
+    c.users.resize(c.userStart[count]);
+    std::vector<unsigned int> fill(c.userStart.begin(), c.userStart.end() - 1);
+    for (unsigned int k = 0; k < count; ++k)
+        for (unsigned int i = c.depStart[k]; i < c.depStart[k + 1]; ++i)
+            if (c.deps[i] >= base) c.users[fill[c.deps[i] - base]++] = base + k;
+
+    std::vector<unsigned int> index(count, NO_RULE);
+    std::vector<unsigned int> low(count, 0);
+    std::vector<bool> stacked(count, false);
+    std::vector<unsigned int> stack;
+    std::vector<std::pair<unsigned int, unsigned int> > path;  // Node and its next dependency
+    unsigned int visited = 0;
+    c.members.clear();
+    c.bounds.clear();
+    c.component.assign(count, 0);
+    for (unsigned int root = 0; root < count; ++root) {
+        if (index[root] != NO_RULE) continue;
+        index[root] = low[root] = visited++;
+        stack.push_back(root);
+        stacked[root] = true;
+        path.push_back(std::make_pair(root, c.depStart[root]));
+        while (!path.empty()) {
+            unsigned int k = path.back().first;
+            if (path.back().second < c.depStart[k + 1]) {
+                unsigned int dep = c.deps[path.back().second++];
+                if (dep < base) continue;
+                unsigned int d = dep - base;
+                if (index[d] == NO_RULE) {
+                    index[d] = low[d] = visited++;
+                    stack.push_back(d);
+                    stacked[d] = true;
+                    path.push_back(std::make_pair(d, c.depStart[d]));
+                } else if (stacked[d] && index[d] < low[k]) {
+                    low[k] = index[d];
+                }
+                continue;
+            }
+            path.pop_back();
+            if (!path.empty() && low[k] < low[path.back().first])
+                low[path.back().first] = low[k];
+            if (low[k] != index[k]) continue;
+            unsigned int comp = static_cast<unsigned int>(c.bounds.size());
+            c.bounds.push_back(static_cast<unsigned int>(c.members.size()));
+            unsigned int m;
+            do {
+                m = stack.back();
+                stack.pop_back();
+                stacked[m] = false;
+                c.component[m] = comp;
+                c.members.push_back(base + m);
+            } while (m != k);
+        }
+    }
+    c.bounds.push_back(static_cast<unsigned int>(c.members.size()));
+}
+
+// Whether a component contains a cycle: several nodes, or one depending on itself
+bool CompiledGrammar::cyclic(const Components& c, unsigned int comp) const {
+    if (c.bounds[comp + 1] - c.bounds[comp] > 1) return true;
+    unsigned int k = c.members[c.bounds[comp]];
+    for (unsigned int i = c.depStart[k - c.base]; i < c.depStart[k - c.base + 1]; ++i)
+        if (c.deps[i] == k) return true;
+    return false;
+}
+
+// FIRST sets and nullability, component by component. A node outside a
+// cycle is evaluated once; in a cycle, the users of a node that changed are
+// evaluated again until nothing changes (sets only grow, so this ends).
+void CompiledGrammar::computeFirstSets(const Components& c) {
+    size_t count = nodes.size() - c.base;
+    std::vector<std::bitset<256> > first(count);
+    std::vector<bool> nullable(count, false);
+    std::vector<bool> queued(count, false);
+    std::deque<unsigned int> work;
+
+    for (unsigned int comp = 0; comp + 1 < c.bounds.size(); ++comp) {
+        for (unsigned int i = c.bounds[comp]; i < c.bounds[comp + 1]; ++i) {
+            work.push_back(c.members[i]);
+            queued[c.members[i] - c.base] = true;
+        }
+        while (!work.empty()) {
+            unsigned int k = work.front();
+            work.pop_front();
+            queued[k - c.base] = false;
+            if (!updateFirst(k, c.base, first, nullable)) continue;
+            for (unsigned int i = c.userStart[k - c.base]; i < c.userStart[k - c.base + 1]; ++i) {
+                unsigned int user = c.users[i];
+                if (c.contains(user, comp) && !queued[user - c.base]) {
+                    work.push_back(user);
+                    queued[user - c.base] = true;
+                }
+            }
+        }
+    }
+
+    for (size_t k = 0; k < count; ++k) {
+        nodes[c.base + k].first = internBitmap(first[k]);
+        if (nullable[k]) nodes[c.base + k].flags |= FLAG_NULLABLE;
+    }
+}
+
+// FIRST set of a node while computeFirstSets runs: nodes from base on are
+// in the working set, earlier ones in the tables
+const std::bitset<256>& CompiledGrammar::firstSoFar(unsigned int id, unsigned int base,
+                                                   const std::vector<std::bitset<256> >& first) const {
+    return id < base ? bitmaps[nodes[id].first] : first[id - base];
+}
+
+bool CompiledGrammar::nullableSoFar(unsigned int id, unsigned int base, const std::vector<bool>& nullable) const {
+    return id < base ? CompiledGrammar::nullable(nodes[id]) : nullable[id - base];
+}
+
+// Recomputes one node's FIRST set and nullability; returns whether either changed
+bool CompiledGrammar::updateFirst(unsigned int id, unsigned int base, std::vector<std::bitset<256> >& first,
+                                  std::vector<bool>& nullable) const {
+    const Node& n = nodes[id];
+    std::bitset<256> fi;
+    bool nul = false;
+    switch (n.kind) {
+        case NODE_TERMINAL:
+            if (n.b > 0) fi.set(static_cast<unsigned char>(literals[n.a]));
+            else nul = true;
+            break;
+        case NODE_SYMBOL:
+            if (n.a != NO_RULE) {
+                fi = firstSoFar(rules[n.a].root, base, first);
+                nul = nullableSoFar(rules[n.a].root, base, nullable);
+            }
+            break;
+        case NODE_SEQUENCE: {
+            nul = true;
+            for (unsigned int i = 0; i < n.b; ++i) {
+                unsigned int kid = edges[n.a + i];
+                fi |= firstSoFar(kid, base, first);
+                if (!nullableSoFar(kid, base, nullable)) {
+                    nul = false;
+                    break;
+                }
+            }
+            break;
+        }
+        case NODE_ALTERNATIVE: {
+            for (unsigned int i = 0; i < n.b; ++i) {
+                unsigned int kid = edges[n.a + i];
+                fi |= firstSoFar(kid, base, first);
+                nul = nul || nullableSoFar(kid, base, nullable);
+            }
+            break;
+        }
+        case NODE_OPTIONAL:
+        case NODE_REPEAT:
+            fi = firstSoFar(n.a, base, first);
+            nul = true;
+            break;
+        case NODE_AND:
+        case NODE_NOT:
+            // Consume nothing; what comes next is FIRST of the sequence rest
+            nul = true;
+            break;
+        case NODE_CHAR_RANGE:
+            for (unsigned int c = n.a; c <= n.b && c < 256; ++c)
+                fi.set(c);
+            break;
+        case NODE_CHAR_CLASS:
+            fi = bitmaps[n.a];
+            break;
+        default:
+            break;
+    }
+    if (fi == first[id - base] && nul == nullable[id - base]) return false;
+    first[id - base] = fi;
+    nullable[id - base] = nul;
+    return true;
+}
+
+// Merges a FOLLOW contribution into a node and queues the node if it grew
+static void addFollow(std::vector<std::bitset<256> >& follow, std::vector<bool>& atEnd,
+                      std::vector<unsigned int>& work, std::vector<bool>& queued,
+                      unsigned int id, const std::bitset<256>& bits, bool end) {
+    std::bitset<256> merged = follow[id] | bits;
+    bool mergedEnd = atEnd[id] || end;
+    if (merged == follow[id] && mergedEnd == atEnd[id]) return;
+    follow[id] = merged;
+    atEnd[id] = mergedEnd;
+    if (!queued[id]) {
+        queued[id] = true;
+        work.push_back(id);
+    }
+}
+
+// FOLLOW sets from the FIRST sets. Every node passes its set on to its
+// children once, and again whenever it grows. A node shared by several
+// parents (interning) gets the union of its contexts. The end of input
+// follows only the start rules given.
+void CompiledGrammar::followSets(const std::vector<unsigned int>& startRules,
+                                 std::vector<std::bitset<256> >& follow, std::vector<bool>& atEnd) const {
+    follow.assign(nodes.size(), std::bitset<256>());
+    atEnd.assign(nodes.size(), false);
+    for (size_t i = 0; i < startRules.size(); ++i) {
+        if (startRules[i] < rules.size())
+            atEnd[rules[startRules[i]].root] = true;
+    }
+
+    // Parents come before their children in preorder, so start from the front
+    std::vector<unsigned int> work;
+    std::vector<bool> queued(nodes.size(), true);
+    for (size_t k = nodes.size(); k-- > 0; )
+        work.push_back(static_cast<unsigned int>(k));
+
+    while (!work.empty()) {
+        unsigned int k = work.back();
+        work.pop_back();
+        queued[k] = false;
+        const Node& n = nodes[k];
+        switch (n.kind) {
+            case NODE_SYMBOL:
+                if (n.a != NO_RULE)
+                    addFollow(follow, atEnd, work, queued, rules[n.a].root, follow[k], atEnd[k]);
+                break;
+            case NODE_SEQUENCE: {
+                // Walk backwards, carrying what can follow the current suffix
+                std::bitset<256> tail = follow[k];
+                bool tailEnd = atEnd[k];
+                for (unsigned int i = n.b; i-- > 0; ) {
+                    unsigned int kid = edges[n.a + i];
+                    addFollow(follow, atEnd, work, queued, kid, tail, tailEnd);
+                    if (nullable(nodes[kid])) {
+                        tail |= bitmaps[nodes[kid].first];
+                    } else {
+                        tail = bitmaps[nodes[kid].first];
+                        tailEnd = false;
+                    }
+                }
+                break;
+            }
+            case NODE_ALTERNATIVE:
+                for (unsigned int i = 0; i < n.b; ++i)
+                    addFollow(follow, atEnd, work, queued, edges[n.a + i], follow[k], atEnd[k]);
+                break;
+            case NODE_OPTIONAL:
+                addFollow(follow, atEnd, work, queued, n.a, follow[k], atEnd[k]);
+                break;
+            case NODE_REPEAT:
+                addFollow(follow, atEnd, work, queued, n.a, follow[k] | bitmaps[nodes[n.a].first], atEnd[k]);
+                break;
+            case NODE_AND:
+            case NODE_NOT:
+                // A lookahead operand can be followed by anything
+                addFollow(follow, atEnd, work, queued, n.a, std::bitset<256>().set(), true);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Minimum and maximum match lengths, component by component.
+//
+// Minimums start at UNBOUNDED (never matches) and only decrease; cycles are
+// solved with a worklist like the FIRST sets, so recursive rules converge.
+//
+// Every node of a cycle matches at most as much as the node it depends on
+// (sums, maxima and copies never shrink), so all nodes of a component share
+// one maximum. It is the largest value of a member with the component's own
+// nodes counted as empty. If a member then grows when they count as that
+// value, going around the cycle consumes input and the whole component is
+// UNBOUNDED. Each component is evaluated once.
+//
+// Unresolved symbols and empty terminals never match but get a minimum of 0,
+// so the parser still reaches them and reports unknown symbols as before.
+void CompiledGrammar::computeLengths(const Components& c) {
+    minLengths.resize(nodes.size(), UNBOUNDED);
+    maxLengths.resize(nodes.size(), 0);
+    std::vector<bool> queued(nodes.size() - c.base, false);
+    std::deque<unsigned int> work;
+
+    for (unsigned int comp = 0; comp + 1 < c.bounds.size(); ++comp) {
+        for (unsigned int i = c.bounds[comp]; i < c.bounds[comp + 1]; ++i) {
+            work.push_back(c.members[i]);
+            queued[c.members[i] - c.base] = true;
+        }
+        while (!work.empty()) {
+            unsigned int k = work.front();
+            work.pop_front();
+            queued[k - c.base] = false;
+            if (!updateMinLength(k)) continue;
+            for (unsigned int i = c.userStart[k - c.base]; i < c.userStart[k - c.base + 1]; ++i) {
+                unsigned int user = c.users[i];
+                if (c.contains(user, comp) && !queued[user - c.base]) {
+                    work.push_back(user);
+                    queued[user - c.base] = true;
+                }
+            }
+        }
+
+        unsigned int hi = 0;
+        for (unsigned int i = c.bounds[comp]; i < c.bounds[comp + 1]; ++i)
+            hi = std::max(hi, maxLengthOf(c.members[i], c, 0));
+        if (hi != UNBOUNDED && cyclic(c, comp)) {
+            for (unsigned int i = c.bounds[comp]; i < c.bounds[comp + 1]; ++i) {
+                if (maxLengthOf(c.members[i], c, hi) > hi) {
+                    hi = UNBOUNDED;
+                    break;
+                }
+            }
+        }
+        for (unsigned int i = c.bounds[comp]; i < c.bounds[comp + 1]; ++i)
+            maxLengths[c.members[i]] = hi;
+    }
+
+    for (size_t k = c.base; k < nodes.size(); ++k)
+        nodes[k].minLen = static_cast<unsigned short>(minLengths[k] < 0xFFFFu ? minLengths[k] : 0xFFFFu);
+}
+
+// Recomputes one node's minimum length; returns whether it decreased
+bool CompiledGrammar::updateMinLength(unsigned int id) {
+    const Node& n = nodes[id];
+    unsigned int lo = 0;
+    switch (n.kind) {
+        case NODE_TERMINAL:
+            lo = n.b;
+            break;
+        case NODE_SYMBOL:
+            lo = n.a != NO_RULE ? minLengths[rules[n.a].root] : 0;
+            break;
+        case NODE_SEQUENCE:
+            for (unsigned int i = 0; i < n.b; ++i)
+                lo = addLength(lo, minLengths[edges[n.a + i]]);
+            break;
+        case NODE_ALTERNATIVE:
+            lo = UNBOUNDED;
+            for (unsigned int i = 0; i < n.b; ++i)
+                if (minLengths[edges[n.a + i]] < lo) lo = minLengths[edges[n.a + i]];
+            break;
+        case NODE_CHAR_RANGE:
+        case NODE_CHAR_CLASS:
+            lo = 1;
+            break;
+        case NODE_FAIL:
+            lo = UNBOUNDED;
+            break;
+        default:  // optional, repeat, predicates
+            break;
+    }
+    if (lo >= minLengths[id]) return false;
+    minLengths[id] = lo;
+    return true;
+}
+
+// Maximum length of a node, with nodes of its own component counted as inside
+unsigned int CompiledGrammar::maxLengthOf(unsigned int id, const Components& c, unsigned int inside) const {
+    const Node& n = nodes[id];
+    unsigned int hi = 0;
+    switch (n.kind) {
+        case NODE_TERMINAL:
+            return n.b;
+        case NODE_CHAR_RANGE:
+        case NODE_CHAR_CLASS:
+            return 1;
+        case NODE_SYMBOL:
+        case NODE_SEQUENCE:
+        case NODE_ALTERNATIVE:
+        case NODE_OPTIONAL:
+        case NODE_REPEAT:
+            break;
+        default:  // predicates, failures
+            return 0;
+    }
+    unsigned int comp = c.component[id - c.base];
+    for (unsigned int i = c.depStart[id - c.base]; i < c.depStart[id - c.base + 1]; ++i) {
+        unsigned int dep = c.deps[i];
+        unsigned int len = c.contains(dep, comp) ? inside : maxLengths[dep];
+        if (n.kind == NODE_SEQUENCE)
+            hi = addLength(hi, len);
+        else if (n.kind == NODE_REPEAT)
+            hi = len > 0 ? UNBOUNDED : 0;
+        else
+            hi = std::max(hi, len);
+    }
+    return hi;
+}
+
+// Levels of symbols and sequences markSharedPrefix looks through
+static const unsigned int MAX_PREFIX_DEPTH = 8;
+
+// Marks the rules that can be retried at a position: those shared by the
+// prefixes of overlapping alternative branches, and by an optional or
+// repetition body and the element after it.
+void CompiledGrammar::computeReentrant(unsigned int firstNode) {
+    for (unsigned int id = firstNode; id < nodes.size(); ++id) {
+        const Node& n = nodes[id];
+        if (n.kind == NODE_ALTERNATIVE) {
+            for (unsigned int i = 0; i < n.b; ++i)
+                for (unsigned int j = i + 1; j < n.b; ++j)
+                    if (overlap(edges[n.a + i], edges[n.a + j]))
+                        markSharedPrefix(edges[n.a + i], edges[n.a + j], 0);
+        } else if (n.kind == NODE_SEQUENCE) {
+            for (unsigned int i = 0; i + 1 < n.b; ++i) {
+                const Node& kid = nodes[edges[n.a + i]];
+                if (kid.kind != NODE_OPTIONAL && kid.kind != NODE_REPEAT) continue;
+                if (overlap(kid.a, edges[n.a + i + 1]))
+                    markSharedPrefix(kid.a, edges[n.a + i + 1], 0);
+            }
+        }
+    }
+}
+
+// Whether some lookahead lets both nodes be tried
+bool CompiledGrammar::overlap(unsigned int a, unsigned int b) const {
+    const Node& na = nodes[a];
+    const Node& nb = nodes[b];
+    return nullable(na) || nullable(nb) || (first(na) & first(nb)).any();
+}
+
+// Marks the rules both nodes try at the position they start at, walking
+// their sequences in step while the elements are the same. Returns whether
+// the nodes are the same as a whole.
+bool CompiledGrammar::markSharedPrefix(unsigned int a, unsigned int b, unsigned int depth) {
+    const Node& na = nodes[a];
+    const Node& nb = nodes[b];
+    if (a == b || (na.kind == NODE_SYMBOL && nb.kind == NODE_SYMBOL && na.a == nb.a && na.a != NO_RULE)) {
+        markSymbols(a);
+        return true;
+    }
+    if (depth >= MAX_PREFIX_DEPTH) return false;
+
+    if (na.kind == NODE_SEQUENCE || nb.kind == NODE_SEQUENCE) {
+        unsigned int ca = na.kind == NODE_SEQUENCE ? na.b : 1;
+        unsigned int cb = nb.kind == NODE_SEQUENCE ? nb.b : 1;
+        for (unsigned int k = 0; k < ca && k < cb; ++k) {
+            unsigned int ea = na.kind == NODE_SEQUENCE ? edges[na.a + k] : a;
+            unsigned int eb = nb.kind == NODE_SEQUENCE ? edges[nb.a + k] : b;
+            if (!markSharedPrefix(ea, eb, depth + 1)) return false;
+        }
+        return ca == cb;
+    }
+
+    // Different rules can still start with a common one
+    bool expandA = na.kind == NODE_SYMBOL && na.a != NO_RULE;
+    bool expandB = nb.kind == NODE_SYMBOL && nb.a != NO_RULE;
+    if (!expandA && !expandB) return false;
+    markSharedPrefix(expandA ? rules[na.a].root : a, expandB ? rules[nb.a].root : b, depth + 1);
+    return false;
+}
+
+// Marks every rule a node refers to directly
+void CompiledGrammar::markSymbols(unsigned int id) {
+    const Node& n = nodes[id];
+    switch (n.kind) {
+        case NODE_SYMBOL:
+            if (n.a != NO_RULE) rules[n.a].reentrant = true;
+            break;
+        case NODE_SEQUENCE:
+        case NODE_ALTERNATIVE:
+            for (unsigned int i = 0; i < n.b; ++i) markSymbols(edges[n.a + i]);
+            break;
+        case NODE_OPTIONAL:
+        case NODE_REPEAT:
+        case NODE_AND:
+        case NODE_NOT:
+            markSymbols(n.a);
+            break;
+        default:
+            break;
+    }
+}
+
+// Sorts the branches of each profiled alternative by wins, most first. The
+// sort is stable, so branches that won equally often keep their order.
+void CompiledGrammar::orderBranches(const BranchProfile& profile) {
+    std::vector<std::pair<long, unsigned int> > order;
+    for (unsigned int id = 0; id < nodes.size(); ++id) {
+        const Node& n = nodes[id];
+        if (n.kind != NODE_ALTERNATIVE) continue;
+        order.clear();
+        bool profiled = false;
+        for (unsigned int i = 0; i < n.b; ++i) {
+            long wins = static_cast<long>(profile.wins(id, i));
+            if (wins) profiled = true;
+            order.push_back(std::make_pair(-wins, i));
+        }
+        if (!profiled) continue;
+        if (ranks.empty()) {
+            ranks.resize(edges.size());
+            for (unsigned int k = 0; k < nodes.size(); ++k) {
+                if (nodes[k].kind != NODE_ALTERNATIVE) continue;
+                for (unsigned int i = 0; i < nodes[k].b; ++i) ranks[nodes[k].a + i] = i;
+            }
+        }
+        std::stable_sort(order.begin(), order.end());
+        std::vector<unsigned int> children(edges.begin() + n.a, edges.begin() + n.a + n.b);
+        for (unsigned int i = 0; i < n.b; ++i) {
+            edges[n.a + i] = children[order[i].second];
+            ranks[n.a + i] = order[i].second;
+        }
+    }
+}
+
+size_t CompiledGrammar::memoryUsage() const {
+    size_t total = nodes.capacity() * sizeof(Node)
+                 + rules.capacity() * sizeof(RuleInfo)
+                 + bitmaps.capacity() * sizeof(std::bitset<256>)
+                 + edges.capacity() * sizeof(unsigned int)
+                 + ranks.capacity() * sizeof(unsigned int)
+                 + minLengths.capacity() * sizeof(unsigned int)
+                 + maxLengths.capacity() * sizeof(unsigned int)
+                 + literals.capacity()
+                 + scanners.capacity() * sizeof(TokenScanner*);
+    for (size_t i = 0; i < names.size(); ++i)
+        total += sizeof(std::string) + names[i].capacity();
+    for (size_t i = 0; i < requiredLiterals.size(); ++i)
+        total += sizeof(std::string) + requiredLiterals[i].capacity();
+    for (size_t i = 0; i < scanners.size(); ++i) {
+        if (scanners[i]) total += sizeof(TokenScanner) + scanners[i]->memoryUsage();
+    }
+    return total;
+}
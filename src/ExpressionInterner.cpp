@@ -1,49 +1,71 @@
 #include "../include/ExpressionInterner.hpp"
 
-ExpressionKey::ExpressionKey() : type(0), rangeStart(0), rangeEnd(0) {}
+static const size_t INITIAL_SLOTS = 1024;
 
-static std::string bitmapToString(const std::bitset<256>& bits) {
-    std::string out;
-    out.reserve(256);
-    for (size_t i = 0; i < 256; ++i) {
-        out.push_back(bits.test(i) ? '1' : '0');
-    }
-    return out;
+static inline size_t combine(size_t h, size_t v) {
+    return h ^ (v + 0x9e3779b9 + (h << 6) + (h >> 2));
 }
 
-ExpressionKey::ExpressionKey(const Expression* expr)
-    : type(static_cast<int>(expr->type)),
-      value(expr->value),
-      rangeStart(static_cast<int>(expr->charRange.start)),
-      rangeEnd(static_cast<int>(expr->charRange.end)),
-      bitmapBits(bitmapToString(expr->charBitmap)) {
-    for (size_t i = 0; i < expr->children.size(); ++i) {
-        childrenIds.push_back(reinterpret_cast<size_t>(expr->children[i]));
+size_t ExpressionInterner::hash(const Expression* expr) {
+    size_t h = static_cast<size_t>(expr->type);
+    for (size_t i = 0; i < expr->value.size(); ++i)
+        h = h * 31 + static_cast<unsigned char>(expr->value[i]);
+    h = combine(h, expr->charRange.start);
+    h = combine(h, expr->charRange.end);
+    if (expr->type == Expression::EXPR_CHAR_CLASS) {
+        for (size_t word = 0; word < 256; word += 32) {
+            size_t bits = 0;
+            for (size_t i = 0; i < 32; ++i)
+                if (expr->charBitmap.test(word + i)) bits |= size_t(1) << i;
+            h = combine(h, bits);
+        }
     }
+    for (size_t i = 0; i < expr->children.size(); ++i)
+        h = combine(h, reinterpret_cast<size_t>(expr->children[i]));
+    return combine(h, expr->children.size());
 }
 
-bool ExpressionKey::operator<(const ExpressionKey& other) const {
-    if (type != other.type) return type < other.type;
-    if (value != other.value) return value < other.value;
-    if (rangeStart != other.rangeStart) return rangeStart < other.rangeStart;
-    if (rangeEnd != other.rangeEnd) return rangeEnd < other.rangeEnd;
-    if (bitmapBits != other.bitmapBits) return bitmapBits < other.bitmapBits;
-    if (childrenIds.size() != other.childrenIds.size()) return childrenIds.size() < other.childrenIds.size();
-    for (size_t i = 0; i < childrenIds.size(); ++i) {
-        if (childrenIds[i] != other.childrenIds[i]) return childrenIds[i] < other.childrenIds[i];
-    }
-    return false;
+bool ExpressionInterner::same(const Expression* a, const Expression* b) {
+    return a->type == b->type && a->value == b->value &&
+           a->charRange.start == b->charRange.start && a->charRange.end == b->charRange.end &&
+           a->charBitmap == b->charBitmap && a->children == b->children;
 }
 
-ExpressionInterner::ExpressionInterner() {}
+ExpressionInterner::ExpressionInterner()
+    : slots(INITIAL_SLOTS, static_cast<Expression*>(0)), hashes(INITIAL_SLOTS, 0) {}
+
+// Doubles the table, keeping it at most half full
+void ExpressionInterner::grow() {
+    std::vector<Expression*> oldSlots(slots.size() * 2, static_cast<Expression*>(0));
+    std::vector<size_t> oldHashes(hashes.size() * 2, 0);
+    oldSlots.swap(slots);
+    oldHashes.swap(hashes);
+    size_t mask = slots.size() - 1;
+    for (size_t i = 0; i < oldSlots.size(); ++i) {
+        if (!oldSlots[i]) continue;
+        size_t at = oldHashes[i] & mask;
+        while (slots[at]) at = (at + 1) & mask;
+        slots[at] = oldSlots[i];
+        hashes[at] = oldHashes[i];
+    }
+}
 
 Expression* ExpressionInterner::intern(Expression* expr, bool allocatedWithArena) {
-    ExpressionKey key(expr);
-    std::map<ExpressionKey, Expression*>::iterator it = table.find(key);
-    if (it != table.end()) {
-        if (!allocatedWithArena) delete expr;
-        return it->second;
+    size_t h = hash(expr);
+    size_t mask = slots.size() - 1;
+    size_t at = h & mask;
+    for (; slots[at]; at = (at + 1) & mask) {
+        if (hashes[at] != h || !same(slots[at], expr)) continue;
+        if (!allocatedWithArena) {
+            // Children are already interned and now shared with the canonical node
+            expr->children.clear();
+            delete expr;
+        }
+        return slots[at];
     }
-    table.insert(std::make_pair(key, expr));
+    slots[at] = expr;
+    hashes[at] = h;
+    order.push_back(expr);
+    if (order.size() * 2 > slots.size()) grow();
     return expr;
 }
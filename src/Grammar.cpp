@@ -1,19 +1,25 @@
 #include "../include/Grammar.hpp"
 #include "../include/Debug.hpp"
 #include <iostream>
-#include <sstream>
+#include <cstdlib>
+#ifndef BNF_NO_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 // ---------------- Rule ----------------
 // Constructor and destructor for Rule.
 // Rule owns the root expression node for the grammar rule.
 // The destructor frees the root expression to avoid leaks.
-Rule::Rule() : rootExpr(0) {}
+Rule::Rule() : rootExpr(0), transparent(false), token(false) {}
 Rule::~Rule() { delete rootExpr; }
 
 // ---------------- Grammar ----------------
 // Grammar lifecycle: initialize debug flag and clean up allocated rules.
-Grammar::Grammar() : arena(0), interner(0) {}
+Grammar::Grammar() : arena(0), interner(0), revision(0) {}
 Grammar::~Grammar() {
+    for (size_t i = 0; i < loadArenas.size(); ++i)
+        delete loadArenas[i];
     // When using arena, memory is owned by the arena; skip deletes entirely.
     if (arena) return;
     // When using interner without arena, avoid double-freeing shared nodes.
@@ -51,16 +57,21 @@ Expression* Grammar::internIfEnabled(Expression* expr) {
     return interner->intern(expr, arena != 0);
 }
 
-// addRule: parse a textual rule of the form "LHS ::= RHS".
-// Trims the LHS, tokenizes the RHS and constructs the expression tree
-// which becomes the rule's root expression.
 void Grammar::addRule(const std::string& ruleText) {
     DEBUG_MSG("Adding rule: " + ruleText);
+    Rule* r = parseRule(ruleText);
+    if (r) appendRule(r);
+}
 
+// parseRule: parse a textual rule of the form "LHS ::= RHS".
+// Trims the LHS, tokenizes the RHS and constructs the expression tree
+// which becomes the rule's root expression. A leading '~' on the LHS
+// marks the rule as transparent, a leading '@' as a lexical token.
+Rule* Grammar::parseRule(const std::string& ruleText) {
     size_t pos = ruleText.find("::=");
     if (pos == std::string::npos) {
         std::cerr << "Invalid rule: " << ruleText << std::endl;
-        return;
+        return 0;
     }
 
     std::string lhs = ruleText.substr(0, pos);
@@ -70,31 +81,237 @@ void Grammar::addRule(const std::string& ruleText) {
     while (!lhs.empty() && lhs[0] == ' ') lhs.erase(0,1);
     while (!lhs.empty() && lhs[lhs.size()-1] == ' ') lhs.erase(lhs.size()-1,1);
 
+    bool transparent = false;
+    bool token = false;
+    while (!lhs.empty() && (lhs[0] == '~' || lhs[0] == '@')) {
+        if (lhs[0] == '~') transparent = true;
+        else token = true;
+        lhs.erase(0, 1);
+        while (!lhs.empty() && lhs[0] == ' ') lhs.erase(0,1);
+    }
+
     Rule* r = createRule();
     r->name = lhs;
+    r->transparent = transparent;
+    r->token = token;
 
     BNFTokenizer tz(rhs);
     r->rootExpr = parseExpression(tz);
 
     DEBUG_MSG("Parsed rootExpr for rule: " + lhs);
+    return r;
+}
+
+void Grammar::appendRule(Rule* r) {
     rules.push_back(r);
+    ruleIndex.insert(std::make_pair(r->name, r));
+    ++revision;
 }
 
 
-// getRule: perform a linear search through stored rules and return
-// a pointer to the rule matching the provided name, or nullptr if not found.
-Rule* Grammar::getRule(const std::string& name) const {
-    DEBUG_MSG("Searching for rule: " + name);
-    for (size_t i = 0; i < rules.size(); ++i) {
-        DEBUG_MSG("Checking rule: " + rules[i]->name);
-        if (rules[i]->name == name) {
-            DEBUG_MSG("Rule found: " + name);
-            return rules[i];
-        }
+// ---------------- Bulk loading ----------------
+
+// Below this many texts per thread, starting a thread costs more than it saves
+static const size_t MIN_TEXTS_PER_THREAD = 256;
+
+// Arena block size of each loading thread
+static const size_t LOAD_ARENA_BLOCK = 64 * 1024;
+
+// A slice of the texts, the grammar that parses it (allocating like this
+// one, and interning into the slice's own interner if this one interns) and
+// the rules parsed
+struct Grammar::LoadSlice {
+    const std::vector<std::string>* texts;
+    size_t begin;
+    size_t end;
+    Grammar* context;
+    ExpressionInterner interned;
+    std::vector<Rule*> parsed;
+};
+
+void* Grammar::loadSlice(void* arg) {
+    LoadSlice* slice = static_cast<LoadSlice*>(arg);
+    slice->parsed.reserve(slice->end - slice->begin);
+    for (size_t i = slice->begin; i < slice->end; ++i) {
+        Rule* r = slice->context->parseRule((*slice->texts)[i]);
+        if (r) slice->parsed.push_back(r);
     }
     return 0;
 }
 
+static unsigned int onlineProcessors() {
+#ifndef BNF_NO_THREADS
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) return static_cast<unsigned int>(n);
+#endif
+    return 1;
+}
+
+// addRules: slices are parsed by grammars of their own, so threads share
+// nothing but the input. Slice 0 runs on the calling thread, as does any
+// slice whose thread cannot be started. The parsed rules are then this
+// grammar's to free (or its load arenas').
+void Grammar::addRules(const std::vector<std::string>& ruleTexts, unsigned int threads) {
+    if (ruleTexts.empty()) return;
+    size_t count = threads;
+    if (count == 0) {
+        count = onlineProcessors();
+        size_t worthwhile = ruleTexts.size() / MIN_TEXTS_PER_THREAD;
+        if (count > worthwhile) count = worthwhile;
+    }
+    if (count > ruleTexts.size()) count = ruleTexts.size();
+    if (count == 0) count = 1;
+#ifdef BNF_NO_THREADS
+    count = 1;
+#endif
+
+    std::vector<LoadSlice> slices(count);
+    for (size_t i = 0; i < count; ++i) {
+        slices[i].texts = &ruleTexts;
+        slices[i].begin = ruleTexts.size() * i / count;
+        slices[i].end = ruleTexts.size() * (i + 1) / count;
+        slices[i].context = new Grammar();
+        if (arena) {
+            loadArenas.push_back(new Arena(LOAD_ARENA_BLOCK));
+            slices[i].context->setArena(loadArenas.back());
+        }
+        if (interner)
+            slices[i].context->setInterner(&slices[i].interned);
+    }
+
+#ifndef BNF_NO_THREADS
+    std::vector<pthread_t> workers(count);
+    std::vector<bool> started(count, false);
+    for (size_t i = 1; i < count; ++i)
+        started[i] = pthread_create(&workers[i], 0, loadSlice, &slices[i]) == 0;
+    loadSlice(&slices[0]);
+    for (size_t i = 1; i < count; ++i) {
+        if (started[i]) pthread_join(workers[i], 0);
+        else loadSlice(&slices[i]);
+    }
+#else
+    loadSlice(&slices[0]);
+#endif
+
+    DEBUG_MSG("addRules: parsed " << ruleTexts.size() << " texts on " << count << " threads");
+    for (size_t i = 0; i < count; ++i) {
+        linkSlice(slices[i]);
+        delete slices[i].context;
+    }
+}
+
+static Expression* forwarded(const std::map<Expression*, Expression*>& forward, Expression* expr) {
+    std::map<Expression*, Expression*>::const_iterator it = forward.find(expr);
+    return it == forward.end() ? expr : it->second;
+}
+
+// linkSlice: a slice's expressions are already deduplicated among
+// themselves. Interning them into this grammar's interner, children first,
+// keeps the first of each structure in text order, as addRule() would;
+// the ones an earlier slice already had are forwarded to it and freed.
+void Grammar::linkSlice(LoadSlice& slice) {
+    std::map<Expression*, Expression*> forward;
+    if (interner) {
+        const std::vector<Expression*>& kept = slice.interned.expressions();
+        for (size_t i = 0; i < kept.size(); ++i) {
+            Expression* expr = kept[i];
+            for (size_t c = 0; c < expr->children.size(); ++c)
+                expr->children[c] = forwarded(forward, expr->children[c]);
+            // Not freed by the interner: other slice nodes may still refer to it
+            Expression* canonical = interner->intern(expr, true);
+            if (canonical != expr) forward[expr] = canonical;
+        }
+    }
+    for (size_t i = 0; i < slice.parsed.size(); ++i) {
+        Rule* r = slice.parsed[i];
+        r->rootExpr = forwarded(forward, r->rootExpr);
+        appendRule(r);
+    }
+    if (arena) return;
+    for (std::map<Expression*, Expression*>::iterator it = forward.begin(); it != forward.end(); ++it) {
+        it->first->children.clear();
+        delete it->first;
+    }
+}
+
+// ---------------- Pruning ----------------
+
+// reachableRules: walk rules and expressions with explicit stacks, since
+// rule chains in generated grammars can be far deeper than the call stack
+void Grammar::reachableRules(const std::vector<std::string>& startRules, std::set<const Rule*>& reached) const {
+    std::vector<const Rule*> pending;
+    for (size_t i = 0; i < startRules.size(); ++i)
+        pending.push_back(getRule(startRules[i]));
+    std::set<const Expression*> seen;
+    std::vector<const Expression*> exprs;
+    while (!pending.empty()) {
+        const Rule* rule = pending.back();
+        pending.pop_back();
+        if (!rule || !reached.insert(rule).second) continue;
+        exprs.push_back(rule->rootExpr);
+        while (!exprs.empty()) {
+            const Expression* expr = exprs.back();
+            exprs.pop_back();
+            if (!expr || !seen.insert(expr).second) continue;
+            if (expr->type == Expression::EXPR_SYMBOL)
+                pending.push_back(getRule(expr->value));
+            exprs.insert(exprs.end(), expr->children.begin(), expr->children.end());
+        }
+    }
+}
+
+// addReachableRules: only the first rule with each name can be reached,
+// so the copies never contain a rule the source would not use
+void Grammar::addReachableRules(const Grammar& source, const std::vector<std::string>& startRules) {
+    std::vector<std::string> starts(startRules);
+    if (!source.skipRule.empty())
+        starts.push_back(source.skipRule);
+    std::set<const Rule*> reached;
+    source.reachableRules(starts, reached);
+
+    for (size_t i = 0; i < source.rules.size(); ++i) {
+        const Rule* from = source.rules[i];
+        if (!reached.count(from)) continue;
+        Rule* r = createRule();
+        r->name = from->name;
+        r->transparent = from->transparent;
+        r->token = from->token;
+        r->rootExpr = copyExpr(from->rootExpr);
+        appendRule(r);
+    }
+    DEBUG_MSG("addReachableRules: copied " << reached.size() << " of " << source.rules.size() << " rules");
+    if (!source.skipRule.empty())
+        setSkipRule(source.skipRule);
+}
+
+// copyExpr: children are copied (and interned) before their parent, as
+// when parsing
+Expression* Grammar::copyExpr(const Expression* expr) {
+    if (!expr) return 0;
+    Expression* e = createExpr(expr->type);
+    e->value = expr->value;
+    e->charRange = expr->charRange;
+    e->charBitmap = expr->charBitmap;
+    e->children.reserve(expr->children.size());
+    for (size_t i = 0; i < expr->children.size(); ++i)
+        e->children.push_back(copyExpr(expr->children[i]));
+    return internIfEnabled(e);
+}
+
+// setSkipRule: the rule is resolved when the grammar is compiled, so it
+// may be added before or after this call.
+void Grammar::setSkipRule(const std::string& name) {
+    skipRule = name;
+    ++revision;
+}
+
+// getRule: look the name up in the index; with several rules of the same
+// name, the first one added is found.
+Rule* Grammar::getRule(const std::string& name) const {
+    std::map<std::string, Rule*>::const_iterator it = ruleIndex.find(name);
+    return it == ruleIndex.end() ? 0 : it->second;
+}
+
 
 // ---------------- Parsing functions ----------------
 
@@ -121,9 +338,7 @@ Expression* Grammar::parseExpression(BNFTokenizer& tz) {
         return single;
     }
 
-    std::stringstream ss;
-    ss << "parseExpression: type=EXPR_ALTERNATIVE, children=" << alt->children.size();
-    DEBUG_MSG(ss.str());
+    DEBUG_MSG("parseExpression: type=EXPR_ALTERNATIVE, children=" << alt->children.size());
 
     return internIfEnabled(alt);
 }
@@ -154,18 +369,33 @@ Expression* Grammar::parseSequence(BNFTokenizer& tz) {
     Expression* seq = createExpr(Expression::EXPR_SEQUENCE);
     seq->children = children;
 
-    std::stringstream ss;
-    ss << "parseSequence: type=EXPR_SEQUENCE, children=" << seq->children.size();
-    DEBUG_MSG(ss.str());
+    DEBUG_MSG("parseSequence: type=EXPR_SEQUENCE, children=" << seq->children.size());
 
     return internIfEnabled(seq);
 }
 
-// parseTerm: handle repetition '{ ... }' and optional '[ ... ]' constructs.
-// For other tokens, delegate to parseFactor.
+// parseTerm: handle repetition '{ ... }' and optional '[ ... ]' constructs
+// and the predicate prefixes '&' and '!'. For other tokens, delegate to
+// parseFactor.
 Expression* Grammar::parseTerm(BNFTokenizer& tz) {
     Token t = tz.peek();
 
+    if (t.type == Token::TOK_AMPERSAND || t.type == Token::TOK_BANG) {
+        tz.next();
+        Expression* inside = parseTerm(tz);
+        if (!inside)
+            std::cerr << "Missing expression after '" << t.value << "'" << std::endl;
+
+        Expression* pred = createExpr(t.type == Token::TOK_AMPERSAND
+                                      ? Expression::EXPR_AND_PREDICATE
+                                      : Expression::EXPR_NOT_PREDICATE);
+        pred->children.push_back(inside);
+
+        DEBUG_MSG("parseTerm: " << (t.type == Token::TOK_AMPERSAND ? "EXPR_AND_PREDICATE" : "EXPR_NOT_PREDICATE"));
+
+        return internIfEnabled(pred);
+    }
+
     if (t.type == Token::TOK_LBRACE) {
         tz.next();
         Expression* inside = parseExpression(tz);
@@ -175,9 +405,7 @@ Expression* Grammar::parseTerm(BNFTokenizer& tz) {
         Expression* rep = createExpr(Expression::EXPR_REPEAT);
         rep->children.push_back(inside);
 
-        std::stringstream ss;
-        ss << "parseTerm: EXPR_REPEAT, children=" << rep->children.size();
-        DEBUG_MSG(ss.str());
+        DEBUG_MSG("parseTerm: EXPR_REPEAT, children=" << rep->children.size());
 
         return internIfEnabled(rep);
     }
@@ -191,9 +419,7 @@ Expression* Grammar::parseTerm(BNFTokenizer& tz) {
         Expression* opt = createExpr(Expression::EXPR_OPTIONAL);
         opt->children.push_back(inside);
 
-        std::stringstream ss;
-        ss << "parseTerm: EXPR_OPTIONAL, children=" << opt->children.size();
-        DEBUG_MSG(ss.str());
+        DEBUG_MSG("parseTerm: EXPR_OPTIONAL, children=" << opt->children.size());
 
         return internIfEnabled(opt);
     }
@@ -230,9 +456,7 @@ Expression* Grammar::parseFactor(BNFTokenizer& tz) {
             Expression* e = createExpr(Expression::EXPR_CHAR_RANGE);
             e->charRange = CharRange(start, end);
             
-            std::stringstream ss;
-            ss << "parseFactor: EXPR_CHAR_RANGE, start=" << (int)start << ", end=" << (int)end;
-            DEBUG_MSG(ss.str());
+            DEBUG_MSG("parseFactor: EXPR_CHAR_RANGE, start=" << (int)start << ", end=" << (int)end);
             
                 return internIfEnabled(e);
         }
@@ -241,9 +465,7 @@ Expression* Grammar::parseFactor(BNFTokenizer& tz) {
         Expression* e = createExpr(Expression::EXPR_TERMINAL);
         e->value = t.value;
 
-        std::stringstream ss;
-        ss << "parseFactor: EXPR_TERMINAL, value=" << t.value;
-        DEBUG_MSG(ss.str());
+        DEBUG_MSG("parseFactor: EXPR_TERMINAL, value=" << t.value);
 
             return internIfEnabled(e);
     }
@@ -252,9 +474,7 @@ Expression* Grammar::parseFactor(BNFTokenizer& tz) {
         Expression* e = createExpr(Expression::EXPR_SYMBOL);
         e->value = t.value;
 
-        std::stringstream ss;
-        ss << "parseFactor: EXPR_SYMBOL, value=" << t.value;
-        DEBUG_MSG(ss.str());
+        DEBUG_MSG("parseFactor: EXPR_SYMBOL, value=" << t.value);
 
             return internIfEnabled(e);
     }
@@ -263,9 +483,7 @@ Expression* Grammar::parseFactor(BNFTokenizer& tz) {
         Expression* e = createExpr(Expression::EXPR_TERMINAL);
         e->value = t.value;
 
-        std::stringstream ss;
-        ss << "parseFactor: EXPR_TERMINAL, value=" << t.value;
-        DEBUG_MSG(ss.str());
+        DEBUG_MSG("parseFactor: EXPR_TERMINAL, value=" << t.value);
 
             return internIfEnabled(e);
     }
@@ -363,13 +581,8 @@ unsigned char Grammar::tokenToChar(const Token& t) const {
     }
     
     if (t.type == Token::TOK_HEX) {
-        // Parse hexadecimal value (format: 0xNN)
-        std::string hexStr = t.value.substr(2); // skip "0x"
-        unsigned int val = 0;
-        std::stringstream ss;
-        ss << std::hex << hexStr;
-        ss >> val;
-        return static_cast<unsigned char>(val);
+        // Parse hexadecimal value (format: 0xNN), skipping "0x"
+        return static_cast<unsigned char>(std::strtoul(t.value.c_str() + 2, 0, 16));
     }
     
     return 0;
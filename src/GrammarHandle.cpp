@@ -0,0 +1,171 @@
+#include "../include/GrammarHandle.hpp"
+#include "../include/Debug.hpp"
+
+// Spin lock on a flag; waits on reads so the cache line is not written
+static void spinLock(volatile int& flag) {
+    while (__sync_lock_test_and_set(&flag, 1)) {
+        while (__sync_fetch_and_add(&flag, 0)) { }
+    }
+}
+
+// Version implementation
+GrammarHandle::Version::Version(Grammar* g, const BranchProfile* profile, unsigned long n)
+    : grammar(g), compiled(new CompiledGrammar(*g, profile)), number(n), refs(0), lazy(false) {
+    pthread_mutex_init(&extending, 0);
+}
+
+GrammarHandle::Version::Version(Grammar* g, const std::vector<std::string>& hotRules, unsigned long n)
+    : grammar(g), compiled(new CompiledGrammar(*g, hotRules)), number(n), refs(0), lazy(true) {
+    pthread_mutex_init(&extending, 0);
+}
+
+GrammarHandle::Version::~Version() {
+    pthread_mutex_destroy(&extending);
+    delete compiled;
+    for (size_t i = 0; i < superseded.size(); ++i)
+        delete superseded[i];
+    delete grammar;
+}
+
+const CompiledGrammar* GrammarHandle::Version::current() const {
+    return __sync_val_compare_and_swap(const_cast<CompiledGrammar**>(&compiled),
+                                       static_cast<CompiledGrammar*>(0), static_cast<CompiledGrammar*>(0));
+}
+
+// Adds a start rule to a copy of the current compilation and publishes the
+// copy. Readers may be using the current one, so it cannot be extended in
+// place; it is kept until the version is deleted. Compiling can take a
+// while, so threads that miss meanwhile sleep on the mutex, then find the
+// rule compiled or add theirs.
+const CompiledGrammar* GrammarHandle::Version::extend(const std::string& rule) {
+    pthread_mutex_lock(&extending);
+    const CompiledGrammar* result = current();
+    if (result->findRule(rule) == CompiledGrammar::NO_RULE) {
+        CompiledGrammar* next = new CompiledGrammar(*result);
+        next->addStartRule(*grammar, rule);
+        // A full barrier, so readers see the new compilation complete. Only
+        // extend() writes the pointer, so the swap cannot fail.
+        CompiledGrammar* old = const_cast<CompiledGrammar*>(result);
+        (void)__sync_val_compare_and_swap(const_cast<CompiledGrammar**>(&compiled), old, next);
+        superseded.push_back(old);
+        result = next;
+        DEBUG_MSG("GrammarHandle: version " << number << " extended for " << rule << ", "
+                  << next->ruleCount() << " rules");
+    }
+    pthread_mutex_unlock(&extending);
+    return result;
+}
+
+// Snapshot implementation
+//
+// `entering` covers the window between reading `current` and incrementing
+// the version's count. A writer that sees it at zero knows every reader
+// that could have read an old pointer has already pinned it.
+GrammarHandle::Snapshot::Snapshot(const GrammarHandle& handle) : version(0) {
+    __sync_fetch_and_add(&handle.entering, 1);
+    version = __sync_val_compare_and_swap(const_cast<Version**>(&handle.current),
+                                          static_cast<Version*>(0), static_cast<Version*>(0));
+    if (version) __sync_fetch_and_add(&version->refs, 1);
+    __sync_fetch_and_sub(&handle.entering, 1);
+}
+
+GrammarHandle::Snapshot::Snapshot(const Snapshot& other) : version(other.version) {
+    if (version) __sync_fetch_and_add(&version->refs, 1);
+}
+
+GrammarHandle::Snapshot& GrammarHandle::Snapshot::operator=(const Snapshot& other) {
+    if (other.version) __sync_fetch_and_add(&other.version->refs, 1);
+    if (version) __sync_fetch_and_sub(&version->refs, 1);
+    version = other.version;
+    return *this;
+}
+
+const CompiledGrammar& GrammarHandle::Snapshot::compiledFor(const std::string& rule) const {
+    const CompiledGrammar* cg = version->current();
+    if (!version->lazy || cg->findRule(rule) != CompiledGrammar::NO_RULE || !version->grammar->getRule(rule))
+        return *cg;
+    return *version->extend(rule);
+}
+
+// Releasing never deletes: the version may still be current, and retired
+// versions are only deleted by writers.
+GrammarHandle::Snapshot::~Snapshot() {
+    if (version) __sync_fetch_and_sub(&version->refs, 1);
+}
+
+// GrammarHandle implementation
+GrammarHandle::GrammarHandle() : current(0), entering(0), writer(0), published(0) {}
+
+GrammarHandle::~GrammarHandle() {
+    delete current;
+    for (size_t i = 0; i < retired.size(); ++i)
+        delete retired[i];
+}
+
+void GrammarHandle::lock() const {
+    spinLock(writer);
+}
+
+void GrammarHandle::unlock() const {
+    __sync_lock_release(&writer);
+}
+
+unsigned long GrammarHandle::publish(Grammar* g, const BranchProfile* profile) {
+    // Compile outside the lock; readers keep using the current version
+    return install(new Version(g, profile, 0));
+}
+
+unsigned long GrammarHandle::publishLazy(Grammar* g, const std::vector<std::string>& hotRules) {
+    return install(new Version(g, hotRules, 0));
+}
+
+unsigned long GrammarHandle::install(Version* next) {
+    lock();
+    next->number = ++published;
+    Version* old = __sync_lock_test_and_set(const_cast<Version**>(&current), next);
+    __sync_synchronize();
+    if (old) retired.push_back(old);
+    size_t freed = reclaimLocked();
+    unlock();
+
+    DEBUG_MSG("GrammarHandle: published version " << next->number << ", reclaimed " << freed);
+    (void)freed;
+    return next->number;
+}
+
+size_t GrammarHandle::reclaim() {
+    lock();
+    size_t freed = reclaimLocked();
+    unlock();
+    return freed;
+}
+
+size_t GrammarHandle::reclaimLocked() {
+    // Check for readers in the pinning window first, then the counts
+    if (__sync_fetch_and_add(&entering, 0) != 0) return 0;
+
+    size_t freed = 0;
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); ++i) {
+        if (__sync_fetch_and_add(&retired[i]->refs, 0) == 0) {
+            delete retired[i];
+            ++freed;
+        } else {
+            retired[kept++] = retired[i];
+        }
+    }
+    retired.resize(kept);
+    return freed;
+}
+
+unsigned long GrammarHandle::currentNumber() const {
+    Snapshot s(*this);
+    return s.number();
+}
+
+size_t GrammarHandle::retiredCount() const {
+    lock();
+    size_t n = retired.size();
+    unlock();
+    return n;
+}
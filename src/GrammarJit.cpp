@@ -0,0 +1,598 @@
+#include "../include/GrammarJit.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include "../include/Debug.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(BNF_NO_JIT)
+#define BNF_JIT_X86_64 1
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+const size_t NO_CODE = static_cast<size_t>(-1);
+
+// Enters rule code: input base, input length, rule function. Returns the
+// match length, or NO_CODE if the rule did not match.
+typedef size_t (*EntryFunction)(const unsigned char*, size_t, const void*);
+
+typedef CompiledGrammar::Node Node;
+
+#ifdef BNF_JIT_X86_64
+
+// Condition codes of Jcc
+enum Condition { CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7 };
+
+// Byte buffer with labels and 32-bit relative fixups. Everything the code
+// refers to (rule functions, bitmaps, jump tables) is in the same buffer
+// and addressed relative to it, so it runs wherever it is copied.
+class Assembler {
+public:
+    std::vector<unsigned char> bytes;
+
+    unsigned int newLabel() {
+        labels.push_back(NO_CODE);
+        return static_cast<unsigned int>(labels.size() - 1);
+    }
+
+    void bind(unsigned int label) { labels[label] = bytes.size(); }
+    size_t position(unsigned int label) const { return labels[label]; }
+
+    void emit(unsigned char b) { bytes.push_back(b); }
+
+    void emit(const char* seq, size_t len) {
+        bytes.insert(bytes.end(), seq, seq + len);
+    }
+
+    void emit32(unsigned int v) {
+        for (int i = 0; i < 4; ++i) emit(static_cast<unsigned char>(v >> (8 * i)));
+    }
+
+    void emit64(unsigned long long v) {
+        for (int i = 0; i < 8; ++i) emit(static_cast<unsigned char>(v >> (8 * i)));
+    }
+
+    // A 32-bit field holding label - base; base defaults to the end of the field
+    void relative(unsigned int label, unsigned int baseLabel = NO_BASE) {
+        Fixup f;
+        f.at = bytes.size();
+        f.label = label;
+        f.base = baseLabel;
+        fixups.push_back(f);
+        emit32(0);
+    }
+
+    void jump(unsigned int label) { emit(0xE9); relative(label); }
+    void call(unsigned int label) { emit(0xE8); relative(label); }
+
+    void jumpIf(Condition cc, unsigned int label) {
+        emit(0x0F);
+        emit(static_cast<unsigned char>(0x80 + cc));
+        relative(label);
+    }
+
+    void align(size_t n) {
+        while (bytes.size() % n) emit(0xCC);
+    }
+
+    void resolve() {
+        for (size_t i = 0; i < fixups.size(); ++i) {
+            const Fixup& f = fixups[i];
+            size_t base = f.base == NO_BASE ? f.at + 4 : labels[f.base];
+            unsigned int v = static_cast<unsigned int>(labels[f.label] - base);
+            for (int k = 0; k < 4; ++k) bytes[f.at + k] = static_cast<unsigned char>(v >> (8 * k));
+        }
+    }
+
+private:
+    static const unsigned int NO_BASE = 0xFFFFFFFFu;
+
+    struct Fixup {
+        size_t at;
+        unsigned int label;
+        unsigned int base;
+    };
+
+    std::vector<size_t> labels;
+    std::vector<Fixup> fixups;
+};
+
+// Register use inside rule code:
+//   r12 = input base, r13 = input length, rbx = position
+//   rax, rcx, r11 = scratch
+// A rule function returns eax = 1 with rbx past the match, or eax = 0.
+// Node code falls through on success with rbx advanced, or jumps to its
+// fail label with rsp as it was on entry (rbx is then undefined; the
+// enclosing node restores it if it needs to).
+class Translator {
+public:
+    Translator(const CompiledGrammar& g, Assembler& a, const std::vector<unsigned int>& ruleLabels)
+        : cg(g), as(a), rules(ruleLabels), bitmapLabels(g.bitmapCount(), NO_LABEL) {}
+
+    void rule(unsigned int r) {
+        unsigned int fail = as.newLabel();
+        as.bind(rules[r]);
+        node(cg.rule(r).root, fail);
+        as.emit("\xB8\x01\x00\x00\x00", 5);   // mov eax, 1
+        as.emit(0xC3);                        // ret
+        as.bind(fail);
+        as.emit("\x31\xC0", 2);               // xor eax, eax
+        as.emit(0xC3);                        // ret
+    }
+
+    // Bitmaps, then jump tables
+    void data() {
+        as.align(16);
+        for (size_t i = 0; i < bitmapLabels.size(); ++i) {
+            if (bitmapLabels[i] == NO_LABEL) continue;
+            as.bind(bitmapLabels[i]);
+            const std::bitset<256>& bits = cg.bitmap(static_cast<unsigned int>(i));
+            for (size_t b = 0; b < 256; b += 8) {
+                unsigned char byte = 0;
+                for (size_t k = 0; k < 8; ++k)
+                    if (bits.test(b + k)) byte = static_cast<unsigned char>(byte | (1 << k));
+                as.emit(byte);
+            }
+        }
+        for (size_t t = 0; t < tables.size(); ++t) {
+            as.align(4);
+            as.bind(tables[t].label);
+            for (size_t b = 0; b < 256; ++b) as.relative(tables[t].targets[b], tables[t].label);
+        }
+    }
+
+private:
+    static const unsigned int NO_LABEL = 0xFFFFFFFFu;
+
+    struct JumpTable {
+        unsigned int label;
+        std::vector<unsigned int> targets;   // Label per byte
+    };
+
+    const CompiledGrammar& cg;
+    Assembler& as;
+    const std::vector<unsigned int>& rules;
+    std::vector<unsigned int> bitmapLabels;
+    std::vector<JumpTable> tables;
+
+    unsigned int bitmap(unsigned int index) {
+        if (bitmapLabels[index] == NO_LABEL) bitmapLabels[index] = as.newLabel();
+        return bitmapLabels[index];
+    }
+
+    // eax = next byte, or jump to fail at the end of input
+    void loadByte(unsigned int fail) {
+        as.emit("\x4C\x39\xEB", 3);           // cmp rbx, r13
+        as.jumpIf(CC_AE, fail);
+        as.emit("\x41\x0F\xB6\x04\x1C", 5);   // movzx eax, byte [r12 + rbx]
+    }
+
+    // Jump to fail unless the next byte is in the bitmap
+    void testByte(unsigned int bitmapIndex, unsigned int fail) {
+        const std::bitset<256>& bits = cg.bitmap(bitmapIndex);
+        if (bits.none()) {
+            as.jump(fail);
+            return;
+        }
+        loadByte(fail);
+        if (bits.count() == 256) return;
+        as.emit("\x4C\x8D\x1D", 3);           // lea r11, [rip + bitmap]
+        as.relative(bitmap(bitmapIndex));
+        as.emit("\x41\x0F\xA3\x03", 4);       // bt dword [r11], eax
+        as.jumpIf(CC_AE, fail);               // jnc
+    }
+
+    // Lookahead a non-nullable node needs before it is tried
+    void lookahead(const Node& n, unsigned int fail) {
+        if (!CompiledGrammar::nullable(n)) testByte(n.first, fail);
+    }
+
+    void node(unsigned int id, unsigned int fail) {
+        const Node& n = cg.node(id);
+        switch (n.kind) {
+            case CompiledGrammar::NODE_TERMINAL: terminal(n, fail); break;
+            case CompiledGrammar::NODE_CHAR_RANGE: charRange(n, fail); break;
+            case CompiledGrammar::NODE_CHAR_CLASS:
+                testByte(n.a, fail);
+                as.emit("\x48\xFF\xC3", 3);   // inc rbx
+                break;
+            case CompiledGrammar::NODE_SYMBOL:
+                as.call(rules[n.a]);
+                as.emit("\x85\xC0", 2);       // test eax, eax
+                as.jumpIf(CC_E, fail);
+                break;
+            case CompiledGrammar::NODE_SEQUENCE:
+                for (unsigned int i = 0; i < n.b; ++i) node(cg.child(n, i), fail);
+                break;
+            case CompiledGrammar::NODE_ALTERNATIVE:
+                if (predictive(n)) dispatch(n, fail);
+                else longest(n, fail);
+                break;
+            case CompiledGrammar::NODE_OPTIONAL: optional(n, fail); break;
+            case CompiledGrammar::NODE_REPEAT: repeat(n); break;
+            case CompiledGrammar::NODE_AND:
+            case CompiledGrammar::NODE_NOT: predicate(n, fail); break;
+            default:
+                as.jump(fail);
+                break;
+        }
+    }
+
+    void terminal(const Node& n, unsigned int fail) {
+        const char* lit = cg.literal(n);
+        size_t len = n.b;
+        if (len == 0) {
+            as.jump(fail);
+            return;
+        }
+        as.emit("\x48\x8D\x83", 3);           // lea rax, [rbx + len]
+        as.emit32(static_cast<unsigned int>(len));
+        as.emit("\x4C\x39\xE8", 3);           // cmp rax, r13
+        as.jumpIf(CC_A, fail);
+        size_t off = 0;
+        while (len - off >= 8) {
+            unsigned long long v = 0;
+            for (int k = 7; k >= 0; --k) v = (v << 8) | static_cast<unsigned char>(lit[off + k]);
+            as.emit("\x48\xB9", 2);           // mov rcx, imm64
+            as.emit64(v);
+            as.emit("\x49\x39\x8C\x1C", 4);   // cmp [r12 + rbx + off], rcx
+            as.emit32(static_cast<unsigned int>(off));
+            as.jumpIf(CC_NE, fail);
+            off += 8;
+        }
+        if (len - off >= 4) {
+            as.emit("\x41\x81\xBC\x1C", 4);   // cmp dword [r12 + rbx + off], imm32
+            as.emit32(static_cast<unsigned int>(off));
+            as.emit(lit + off, 4);
+            as.jumpIf(CC_NE, fail);
+            off += 4;
+        }
+        if (len - off >= 2) {
+            as.emit("\x66\x41\x81\xBC\x1C", 5);   // cmp word [r12 + rbx + off], imm16
+            as.emit32(static_cast<unsigned int>(off));
+            as.emit(lit + off, 2);
+            as.jumpIf(CC_NE, fail);
+            off += 2;
+        }
+        if (len - off == 1) {
+            as.emit("\x41\x80\xBC\x1C", 4);   // cmp byte [r12 + rbx + off], imm8
+            as.emit32(static_cast<unsigned int>(off));
+            as.emit(lit + off, 1);
+            as.jumpIf(CC_NE, fail);
+        }
+        as.emit("\x48\x89\xC3", 3);           // mov rbx, rax
+    }
+
+    void charRange(const Node& n, unsigned int fail) {
+        if (n.a > n.b) {
+            as.jump(fail);
+            return;
+        }
+        loadByte(fail);
+        as.emit(0x2D);                        // sub eax, lo
+        as.emit32(n.a);
+        as.emit(0x3D);                        // cmp eax, hi - lo
+        as.emit32(n.b - n.a);
+        as.jumpIf(CC_A, fail);
+        as.emit("\x48\xFF\xC3", 3);           // inc rbx
+    }
+
+    // At most one branch can start with any byte, and none with nothing:
+    // the next byte picks the only branch worth trying.
+    bool predictive(const Node& n) const {
+        if (n.b < 3) return false;
+        std::bitset<256> seen;
+        for (unsigned int i = 0; i < n.b; ++i) {
+            const Node& bn = cg.node(cg.child(n, i));
+            if (CompiledGrammar::nullable(bn) || (seen & cg.first(bn)).any()) return false;
+            seen |= cg.first(bn);
+        }
+        return true;
+    }
+
+    void dispatch(const Node& n, unsigned int fail) {
+        JumpTable table;
+        table.label = as.newLabel();
+        table.targets.assign(256, fail);
+        unsigned int done = as.newLabel();
+        std::vector<unsigned int> branches;
+        for (unsigned int i = 0; i < n.b; ++i) {
+            branches.push_back(as.newLabel());
+            const std::bitset<256>& first = cg.first(cg.node(cg.child(n, i)));
+            for (size_t b = 0; b < 256; ++b)
+                if (first.test(b)) table.targets[b] = branches[i];
+        }
+        tables.push_back(table);
+
+        loadByte(fail);
+        as.emit("\x4C\x8D\x1D", 3);           // lea r11, [rip + table]
+        as.relative(table.label);
+        as.emit("\x49\x63\x04\x83", 4);       // movsxd rax, dword [r11 + rax * 4]
+        as.emit("\x4C\x01\xD8", 3);           // add rax, r11
+        as.emit("\xFF\xE0", 2);               // jmp rax
+        for (unsigned int i = 0; i < n.b; ++i) {
+            as.bind(branches[i]);
+            node(cg.child(n, i), fail);
+            as.jump(done);
+        }
+        as.bind(done);
+    }
+
+    // Every branch the lookahead allows, from the same start; the longest
+    // match wins. Stack: [rsp] = best end + 1 (0: none), [rsp + 8] = start.
+    void longest(const Node& n, unsigned int fail) {
+        as.emit(0x53);                        // push rbx
+        as.emit("\x6A\x00", 2);               // push 0
+        for (unsigned int i = 0; i < n.b; ++i) {
+            unsigned int branch = cg.child(n, i);
+            const Node& bn = cg.node(branch);
+            if (!CompiledGrammar::nullable(bn) && cg.first(bn).none()) continue;
+            unsigned int next = as.newLabel();
+            as.emit("\x48\x8B\x5C\x24\x08", 5);   // mov rbx, [rsp + 8]
+            lookahead(bn, next);
+            node(branch, next);
+            as.emit("\x48\x8D\x43\x01", 4);   // lea rax, [rbx + 1]
+            as.emit("\x48\x3B\x04\x24", 4);   // cmp rax, [rsp]
+            as.jumpIf(CC_BE, next);
+            as.emit("\x48\x89\x04\x24", 4);   // mov [rsp], rax
+            as.bind(next);
+        }
+        as.emit("\x48\x8B\x04\x24", 4);       // mov rax, [rsp]
+        as.emit("\x48\x83\xC4\x10", 4);       // add rsp, 16
+        as.emit("\x48\x85\xC0", 3);           // test rax, rax
+        as.jumpIf(CC_E, fail);
+        as.emit("\x48\x8D\x58\xFF", 4);       // lea rbx, [rax - 1]
+    }
+
+    void optional(const Node& n, unsigned int fail) {
+        (void)fail;   // an optional always matches
+        unsigned int restore = as.newLabel();
+        unsigned int done = as.newLabel();
+        as.emit(0x53);                        // push rbx
+        lookahead(cg.node(n.a), restore);
+        node(n.a, restore);
+        as.emit("\x48\x83\xC4\x08", 4);       // add rsp, 8
+        as.jump(done);
+        as.bind(restore);
+        as.emit(0x5B);                        // pop rbx
+        as.bind(done);
+    }
+
+    // Greedy: stops at a lookahead outside FIRST(body), a failed or empty
+    // iteration, or the end of input
+    void repeat(const Node& n) {
+        unsigned int loop = as.newLabel();
+        unsigned int restore = as.newLabel();
+        unsigned int done = as.newLabel();
+        const Node& body = cg.node(n.a);
+        as.bind(loop);
+        testByte(body.first, done);
+        as.emit(0x53);                        // push rbx
+        node(n.a, restore);
+        as.emit("\x48\x3B\x1C\x24", 4);       // cmp rbx, [rsp]
+        as.jumpIf(CC_E, restore);
+        as.emit("\x48\x83\xC4\x08", 4);       // add rsp, 8
+        as.jump(loop);
+        as.bind(restore);
+        as.emit(0x5B);                        // pop rbx
+        as.bind(done);
+    }
+
+    void predicate(const Node& n, unsigned int fail) {
+        unsigned int missed = as.newLabel();
+        unsigned int done = as.newLabel();
+        bool positive = n.kind == CompiledGrammar::NODE_AND;
+        as.emit(0x53);                        // push rbx
+        node(n.a, missed);
+        as.emit(0x5B);                        // pop rbx
+        if (positive) as.jump(done);
+        else as.jump(fail);
+        as.bind(missed);
+        as.emit(0x5B);                        // pop rbx
+        if (positive) as.jump(fail);
+        as.bind(done);
+    }
+};
+
+const unsigned int Assembler::NO_BASE;
+const unsigned int Translator::NO_LABEL;
+
+// Saves the registers rule code uses, loads the input registers and calls
+// the rule function passed in rdx.
+void emitEntry(Assembler& as) {
+    as.emit(0x53);                            // push rbx
+    as.emit("\x41\x54", 2);                   // push r12
+    as.emit("\x41\x55", 2);                   // push r13
+    as.emit("\x49\x89\xFC", 3);               // mov r12, rdi
+    as.emit("\x49\x89\xF5", 3);               // mov r13, rsi
+    as.emit("\x31\xDB", 2);                   // xor ebx, ebx
+    as.emit("\xFF\xD2", 2);                   // call rdx
+    as.emit("\x48\xC7\xC1\xFF\xFF\xFF\xFF", 7);   // mov rcx, -1
+    as.emit("\x85\xC0", 2);                   // test eax, eax
+    as.emit("\x48\x0F\x45\xCB", 4);           // cmovnz rcx, rbx
+    as.emit("\x48\x89\xC8", 3);               // mov rax, rcx
+    as.emit("\x41\x5D", 2);                   // pop r13
+    as.emit("\x41\x5C", 2);                   // pop r12
+    as.emit(0x5B);                            // pop rbx
+    as.emit(0xC3);                            // ret
+}
+
+#endif
+
+// Whether a node can be translated on its own (rule references aside)
+bool translatable(const CompiledGrammar& cg, unsigned int id, std::string& reason) {
+    const Node& n = cg.node(id);
+    switch (n.kind) {
+        case CompiledGrammar::NODE_SYMBOL:
+            if (n.a == CompiledGrammar::NO_RULE) {
+                reason = "refers to unknown rule " + cg.name(n.b);
+                return false;
+            }
+            return true;
+        case CompiledGrammar::NODE_SEQUENCE:
+        case CompiledGrammar::NODE_ALTERNATIVE:
+            for (unsigned int i = 0; i < n.b; ++i)
+                if (!translatable(cg, cg.child(n, i), reason)) return false;
+            return true;
+        case CompiledGrammar::NODE_OPTIONAL:
+        case CompiledGrammar::NODE_REPEAT:
+        case CompiledGrammar::NODE_AND:
+        case CompiledGrammar::NODE_NOT:
+            return translatable(cg, n.a, reason);
+        default:
+            return true;
+    }
+}
+
+// Rules a node refers to
+void references(const CompiledGrammar& cg, unsigned int id, std::vector<unsigned int>& out) {
+    const Node& n = cg.node(id);
+    switch (n.kind) {
+        case CompiledGrammar::NODE_SYMBOL:
+            if (n.a != CompiledGrammar::NO_RULE) out.push_back(n.a);
+            break;
+        case CompiledGrammar::NODE_SEQUENCE:
+        case CompiledGrammar::NODE_ALTERNATIVE:
+            for (unsigned int i = 0; i < n.b; ++i) references(cg, cg.child(n, i), out);
+            break;
+        case CompiledGrammar::NODE_OPTIONAL:
+        case CompiledGrammar::NODE_REPEAT:
+        case CompiledGrammar::NODE_AND:
+        case CompiledGrammar::NODE_NOT:
+            references(cg, n.a, out);
+            break;
+        default:
+            break;
+    }
+}
+
+} // namespace
+
+GrammarJit::GrammarJit(const Grammar& g)
+    : parser(g), compiled(0), code(0), codeBytes(0), entryStub(0)
+{
+    build();
+}
+
+GrammarJit::GrammarJit(const GrammarHandle::Snapshot& snapshot)
+    : parser(snapshot), compiled(0), code(0), codeBytes(0), entryStub(0)
+{
+    build();
+}
+
+GrammarJit::~GrammarJit() {
+#ifdef BNF_JIT_X86_64
+    if (code) munmap(code, codeBytes);
+#endif
+}
+
+// Decides which rules are native, translates them, and maps the result
+// executable. Anything that goes wrong leaves every rule to the interpreter.
+void GrammarJit::build() {
+    const CompiledGrammar& cg = parser.compiledGrammar();
+    compiled = &cg;
+    size_t count = cg.ruleCount();
+    ruleOffsets.assign(count, NO_CODE);
+    reasons.assign(count, std::string());
+
+    std::vector<bool> ok(count, true);
+    for (unsigned int r = 0; r < count; ++r) {
+#ifndef BNF_JIT_X86_64
+        reasons[r] = "no JIT for this platform";
+        ok[r] = false;
+#else
+        if (cg.skipSet()) {
+            reasons[r] = "grammar skips bytes between tokens";
+            ok[r] = false;
+        } else if (!translatable(cg, cg.rule(r).root, reasons[r])) {
+            ok[r] = false;
+        }
+#endif
+    }
+
+    // A rule that uses an interpreted one is interpreted too
+    std::vector<std::vector<unsigned int> > uses(count);
+    for (unsigned int r = 0; r < count; ++r) references(cg, cg.rule(r).root, uses[r]);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned int r = 0; r < count; ++r) {
+            if (!ok[r]) continue;
+            for (size_t k = 0; k < uses[r].size(); ++k) {
+                if (ok[uses[r][k]]) continue;
+                ok[r] = false;
+                reasons[r] = "uses " + cg.name(cg.rule(uses[r][k]).name) + ", which is interpreted";
+                changed = true;
+                break;
+            }
+        }
+    }
+
+#ifdef BNF_JIT_X86_64
+    Assembler as;
+    std::vector<unsigned int> labels(count);
+    for (unsigned int r = 0; r < count; ++r) labels[r] = as.newLabel();
+    emitEntry(as);
+    Translator tr(cg, as, labels);
+    size_t nativeRules = 0;
+    for (unsigned int r = 0; r < count; ++r) {
+        if (!ok[r]) continue;
+        tr.rule(r);
+        ++nativeRules;
+    }
+    if (!nativeRules) return;
+    tr.data();
+    as.resolve();
+
+    void* mem = mmap(0, as.bytes.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        for (unsigned int r = 0; r < count; ++r)
+            if (ok[r]) reasons[r] = "could not map code memory";
+        return;
+    }
+    std::memcpy(mem, &as.bytes[0], as.bytes.size());
+    if (mprotect(mem, as.bytes.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, as.bytes.size());
+        for (unsigned int r = 0; r < count; ++r)
+            if (ok[r]) reasons[r] = "could not make code memory executable";
+        return;
+    }
+    code = static_cast<unsigned char*>(mem);
+    codeBytes = as.bytes.size();
+    entryStub = 0;
+    for (unsigned int r = 0; r < count; ++r)
+        if (ok[r]) ruleOffsets[r] = as.position(labels[r]);
+    DEBUG_MSG("GrammarJit: " << nativeRules << " of " << count << " rules native, "
+              << codeBytes << " bytes");
+#endif
+}
+
+bool GrammarJit::native(const std::string& rule) const {
+    unsigned int r = compiled->findRule(rule);
+    return r != CompiledGrammar::NO_RULE && ruleOffsets[r] != NO_CODE;
+}
+
+std::string GrammarJit::fallbackReason(const std::string& rule) const {
+    unsigned int r = compiled->findRule(rule);
+    return r == CompiledGrammar::NO_RULE ? std::string() : reasons[r];
+}
+
+bool GrammarJit::match(const std::string& rule, const std::string& input, size_t& consumed) const {
+    unsigned int r = compiled->findRule(rule);
+    if (r == CompiledGrammar::NO_RULE || ruleOffsets[r] == NO_CODE)
+        return parser.match(rule, input, consumed);
+
+    EntryFunction enter;
+    const unsigned char* stub = code + entryStub;
+    std::memcpy(&enter, &stub, sizeof(enter));
+    size_t len = enter(reinterpret_cast<const unsigned char*>(input.data()), input.size(),
+                       code + ruleOffsets[r]);
+    consumed = len == NO_CODE ? 0 : len;
+    return len != NO_CODE;
+}
+
+bool GrammarJit::matchFull(const std::string& rule, const std::string& input) const {
+    if (!native(rule)) return parser.matchFull(rule, input);
+    size_t consumed = 0;
+    return match(rule, input, consumed) && consumed == input.size();
+}
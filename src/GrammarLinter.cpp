@@ -0,0 +1,318 @@
+#include "../include/GrammarLinter.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include <iostream>
+#include <sstream>
+#include <bitset>
+
+namespace {
+
+typedef CompiledGrammar::Node Node;
+
+// A byte as it would be written in a grammar
+std::string showByte(size_t b) {
+    std::ostringstream out;
+    if (b >= 0x21 && b < 0x7F && b != '\'') out << '\'' << static_cast<char>(b) << '\'';
+    else {
+        const char* hex = "0123456789ABCDEF";
+        out << "0x" << hex[b >> 4] << hex[b & 15];
+    }
+    return out.str();
+}
+
+size_t firstByte(const std::bitset<256>& bits) {
+    for (size_t b = 0; b < 256; ++b)
+        if (bits.test(b)) return b;
+    return 256;
+}
+
+// Walks one compiled grammar; findings go to the linter's tables
+struct Checker {
+    const CompiledGrammar& cg;
+    std::vector<LintWarning>& found;
+    std::vector<GrammarLinter::Complexity>& own;
+
+    std::vector<std::vector<unsigned int> > calls;  // Rules each rule refers to
+    std::vector<unsigned int> component;            // Recursion cycle of each rule
+    std::vector<bool> cyclic;                       // Whether that cycle recurses
+    std::vector<bool> repeated;                     // Rule runs inside some repetition
+
+    Checker(const CompiledGrammar& g, std::vector<LintWarning>& f,
+            std::vector<GrammarLinter::Complexity>& o)
+        : cg(g), found(f), own(o) {}
+
+    void warn(LintWarning::Kind kind, unsigned int rule, const std::string& message,
+              GrammarLinter::Complexity cost) {
+        LintWarning w;
+        w.kind = kind;
+        w.rule = cg.name(cg.rule(rule).name);
+        w.message = message;
+        found.push_back(w);
+        if (cost > own[rule]) own[rule] = cost;
+    }
+
+    // Symbols under a node, without entering other rules
+    void collectCalls(unsigned int id, std::vector<unsigned int>& out, std::vector<bool>& seen) const {
+        if (seen[id]) return;
+        seen[id] = true;
+        const Node& n = cg.node(id);
+        switch (n.kind) {
+            case CompiledGrammar::NODE_SYMBOL:
+                if (n.a != CompiledGrammar::NO_RULE) out.push_back(n.a);
+                break;
+            case CompiledGrammar::NODE_SEQUENCE:
+            case CompiledGrammar::NODE_ALTERNATIVE:
+                for (unsigned int i = 0; i < cg.childCount(n); ++i)
+                    collectCalls(cg.child(n, i), out, seen);
+                break;
+            case CompiledGrammar::NODE_OPTIONAL:
+            case CompiledGrammar::NODE_REPEAT:
+            case CompiledGrammar::NODE_AND:
+            case CompiledGrammar::NODE_NOT:
+                collectCalls(n.a, out, seen);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Tarjan's strongly connected components over the rule call graph
+    std::vector<unsigned int> index, low, stack;
+    std::vector<bool> onStack;
+    unsigned int counter, components;
+
+    void connect(unsigned int r) {
+        index[r] = low[r] = ++counter;
+        stack.push_back(r);
+        onStack[r] = true;
+        for (size_t k = 0; k < calls[r].size(); ++k) {
+            unsigned int s = calls[r][k];
+            if (!index[s]) {
+                connect(s);
+                if (low[s] < low[r]) low[r] = low[s];
+            } else if (onStack[s] && index[s] < low[r]) {
+                low[r] = index[s];
+            }
+        }
+        if (low[r] != index[r]) return;
+        size_t size = 0;
+        unsigned int s;
+        do {
+            s = stack.back();
+            stack.pop_back();
+            onStack[s] = false;
+            component[s] = components;
+            ++size;
+        } while (s != r);
+        bool selfCall = false;
+        for (size_t k = 0; k < calls[r].size(); ++k)
+            if (calls[r][k] == r) selfCall = true;
+        cyclic.push_back(size > 1 || selfCall);
+        ++components;
+    }
+
+    void analyzeCalls() {
+        unsigned int count = static_cast<unsigned int>(cg.ruleCount());
+        calls.resize(count);
+        std::vector<bool> seen;
+        for (unsigned int r = 0; r < count; ++r) {
+            seen.assign(cg.nodeCount(), false);
+            collectCalls(cg.rule(r).root, calls[r], seen);
+        }
+        index.assign(count, 0);
+        low.assign(count, 0);
+        onStack.assign(count, false);
+        component.assign(count, 0);
+        counter = components = 0;
+        for (unsigned int r = 0; r < count; ++r)
+            if (!index[r]) connect(r);
+
+        // Rules used inside a repetition body, directly or through other rules
+        repeated.assign(count, false);
+        std::vector<unsigned int> work;
+        for (unsigned int id = 0; id < cg.nodeCount(); ++id) {
+            if (cg.node(id).kind != CompiledGrammar::NODE_REPEAT) continue;
+            std::vector<unsigned int> inner;
+            seen.assign(cg.nodeCount(), false);
+            collectCalls(cg.node(id).a, inner, seen);
+            work.insert(work.end(), inner.begin(), inner.end());
+        }
+        while (!work.empty()) {
+            unsigned int r = work.back();
+            work.pop_back();
+            if (repeated[r]) continue;
+            repeated[r] = true;
+            work.insert(work.end(), calls[r].begin(), calls[r].end());
+        }
+    }
+
+    // Whether a node refers to a rule of the given recursion cycle
+    bool reachesCycle(unsigned int id, unsigned int cycle) const {
+        std::vector<unsigned int> out;
+        std::vector<bool> seen(cg.nodeCount(), false);
+        collectCalls(id, out, seen);
+        for (size_t k = 0; k < out.size(); ++k)
+            if (component[out[k]] == cycle) return true;
+        return false;
+    }
+
+    void checkAlternative(unsigned int id, unsigned int rule, bool underRepeat) {
+        const Node& n = cg.node(id);
+        unsigned int count = cg.childCount(n);
+        unsigned int cycle = component[rule];
+        for (unsigned int i = 0; i < count; ++i) {
+            for (unsigned int j = i + 1; j < count; ++j) {
+                unsigned int a = cg.child(n, i), b = cg.child(n, j);
+                std::bitset<256> shared = cg.first(cg.node(a)) & cg.first(cg.node(b));
+                if (shared.none()) continue;
+                std::ostringstream where;
+                where << "branches " << (cg.branchRank(n, i) + 1) << " and " << (cg.branchRank(n, j) + 1)
+                      << " can both start with " << showByte(firstByte(shared));
+                if (cyclic[cycle] && reachesCycle(a, cycle) && reachesCycle(b, cycle)) {
+                    warn(LintWarning::RECURSIVE_BRANCHES, rule,
+                         where.str() + " and both recurse; the shared prefix is parsed again at every nesting level",
+                         GrammarLinter::EXPONENTIAL);
+                    return;  // One warning per alternative
+                }
+                if (underRepeat) {
+                    bool unbounded = cg.maxLength(a) == CompiledGrammar::UNBOUNDED
+                                  || cg.maxLength(b) == CompiledGrammar::UNBOUNDED;
+                    warn(LintWarning::OVERLAPPING_BRANCHES, rule,
+                         where.str() + " under a repetition; every iteration tries both"
+                         + (unbounded ? ", and one can scan to the end of input" : ""),
+                         unbounded ? GrammarLinter::QUADRATIC : GrammarLinter::LINEAR);
+                    return;
+                }
+            }
+        }
+    }
+
+    // Inner repetitions of an outer repetition's body whose body can start
+    // the text that follows them (`follow`) before the next outer iteration
+    void checkNested(unsigned int id, const std::bitset<256>& follow, unsigned int rule,
+                     std::vector<bool>& entered) {
+        const Node& n = cg.node(id);
+        switch (n.kind) {
+            case CompiledGrammar::NODE_SEQUENCE: {
+                std::bitset<256> after = follow;
+                for (unsigned int i = cg.childCount(n); i-- > 0; ) {
+                    unsigned int c = cg.child(n, i);
+                    checkNested(c, after, rule, entered);
+                    const Node& cn = cg.node(c);
+                    after = CompiledGrammar::nullable(cn) ? (cg.first(cn) | after) : cg.first(cn);
+                }
+                break;
+            }
+            case CompiledGrammar::NODE_ALTERNATIVE:
+                for (unsigned int i = 0; i < cg.childCount(n); ++i)
+                    checkNested(cg.child(n, i), follow, rule, entered);
+                break;
+            case CompiledGrammar::NODE_OPTIONAL:
+                checkNested(n.a, follow, rule, entered);
+                break;
+            case CompiledGrammar::NODE_SYMBOL:
+                if (n.a != CompiledGrammar::NO_RULE && !entered[n.a]) {
+                    entered[n.a] = true;
+                    checkNested(cg.rule(n.a).root, follow, rule, entered);
+                }
+                break;
+            case CompiledGrammar::NODE_REPEAT: {
+                std::bitset<256> shared = cg.first(cg.node(n.a)) & follow;
+                if (shared.any()) {
+                    warn(LintWarning::NESTED_REPETITION, rule,
+                         "nested repetition can match the text after it (" + showByte(firstByte(shared))
+                         + "); a backtracking matcher tries every split, and here the inner repetition"
+                           " takes it all greedily",
+                         GrammarLinter::LINEAR);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Walks a rule's own nodes (not the rules it refers to)
+    void walk(unsigned int id, unsigned int rule, bool underRepeat, std::vector<bool>& seen) {
+        if (seen[id]) return;
+        seen[id] = true;
+        const Node& n = cg.node(id);
+        switch (n.kind) {
+            case CompiledGrammar::NODE_ALTERNATIVE:
+                checkAlternative(id, rule, underRepeat);
+                // fall through
+            case CompiledGrammar::NODE_SEQUENCE:
+                for (unsigned int i = 0; i < cg.childCount(n); ++i)
+                    walk(cg.child(n, i), rule, underRepeat, seen);
+                break;
+            case CompiledGrammar::NODE_REPEAT: {
+                std::vector<bool> entered(cg.ruleCount(), false);
+                entered[rule] = true;
+                checkNested(n.a, cg.first(cg.node(n.a)), rule, entered);
+                walk(n.a, rule, true, seen);
+                break;
+            }
+            case CompiledGrammar::NODE_OPTIONAL:
+            case CompiledGrammar::NODE_AND:
+            case CompiledGrammar::NODE_NOT:
+                walk(n.a, rule, underRepeat, seen);
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+}
+
+GrammarLinter::GrammarLinter(const Grammar& g) {
+    CompiledGrammar cg(g);
+    unsigned int count = static_cast<unsigned int>(cg.ruleCount());
+    estimates.assign(count, LINEAR);
+    for (unsigned int r = 0; r < count; ++r)
+        ruleNames.push_back(cg.name(cg.rule(r).name));
+
+    Checker checker(cg, found, estimates);
+    checker.analyzeCalls();
+    std::vector<bool> seen;
+    for (unsigned int r = 0; r < count; ++r) {
+        seen.assign(cg.nodeCount(), false);
+        checker.walk(cg.rule(r).root, r, checker.repeated[r], seen);
+    }
+
+    // A rule is as slow as the slowest rule it uses
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned int r = 0; r < count; ++r) {
+            for (size_t k = 0; k < checker.calls[r].size(); ++k) {
+                Complexity callee = estimates[checker.calls[r][k]];
+                if (callee > estimates[r]) {
+                    estimates[r] = callee;
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+GrammarLinter::Complexity GrammarLinter::complexity(const std::string& rule) const {
+    for (size_t r = 0; r < ruleNames.size(); ++r)
+        if (ruleNames[r] == rule) return estimates[r];
+    return LINEAR;
+}
+
+const char* GrammarLinter::describe(Complexity c) {
+    switch (c) {
+        case QUADRATIC: return "O(n^2)";
+        case EXPONENTIAL: return "O(k^n)";
+        default: return "O(n)";
+    }
+}
+
+void GrammarLinter::print(std::ostream& out) const {
+    for (size_t i = 0; i < found.size(); ++i)
+        out << found[i].rule << ": " << found[i].message << "\n";
+    for (size_t r = 0; r < ruleNames.size(); ++r)
+        if (estimates[r] != LINEAR)
+            out << ruleNames[r] << ": worst case " << describe(estimates[r]) << "\n";
+}
@@ -0,0 +1,145 @@
+#include "../include/IncrementalParser.hpp"
+#include "../include/Debug.hpp"
+
+// TextEdit implementation
+TextEdit::TextEdit(size_t off, size_t del, const std::string& ins)
+    : offset(off), deletedLength(del), insertedText(ins) {}
+
+// IncrementalParser implementation
+IncrementalParser::IncrementalParser(const BNFParser& p, const std::string& ruleName)
+    : parser(p), rule(ruleName), root(0), previous(0), reused(0) {}
+
+IncrementalParser::~IncrementalParser() {
+    delete root;
+}
+
+// Full parse: drop every previous result and record extents from scratch
+const ASTNode* IncrementalParser::parse(const std::string& text, size_t& consumed) {
+    delete root;
+    root = 0;
+    extents.clear();
+    candidates.clear();
+    input = text;
+    reused = 0;
+    return run(consumed);
+}
+
+// Apply the edit, collect reusable subtrees of the old tree and parse again
+const ASTNode* IncrementalParser::reparse(const TextEdit& edit, size_t& consumed) {
+    TextEdit e(edit);
+    if (e.offset > input.size()) e.offset = input.size();
+    if (e.deletedLength > input.size() - e.offset)
+        e.deletedLength = input.size() - e.offset;
+
+    reused = 0;
+    candidates.clear();
+    if (root) collect(root, 0, 0, 0, e);
+
+    input.replace(e.offset, e.deletedLength, e.insertedText);
+    DEBUG_MSG("IncrementalParser::reparse: " << candidates.size()
+              << " reusable subtrees after edit at " << e.offset);
+
+    previous = root;
+    root = 0;
+    run(consumed);
+
+    // Whatever the new tree did not adopt is released together with its extents
+    discard(previous);
+    previous = 0;
+    candidates.clear();
+    return root;
+}
+
+const ASTNode* IncrementalParser::run(size_t& consumed) {
+    IncrementalParser* saved = parser.incremental;
+    parser.incremental = this;
+    root = parser.parse(rule, input, consumed);
+    parser.incremental = saved;
+    return root;
+}
+
+// Walk the old tree top-down. A symbol node whose inspected range does not
+// overlap the edit is registered at its new position and not descended into;
+// everything else is descended so smaller subtrees can still be reused.
+void IncrementalParser::collect(ASTNode* node, ASTNode* parent, size_t index,
+                                long shift, const TextEdit& edit) {
+    if (!node) return;
+
+    std::map<const ASTNode*, Extent>::iterator it = extents.find(node);
+    if (it != extents.end()) {
+        shift += it->second.shift;
+        size_t start = static_cast<size_t>(static_cast<long>(it->second.start) + shift);
+        size_t inspectedEnd = start + it->second.lookahead;
+
+        bool reusable = false;
+        size_t newStart = start;
+        if (inspectedEnd <= edit.offset) {
+            reusable = true;
+        } else if (start >= edit.offset + edit.deletedLength) {
+            reusable = true;
+            newStart = start - edit.deletedLength + edit.insertedText.size();
+        }
+
+        if (reusable) {
+            Candidate c;
+            c.node = node;
+            c.parent = parent;
+            c.index = index;
+            candidates.insert(std::make_pair(std::make_pair(node->symbol, newStart), c));
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < node->children.size(); ++i)
+        collect(node->children[i], node, i, shift, edit);
+}
+
+// Hand a reusable subtree to the parser, detaching it from the old tree
+ASTNode* IncrementalParser::adopt(const std::string& symbol, size_t pos,
+                                  size_t& end, size_t& lookahead) {
+    if (candidates.empty()) return 0;
+    CandidateMap::iterator it = candidates.find(std::make_pair(symbol, pos));
+    if (it == candidates.end()) return 0;
+
+    Candidate c = it->second;
+    candidates.erase(it);
+    if (c.parent) c.parent->children[c.index] = 0;
+    else previous = 0;
+
+    Extent& ext = extents[c.node];
+    ext.shift = static_cast<long>(pos) - static_cast<long>(ext.start);
+    end = pos + ext.length;
+    lookahead = ext.lookahead;
+    ++reused;
+    DEBUG_MSG("IncrementalParser::adopt: reusing " << symbol << " at " << pos);
+    return c.node;
+}
+
+// The matched text can start after skipped whitespace, so the consumed
+// length is kept separately
+void IncrementalParser::record(const ASTNode* node, size_t start, size_t end, size_t extent) {
+    Extent ext;
+    ext.start = start;
+    ext.length = end - start;
+    ext.lookahead = extent > start ? extent - start : 0;
+    ext.shift = 0;
+    extents[node] = ext;
+}
+
+// Called before the parser deletes a subtree (e.g. a losing alternative)
+void IncrementalParser::forget(const ASTNode* node) {
+    if (!node) return;
+    extents.erase(node);
+    for (size_t i = 0; i < node->children.size(); ++i)
+        forget(node->children[i]);
+}
+
+// Delete the parts of the old tree that were not adopted
+void IncrementalParser::discard(ASTNode* node) {
+    if (!node) return;
+    extents.erase(node);
+    for (size_t i = 0; i < node->children.size(); ++i)
+        discard(node->children[i]);
+    node->children.clear();
+    delete node;
+}
@@ -0,0 +1,47 @@
+#include "../include/LiteralFinder.hpp"
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+LiteralFinder::LiteralFinder(const std::string& literal) : needle(literal) {}
+
+size_t LiteralFinder::find(const char* data, size_t pos, size_t end) const {
+    size_t len = needle.size();
+    if (len == 0 || pos >= end || end - pos < len) return end;
+    const char* lit = needle.data();
+    size_t last = end - len;  // last offset an occurrence can start at
+
+    if (len == 1) {
+        const void* hit = std::memchr(data + pos, lit[0], end - pos);
+        return hit ? static_cast<size_t>(static_cast<const char*>(hit) - data) : end;
+    }
+
+#if defined(__SSE2__)
+    // Both loads of a block stay inside [pos, end): the second one starts
+    // len - 1 bytes later, and pos + 15 <= last.
+    __m128i first = _mm_set1_epi8(lit[0]);
+    __m128i final = _mm_set1_epi8(lit[len - 1]);
+    while (pos + 15 <= last) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + len - 1));
+        unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, final))));
+        while (mask) {
+            unsigned int bit = __builtin_ctz(mask);
+            if (std::memcmp(data + pos + bit + 1, lit + 1, len - 2) == 0) return pos + bit;
+            mask &= mask - 1;
+        }
+        pos += 16;
+    }
+#endif
+
+    while (pos <= last) {
+        const void* hit = std::memchr(data + pos, lit[0], last - pos + 1);
+        if (!hit) return end;
+        pos = static_cast<size_t>(static_cast<const char*>(hit) - data);
+        if (std::memcmp(data + pos + 1, lit + 1, len - 1) == 0) return pos;
+        ++pos;
+    }
+    return end;
+}
@@ -0,0 +1,57 @@
+#include "../include/ParseMemo.hpp"
+
+const unsigned int ParseMemo::CONTEXTS;
+
+// New entries are value-initialized, so their generation is 0 (dead)
+ParseMemo::ParseMemo() : slots(64), used(0), generation(1) {}
+
+void ParseMemo::clear() {
+    used = 0;
+    if (++generation == 0) {
+        // Wrapped around: stale entries could look live again
+        for (size_t i = 0; i < slots.size(); ++i)
+            slots[i].generation = 0;
+        generation = 1;
+    }
+}
+
+// Linear probing from a multiplicative hash; the table is a power of two
+// and at most half full, so probes stop at a dead entry.
+size_t ParseMemo::slot(unsigned int key, size_t pos) const {
+    size_t mask = slots.size() - 1;
+    size_t h = (static_cast<size_t>(key) * 0x9E3779B1u) ^ (pos * 0x85EBCA6Bu);
+    h ^= h >> 15;
+    size_t i = h & mask;
+    while (slots[i].generation == generation && (slots[i].key != key || slots[i].pos != pos))
+        i = (i + 1) & mask;
+    return i;
+}
+
+ParseMemo::Result ParseMemo::find(unsigned int rule, size_t pos, unsigned int context, size_t& end) const {
+    const Entry& e = slots[slot(rule * CONTEXTS + context, pos)];
+    if (e.generation != generation) return UNKNOWN;
+    end = e.end;
+    return e.matched ? MATCHED : FAILED;
+}
+
+void ParseMemo::store(unsigned int rule, size_t pos, unsigned int context, bool matched, size_t end) {
+    if ((used + 1) * 2 > slots.size()) grow();
+    unsigned int key = rule * CONTEXTS + context;
+    Entry& e = slots[slot(key, pos)];
+    if (e.generation != generation) ++used;
+    e.pos = pos;
+    e.end = end;
+    e.key = key;
+    e.generation = generation;
+    e.matched = matched;
+}
+
+void ParseMemo::grow() {
+    std::vector<Entry> old;
+    old.swap(slots);
+    slots.resize(old.size() * 2);
+    for (size_t i = 0; i < old.size(); ++i) {
+        if (old[i].generation != generation) continue;
+        slots[slot(old[i].key, old[i].pos)] = old[i];
+    }
+}
@@ -0,0 +1,23 @@
+#include "../include/SemanticActions.hpp"
+
+// SemanticValue implementation
+SemanticValue::SemanticValue() : integer(0), object(0) {}
+SemanticValue::SemanticValue(long i) : integer(i), object(0) {}
+
+// SemanticActions implementation
+void SemanticActions::on(const std::string& ruleName, SemanticAction action, void* userData) {
+    Entry e;
+    e.action = action;
+    e.userData = userData;
+    actions[ruleName] = e;
+}
+
+SemanticAction SemanticActions::find(const std::string& ruleName, void*& userData) const {
+    std::map<std::string, Entry>::const_iterator it = actions.find(ruleName);
+    if (it == actions.end()) {
+        userData = 0;
+        return 0;
+    }
+    userData = it->second.userData;
+    return it->second.action;
+}
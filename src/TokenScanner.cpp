@@ -0,0 +1,265 @@
+#include "../include/TokenScanner.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include "../include/Debug.hpp"
+
+const size_t TokenScanner::NO_MATCH = static_cast<size_t>(-1);
+const size_t TokenScanner::BATCH_LANES;
+
+// Transition entries are 16 bits wide
+static const size_t MAX_STATES = 0xFFFF;
+
+static void appendAll(std::vector<unsigned int>& to, const std::vector<unsigned int>& from) {
+    to.insert(to.end(), from.begin(), from.end());
+}
+
+TokenScanner::TokenScanner(const CompiledGrammar& cg, unsigned int rule) {
+    classes.push_back(std::bitset<256>());  // start state
+    follow.push_back(std::vector<unsigned int>());
+
+    Fragment f;
+    if (!build(cg, cg.rule(rule).root, f)) {
+        DEBUG_MSG("TokenScanner: " << cg.name(cg.rule(rule).name) << " uses the interpreter: " << reason);
+        classes.clear();
+        follow.clear();
+        return;
+    }
+    follow[0] = f.first;
+
+    accepting.assign(classes.size(), false);
+    accepting[0] = f.nullable;
+    for (size_t i = 0; i < f.last.size(); ++i)
+        accepting[f.last[i]] = true;
+
+    table.assign(classes.size() * 256, 0);
+    for (size_t s = 0; s < classes.size(); ++s) {
+        if (!fillRow(s, follow[s])) {
+            reason = "not deterministic";
+            DEBUG_MSG("TokenScanner: " << cg.name(cg.rule(rule).name) << " uses the interpreter: " << reason);
+            table.clear();
+            accepting.clear();
+            break;
+        }
+    }
+    classes.clear();
+    follow.clear();
+    ruleStack.clear();
+}
+
+unsigned int TokenScanner::addPosition(const std::bitset<256>& bits) {
+    classes.push_back(bits);
+    follow.push_back(std::vector<unsigned int>());
+    return static_cast<unsigned int>(classes.size() - 1);
+}
+
+void TokenScanner::link(const std::vector<unsigned int>& from, const std::vector<unsigned int>& to) {
+    for (size_t i = 0; i < from.size(); ++i)
+        appendAll(follow[from[i]], to);
+}
+
+// Fill a state's transition row; fails when two successors share a byte
+bool TokenScanner::fillRow(size_t state, const std::vector<unsigned int>& targets) {
+    unsigned short* row = &table[state * 256];
+    for (size_t t = 0; t < targets.size(); ++t) {
+        const std::bitset<256>& bits = classes[targets[t]];
+        for (size_t b = 0; b < 256; ++b) {
+            if (!bits.test(b)) continue;
+            unsigned short next = static_cast<unsigned short>(targets[t]);
+            if (row[b] && row[b] != next) return false;
+            row[b] = next;
+        }
+    }
+    return true;
+}
+
+// Glushkov construction over the compiled nodes: every byte-consuming leaf
+// occurrence becomes a state; first/last/follow are built bottom-up.
+bool TokenScanner::build(const CompiledGrammar& cg, unsigned int id, Fragment& out) {
+    const CompiledGrammar::Node& n = cg.node(id);
+    out.nullable = false;
+    out.first.clear();
+    out.last.clear();
+    if (classes.size() >= MAX_STATES) {
+        reason = "too many states";
+        return false;
+    }
+
+    switch (n.kind) {
+        case CompiledGrammar::NODE_TERMINAL: {
+            if (n.b == 0) {
+                reason = "empty literal";
+                return false;
+            }
+            const char* lit = cg.literal(n);
+            unsigned int prev = 0;
+            for (unsigned int i = 0; i < n.b; ++i) {
+                std::bitset<256> bits;
+                bits.set(static_cast<unsigned char>(lit[i]));
+                unsigned int p = addPosition(bits);
+                if (i == 0) out.first.push_back(p);
+                else follow[prev].push_back(p);
+                prev = p;
+            }
+            out.last.push_back(prev);
+            return true;
+        }
+        case CompiledGrammar::NODE_CHAR_RANGE:
+        case CompiledGrammar::NODE_CHAR_CLASS: {
+            std::bitset<256> bits;
+            if (n.kind == CompiledGrammar::NODE_CHAR_CLASS) {
+                bits = cg.bitmap(n.a);
+            } else {
+                for (unsigned int c = n.a; c <= n.b && c < 256; ++c)
+                    bits.set(c);
+            }
+            unsigned int p = addPosition(bits);
+            out.first.push_back(p);
+            out.last.push_back(p);
+            return true;
+        }
+        case CompiledGrammar::NODE_SYMBOL: {
+            if (n.a == CompiledGrammar::NO_RULE) {
+                reason = "unknown symbol " + cg.name(n.b);
+                return false;
+            }
+            for (size_t i = 0; i < ruleStack.size(); ++i) {
+                if (ruleStack[i] == n.a) {
+                    reason = "recursive rule " + cg.name(n.b);
+                    return false;
+                }
+            }
+            ruleStack.push_back(n.a);
+            bool ok = build(cg, cg.rule(n.a).root, out);
+            ruleStack.pop_back();
+            return ok;
+        }
+        case CompiledGrammar::NODE_SEQUENCE: {
+            out.nullable = true;
+            for (unsigned int i = 0; i < cg.childCount(n); ++i) {
+                Fragment c;
+                if (!build(cg, cg.child(n, i), c)) return false;
+                link(out.last, c.first);
+                if (out.nullable) appendAll(out.first, c.first);
+                if (!c.nullable) out.last.clear();
+                appendAll(out.last, c.last);
+                out.nullable = out.nullable && c.nullable;
+            }
+            return true;
+        }
+        case CompiledGrammar::NODE_ALTERNATIVE: {
+            if (cg.childCount(n) == 0) {
+                reason = "empty alternative";
+                return false;
+            }
+            for (unsigned int i = 0; i < cg.childCount(n); ++i) {
+                Fragment c;
+                if (!build(cg, cg.child(n, i), c)) return false;
+                appendAll(out.first, c.first);
+                appendAll(out.last, c.last);
+                out.nullable = out.nullable || c.nullable;
+            }
+            return true;
+        }
+        case CompiledGrammar::NODE_OPTIONAL:
+            if (!build(cg, n.a, out)) return false;
+            out.nullable = true;
+            return true;
+        case CompiledGrammar::NODE_REPEAT:
+            if (!build(cg, n.a, out)) return false;
+            link(out.last, out.first);
+            out.nullable = true;
+            return true;
+        default:
+            reason = "predicate or missing expression";
+            return false;
+    }
+}
+
+size_t TokenScanner::match(const std::string& input, size_t pos, size_t& inspected) const {
+    size_t best = accepting[0] ? 0 : NO_MATCH;
+    size_t state = 0;
+    size_t i = pos;
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(input.data());
+    for (; i < input.size(); ++i) {
+        unsigned short next = table[state * 256 + data[i]];
+        if (!next) break;
+        state = next;
+        if (accepting[state]) best = i + 1 - pos;
+    }
+    inspected = i < input.size() ? i + 1 : input.size() + 1;
+    return best;
+}
+
+// One input being stepped through the table by matchBatch
+struct BatchLane {
+    const unsigned char* data;
+    size_t size;
+    size_t pos;
+    size_t state;
+    size_t best;
+    size_t index;
+};
+
+void TokenScanner::matchBatch(const std::vector<std::string>& inputs, std::vector<size_t>& lengths) const {
+    lengths.assign(inputs.size(), NO_MATCH);
+    if (!deterministic()) return;
+
+    BatchLane lanes[BATCH_LANES];
+    size_t active = 0;
+    size_t next = 0;
+    size_t startBest = accepting[0] ? 0 : NO_MATCH;
+    const unsigned short* rows = &table[0];
+
+    for (;;) {
+        // Retire lanes at the end of their input or without a transition,
+        // and give the free lanes the next inputs
+        for (size_t k = 0; k < active || (k < BATCH_LANES && next < inputs.size()); ) {
+            BatchLane& l = lanes[k];
+            if (k < active) {
+                if (l.pos < l.size && rows[l.state * 256 + l.data[l.pos]]) {
+                    ++k;
+                    continue;
+                }
+                lengths[l.index] = l.best;
+            }
+            if (next < inputs.size()) {
+                const std::string& in = inputs[next];
+                l.data = reinterpret_cast<const unsigned char*>(in.data());
+                l.size = in.size();
+                l.pos = 0;
+                l.state = 0;
+                l.best = startBest;
+                l.index = next++;
+                if (k == active) ++active;
+            } else {
+                l = lanes[--active];
+            }
+        }
+        if (!active) break;
+
+        // Every lane can take this many steps without running off its input
+        size_t steps = lanes[0].size - lanes[0].pos;
+        for (size_t k = 1; k < active; ++k)
+            if (lanes[k].size - lanes[k].pos < steps) steps = lanes[k].size - lanes[k].pos;
+
+        // One step per lane per pass: the lanes' table loads do not depend
+        // on each other, so they overlap. A lane without a transition stays
+        // where it is until the next retire pass, which comes as soon as
+        // most lanes are stuck. Every pass then moves at least half the
+        // lanes, so the work follows the match lengths, not the input lengths.
+        for (size_t t = 0; t < steps; ++t) {
+            size_t stuck = 0;
+            for (size_t k = 0; k < active; ++k) {
+                BatchLane& l = lanes[k];
+                size_t s = rows[l.state * 256 + l.data[l.pos]];
+                if (!s) {
+                    ++stuck;
+                    continue;
+                }
+                l.state = s;
+                ++l.pos;
+                if (accepting[s]) l.best = l.pos;
+            }
+            if (stuck * 2 > active) break;
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/GrammarHandle.hpp"
+#include <cstdlib>
+
+static void buildStampGrammar(Grammar& g) {
+    g.addRule("<d> ::= ( '0' ... '9' )");
+    g.addRule("<date> ::= <d> <d> <d> <d> '-' <d> <d> '-' <d> <d>");
+    g.addRule("<time> ::= <d> <d> ':' <d> <d>");
+    g.addRule("<stamp> ::= <date> | <date> 'T' <time> | <time>");
+}
+
+static unsigned int stampNode(const BNFParser& p) {
+    const CompiledGrammar& cg = p.compiledGrammar();
+    return cg.rule(cg.findRule("<stamp>")).root;
+}
+
+static void parseTimes(const BNFParser& p, const std::string& input, int times) {
+    for (int i = 0; i < times; ++i) {
+        size_t consumed = 0;
+        delete p.parse("<stamp>", input, consumed);
+    }
+}
+
+void test_order_follows_recent_wins(TestRunner& runner) {
+    Grammar g;
+    buildStampGrammar(g);
+    BNFParser p(g);
+    unsigned int stamp = stampNode(p);
+    ASSERT_EQ(runner, p.branchTriedAt(stamp, 0), 0u);
+
+    p.adaptBranches(8);
+    parseTimes(p, "2024-05-06T07:08", 8);
+    ASSERT_EQ(runner, p.branchTriedAt(stamp, 0), 1u);
+
+    // The mix shifts; halving lets the new winner overtake
+    parseTimes(p, "07:08", 16);
+    ASSERT_EQ(runner, p.branchTriedAt(stamp, 0), 2u);
+    ASSERT_EQ(runner, p.branchTriedAt(stamp, 1), 1u);
+
+    p.adaptBranches(0);
+    ASSERT_EQ(runner, p.branchTriedAt(stamp, 0), 0u);
+}
+
+void test_adaptive_results_unchanged(TestRunner& runner) {
+    Grammar g;
+    buildStampGrammar(g);
+    g.addRule("<word> ::= 'ab' | ( 'a' ... 'z' ) ( 'a' ... 'z' ) | 'a'");
+    g.addRule("<item> ::= <stamp> | <word> | <d>");
+    g.addRule("<items> ::= <item> { ' ' <item> }");
+    BNFParser plain(g);
+    BNFParser adapting(g);
+    adapting.adaptBranches(3);
+
+    const char* parts[] = { "2024-05-06", "T", "07:08", "ab", "ax", "a", "7", " " };
+    bool same = true;
+    std::srand(92);
+    for (int i = 0; i < 400 && same; ++i) {
+        std::string text;
+        size_t count = std::rand() % 5;
+        for (size_t j = 0; j < count; ++j)
+            text += parts[std::rand() % 8];
+        size_t c1 = 0, c2 = 0;
+        ASTNode* a = plain.parse("<items>", text, c1);
+        ASTNode* b = adapting.parse("<items>", text, c2);
+        if (c1 != c2 || formatAST(a) != formatAST(b)) same = false;
+        delete a;
+        delete b;
+        bool fullA = plain.matchFull("<items>", text);
+        bool fullB = adapting.matchFull("<items>", text);
+        if (fullA != fullB) same = false;
+    }
+    ASSERT_TRUE(runner, same);
+}
+
+void test_order_is_per_parser(TestRunner& runner) {
+    Grammar* g = new Grammar();
+    buildStampGrammar(*g);
+    GrammarHandle handle;
+    handle.publish(g);
+    GrammarHandle::Snapshot snapshot(handle);
+
+    BNFParser first(snapshot);
+    BNFParser second(snapshot);
+    first.adaptBranches(4);
+    second.adaptBranches(4);
+    parseTimes(first, "07:08", 4);
+    parseTimes(second, "2024-05-06T07:08", 4);
+
+    unsigned int stamp = stampNode(first);
+    ASSERT_EQ(runner, first.branchTriedAt(stamp, 0), 2u);
+    ASSERT_EQ(runner, second.branchTriedAt(stamp, 0), 1u);
+    // The shared compiled grammar keeps the written order
+    const CompiledGrammar& cg = snapshot.compiled();
+    ASSERT_EQ(runner, cg.branchRank(cg.node(stamp), 0), 0u);
+}
+
+void test_adaptive_order_survives_recompile(TestRunner& runner) {
+    Grammar g;
+    buildStampGrammar(g);
+    BNFParser p(g);
+    p.adaptBranches(2);
+    parseTimes(p, "07:08", 2);
+
+    // New rules recompile the grammar and restart adaptation
+    g.addRule("<stamps> ::= <stamp> { ',' <stamp> }");
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<stamps>", "07:08,2024-05-06", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 16u);
+    delete ast;
+    ASSERT_EQ(runner, p.branchTriedAt(stampNode(p), 0), 0u);
+}
+
+int main() {
+    TestSuite suite("Adaptive Order Test Suite");
+    suite.addTest("Order Follows Recent Wins", test_order_follows_recent_wins);
+    suite.addTest("Results Unchanged", test_adaptive_results_unchanged);
+    suite.addTest("Order Is Per Parser", test_order_is_per_parser);
+    suite.addTest("Survives Recompile", test_adaptive_order_survives_recompile);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/BranchProfile.hpp"
+#include "../include/GrammarHandle.hpp"
+#include <sstream>
+#include <cstdlib>
+
+static void buildValueGrammar(Grammar& g) {
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<code> ::= <letter> <letter> <digit>");
+    g.addRule("<pair> ::= <letter> <letter>");
+    g.addRule("<name> ::= <letter> { <letter> }");
+    g.addRule("<value> ::= <code> | <pair> | <name> | <digit> { <digit> }");
+    g.addRule("<values> ::= <value> { ',' <value> }");
+}
+
+// Compiled index of the root alternative of a rule
+static unsigned int rootOf(const BNFParser& p, const std::string& rule) {
+    const CompiledGrammar& cg = p.compiledGrammar();
+    return cg.rule(cg.findRule(rule)).root;
+}
+
+void test_record_branch_wins(TestRunner& runner) {
+    Grammar g;
+    buildValueGrammar(g);
+    BNFParser p(g);
+    BranchProfile profile;
+    p.recordBranches(&profile);
+
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<values>", "alpha,beta,7,ab,xy1,gamma", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    delete ast;
+    p.recordBranches(0);
+
+    unsigned int value = rootOf(p, "<value>");
+    ASSERT_EQ(runner, profile.wins(value, 0), 1ul);   // xy1
+    ASSERT_EQ(runner, profile.wins(value, 1), 1ul);   // ab
+    ASSERT_EQ(runner, profile.wins(value, 2), 3ul);   // alpha, beta, gamma
+    ASSERT_EQ(runner, profile.wins(value, 3), 1ul);   // 7
+    ASSERT_EQ(runner, profile.wins(value, 9), 0ul);
+
+    // Nothing is recorded once recording stops
+    unsigned long total = profile.total();
+    ast = p.parse("<values>", "delta", consumed);
+    delete ast;
+    ASSERT_EQ(runner, profile.total(), total);
+}
+
+void test_branches_ordered_by_profile(TestRunner& runner) {
+    Grammar g;
+    buildValueGrammar(g);
+    BNFParser plain(g);
+    BNFParser ordered(g);
+    BranchProfile profile;
+    unsigned int value = rootOf(plain, "<value>");
+    profile.record(value, 2);
+    profile.record(value, 2);
+    profile.record(value, 3);
+    ordered.orderBranches(&profile);
+
+    const CompiledGrammar& cg = ordered.compiledGrammar();
+    const CompiledGrammar::Node& alt = cg.node(value);
+    ASSERT_EQ(runner, cg.branchRank(alt, 0), 2u);
+    ASSERT_EQ(runner, cg.branchRank(alt, 1), 3u);
+    // Branches that never won keep their order
+    ASSERT_EQ(runner, cg.branchRank(alt, 2), 0u);
+    ASSERT_EQ(runner, cg.branchRank(alt, 3), 1u);
+    ASSERT_EQ(runner, plain.compiledGrammar().branchRank(plain.compiledGrammar().node(value), 2), 2u);
+
+    // Same trees either way
+    const std::string alphabet = "abz019,";
+    bool same = true;
+    std::srand(91);
+    for (int i = 0; i < 300 && same; ++i) {
+        std::string text;
+        size_t len = std::rand() % 16;
+        for (size_t j = 0; j < len; ++j)
+            text += alphabet[std::rand() % alphabet.size()];
+        size_t c1 = 0, c2 = 0;
+        ASTNode* a = plain.parse("<values>", text, c1);
+        ASTNode* b = ordered.parse("<values>", text, c2);
+        if (c1 != c2 || formatAST(a) != formatAST(b)) same = false;
+        delete a;
+        delete b;
+    }
+    ASSERT_TRUE(runner, same);
+}
+
+void test_ties_go_to_written_order(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<word> ::= 'ab' | ( 'a' ... 'z' ) ( 'a' ... 'z' ) | 'a'");
+    BNFParser p(g);
+    BranchProfile profile;
+    unsigned int word = rootOf(p, "<word>");
+    profile.record(word, 2);
+    profile.record(word, 1);
+    profile.record(word, 1);
+    p.orderBranches(&profile);
+
+    // The class pair is tried first, but 'ab' is written first and ties it
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<word>", "ab", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, formatAST(ast), std::string("<alt>[ab](ab[ab]())"));
+    delete ast;
+
+    ast = p.parse("<word>", "ax", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, ast->children[0]->symbol, std::string("<seq>"));
+    delete ast;
+
+    ast = p.parse("<word>", "a", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 1u);
+    delete ast;
+}
+
+void test_profile_save_and_load(TestRunner& runner) {
+    BranchProfile profile;
+    profile.record(4, 0);
+    profile.record(4, 2);
+    profile.record(4, 2);
+    profile.record(17, 1);
+
+    std::ostringstream out;
+    profile.save(out);
+    ASSERT_EQ(runner, out.str(), std::string("4 1 0 2\n17 0 1\n"));
+
+    BranchProfile loaded;
+    std::istringstream in(out.str());
+    ASSERT_TRUE(runner, loaded.load(in));
+    ASSERT_EQ(runner, loaded.wins(4, 2), 2ul);
+    ASSERT_EQ(runner, loaded.wins(17, 1), 1ul);
+    ASSERT_EQ(runner, loaded.total(), 4ul);
+
+    std::istringstream bad("4 1 x\n");
+    ASSERT_FALSE(runner, loaded.load(bad));
+}
+
+void test_publish_with_profile(TestRunner& runner) {
+    Grammar* g = new Grammar();
+    buildValueGrammar(*g);
+    BranchProfile profile;
+    {
+        BNFParser p(*g);
+        profile.record(rootOf(p, "<value>"), 3);
+    }
+
+    GrammarHandle handle;
+    handle.publish(g, &profile);
+    GrammarHandle::Snapshot snapshot(handle);
+    BNFParser p(snapshot);
+    unsigned int value = rootOf(p, "<value>");
+    ASSERT_EQ(runner, p.compiledGrammar().branchRank(p.compiledGrammar().node(value), 0), 3u);
+
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<values>", "12,ab1", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 6u);
+    delete ast;
+}
+
+int main() {
+    TestSuite suite("Branch Profile Test Suite");
+    suite.addTest("Record Branch Wins", test_record_branch_wins);
+    suite.addTest("Branches Ordered By Profile", test_branches_ordered_by_profile);
+    suite.addTest("Ties Go To Written Order", test_ties_go_to_written_order);
+    suite.addTest("Save and Load", test_profile_save_and_load);
+    suite.addTest("Publish With Profile", test_publish_with_profile);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/ExpressionInterner.hpp"
+#include <map>
+#include <sstream>
+
+// Rule texts using every construct, with a repeated name and a text that is not a rule
+static std::vector<std::string> buildTexts(size_t messages) {
+    std::vector<std::string> texts;
+    texts.push_back("<d> ::= ( '0' ... '9' )");
+    texts.push_back("~<w> ::= ( 'a' ... 'z' ) { ( 'a' ... 'z' ) }");
+    texts.push_back("@<num> ::= <d> { <d> }");
+    texts.push_back("<ws> ::= ( 0x20 0x09 )");
+    for (size_t i = 0; i < messages; ++i) {
+        std::ostringstream r;
+        r << "<m" << i << "> ::= 'KW" << i % 7 << "' <w> [ ':' <num> ] | !'x' 'a' ... 'c' { ',' <w> }"
+          << " | &'y' ( ^ 'q' ) <m" << i / 2 << ">";
+        texts.push_back(r.str());
+        if (i % 50 == 7) texts.push_back("<m3> ::= 'shadowed'");
+        if (i % 90 == 11) texts.push_back("not a rule");
+    }
+    return texts;
+}
+
+static bool sameTree(const Expression* a, const Expression* b) {
+    if (!a || !b) return a == b;
+    if (a->type != b->type || a->value != b->value || a->charBitmap != b->charBitmap ||
+        a->charRange.start != b->charRange.start || a->charRange.end != b->charRange.end ||
+        a->children.size() != b->children.size())
+        return false;
+    for (size_t i = 0; i < a->children.size(); ++i)
+        if (!sameTree(a->children[i], b->children[i])) return false;
+    return true;
+}
+
+static bool sameRules(const Grammar& a, const Grammar& b) {
+    if (a.getRules().size() != b.getRules().size()) return false;
+    for (size_t i = 0; i < a.getRules().size(); ++i) {
+        const Rule* x = a.getRules()[i];
+        const Rule* y = b.getRules()[i];
+        if (x->name != y->name || x->transparent != y->transparent || x->token != y->token ||
+            !sameTree(x->rootExpr, y->rootExpr))
+            return false;
+    }
+    return true;
+}
+
+// Numbers nodes in order of first visit, so two grammars share nodes the
+// same way exactly when their sequences are equal
+static void shape(const Expression* e, std::map<const Expression*, size_t>& ids, std::vector<size_t>& out) {
+    if (!e) { out.push_back(0); return; }
+    std::map<const Expression*, size_t>::iterator it = ids.find(e);
+    if (it != ids.end()) { out.push_back(it->second); return; }
+    size_t id = ids.size() + 1;
+    ids[e] = id;
+    out.push_back(id);
+    for (size_t i = 0; i < e->children.size(); ++i)
+        shape(e->children[i], ids, out);
+}
+
+static std::vector<size_t> sharing(const Grammar& g) {
+    std::map<const Expression*, size_t> ids;
+    std::vector<size_t> out;
+    for (size_t i = 0; i < g.getRules().size(); ++i)
+        shape(g.getRules()[i]->rootExpr, ids, out);
+    return out;
+}
+
+void test_same_as_add_rule(TestRunner& runner) {
+    std::vector<std::string> texts = buildTexts(600);
+    Grammar expected;
+    for (size_t i = 0; i < texts.size(); ++i)
+        expected.addRule(texts[i]);
+
+    unsigned int threads[] = { 0, 1, 3, 8 };
+    for (size_t t = 0; t < 4; ++t) {
+        Grammar g;
+        g.addRules(texts, threads[t]);
+        ASSERT_TRUE(runner, sameRules(g, expected));
+        ASSERT_EQ(runner, g.getRevision(), expected.getRevision());
+        // The first rule with a name wins, as with addRule
+        ASSERT_EQ(runner, g.getRule("<m3>"), g.getRules()[7]);
+        ASSERT_EQ(runner, g.getRule("<m3>")->rootExpr->type, Expression::EXPR_ALTERNATIVE);
+        ASSERT_TRUE(runner, g.getRule("<m599>") != 0);
+    }
+}
+
+void test_interned_sharing(TestRunner& runner) {
+    std::vector<std::string> texts = buildTexts(400);
+    ExpressionInterner sequential;
+    Grammar expected;
+    expected.setInterner(&sequential);
+    for (size_t i = 0; i < texts.size(); ++i)
+        expected.addRule(texts[i]);
+
+    ExpressionInterner bulk;
+    Grammar g;
+    g.setInterner(&bulk);
+    g.addRules(texts, 4);
+    ASSERT_TRUE(runner, sameRules(g, expected));
+    ASSERT_EQ(runner, bulk.size(), sequential.size());
+    ASSERT_TRUE(runner, sharing(g) == sharing(expected));
+    // Literals repeated across slices are one node
+    ASSERT_EQ(runner, g.getRule("<m0>")->rootExpr->children[0]->children[0],
+              g.getRule("<m399>")->rootExpr->children[0]->children[0]);
+}
+
+void test_arena(TestRunner& runner) {
+    std::vector<std::string> texts = buildTexts(300);
+    Arena arena;
+    Grammar g;
+    g.setArena(&arena);
+    g.addRules(texts, 3);
+    Grammar expected;
+    for (size_t i = 0; i < texts.size(); ++i)
+        expected.addRule(texts[i]);
+    ASSERT_TRUE(runner, sameRules(g, expected));
+
+    BNFParser p(g);
+    BNFParser q(expected);
+    const char* inputs[] = { "KW3abc:12", "b,xy,z", "yzKW1", "KW0", "q" };
+    for (size_t i = 0; i < 5; ++i)
+        ASSERT_EQ(runner, p.matchFull("<m10>", inputs[i]), q.matchFull("<m10>", inputs[i]));
+    ASSERT_TRUE(runner, p.matchFull("<m10>", "KW3abc:12"));
+}
+
+void test_appends_to_existing_rules(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<greeting> ::= 'hi' <name>");
+    g.addRule("<name> ::= 'bob'");
+    std::vector<std::string> texts;
+    texts.push_back("<name> ::= 'alice'");
+    texts.push_back("<farewell> ::= 'bye' <name>");
+    g.addRules(texts, 2);
+    g.addRule("<both> ::= <greeting> <farewell>");
+    g.addRules(std::vector<std::string>(), 2);
+
+    ASSERT_EQ(runner, g.getRules().size(), 5u);
+    ASSERT_EQ(runner, g.getRevision(), 5ul);
+    ASSERT_EQ(runner, g.getRules()[2]->rootExpr->value, std::string("alice"));
+    ASSERT_EQ(runner, g.getRules()[4]->name, std::string("<both>"));
+    BNFParser p(g);
+    ASSERT_TRUE(runner, p.matchFull("<both>", "hibobbyebob"));
+    ASSERT_FALSE(runner, p.matchFull("<both>", "hialicebyealice"));
+}
+
+int main() {
+    TestSuite suite("Bulk Load Test Suite");
+    suite.addTest("Same As addRule", test_same_as_add_rule);
+    suite.addTest("Interned Sharing", test_interned_sharing);
+    suite.addTest("Arena", test_arena);
+    suite.addTest("Appends To Existing Rules", test_appends_to_existing_rules);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/ExpressionInterner.hpp"
+
+void test_compiled_node_size(TestRunner& runner) {
+    ASSERT_LE(runner, sizeof(CompiledGrammar::Node), 16u);
+    ASSERT_LT(runner, sizeof(CompiledGrammar::Node), sizeof(Expression));
+}
+
+void test_compiled_payloads(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<digit> ::= '0' ... '9'");
+    g.addRule("<word> ::= 'hello'");
+    g.addRule("<num> ::= <digit> { <digit> }");
+
+    CompiledGrammar cg(g);
+    ASSERT_EQ(runner, cg.ruleCount(), 3u);
+
+    unsigned int digit = cg.findRule("<digit>");
+    ASSERT_NE(runner, digit, CompiledGrammar::NO_RULE);
+    const CompiledGrammar::Node& range = cg.node(cg.rule(digit).root);
+    ASSERT_EQ(runner, static_cast<int>(range.kind), static_cast<int>(CompiledGrammar::NODE_CHAR_RANGE));
+    ASSERT_EQ(runner, range.a, static_cast<unsigned int>('0'));
+    ASSERT_EQ(runner, range.b, static_cast<unsigned int>('9'));
+
+    const CompiledGrammar::Node& word = cg.node(cg.rule(cg.findRule("<word>")).root);
+    ASSERT_EQ(runner, static_cast<int>(word.kind), static_cast<int>(CompiledGrammar::NODE_TERMINAL));
+    ASSERT_EQ(runner, std::string(cg.literal(word), word.b), std::string("hello"));
+
+    const CompiledGrammar::Node& num = cg.node(cg.rule(cg.findRule("<num>")).root);
+    ASSERT_EQ(runner, static_cast<int>(num.kind), static_cast<int>(CompiledGrammar::NODE_SEQUENCE));
+    ASSERT_EQ(runner, cg.childCount(num), 2u);
+    const CompiledGrammar::Node& sym = cg.node(cg.child(num, 0));
+    ASSERT_EQ(runner, sym.a, digit);
+    ASSERT_EQ(runner, cg.name(sym.b), std::string("<digit>"));
+
+    ASSERT_EQ(runner, cg.findRule("<missing>"), CompiledGrammar::NO_RULE);
+}
+
+void test_compiled_bitmap_dedup(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<a> ::= ( 'a' ... 'z' )");
+    g.addRule("<b> ::= ( 'a' ... 'z' )");
+    g.addRule("<c> ::= <a> | <b>");
+
+    CompiledGrammar cg(g);
+    const CompiledGrammar::Node& a = cg.node(cg.rule(cg.findRule("<a>")).root);
+    const CompiledGrammar::Node& b = cg.node(cg.rule(cg.findRule("<b>")).root);
+    const CompiledGrammar::Node& c = cg.node(cg.rule(cg.findRule("<c>")).root);
+
+    // Both classes and every FIRST set here are the same 26 letters
+    ASSERT_EQ(runner, a.a, b.a);
+    ASSERT_EQ(runner, a.first, a.a);
+    ASSERT_EQ(runner, c.first, a.a);
+    ASSERT_TRUE(runner, cg.first(c).test('q'));
+    ASSERT_FALSE(runner, CompiledGrammar::nullable(c));
+}
+
+void test_compiled_first_and_nullable(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<s> ::= [ 'x' ] { 'y' } 'z'");
+    g.addRule("<e> ::= [ 'x' ] { 'y' }");
+
+    CompiledGrammar cg(g);
+    const CompiledGrammar::Node& s = cg.node(cg.rule(cg.findRule("<s>")).root);
+    ASSERT_TRUE(runner, cg.first(s).test('x'));
+    ASSERT_TRUE(runner, cg.first(s).test('y'));
+    ASSERT_TRUE(runner, cg.first(s).test('z'));
+    ASSERT_FALSE(runner, CompiledGrammar::nullable(s));
+
+    const CompiledGrammar::Node& e = cg.node(cg.rule(cg.findRule("<e>")).root);
+    ASSERT_TRUE(runner, CompiledGrammar::nullable(e));
+    ASSERT_FALSE(runner, cg.first(e).test('z'));
+}
+
+void test_compiled_keeps_interned_sharing(TestRunner& runner) {
+    ExpressionInterner inter;
+    Grammar g;
+    g.setInterner(&inter);
+    g.addRule("<a> ::= 'X' | 'Y'");
+    g.addRule("<b> ::= 'X' | 'Y'");
+
+    CompiledGrammar cg(g);
+    ASSERT_EQ(runner, cg.rule(0).root, cg.rule(1).root);
+    ASSERT_EQ(runner, cg.nodeCount(), 3u);
+}
+
+void test_compiled_recursive_rule(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<list> ::= 'i' [ ',' <list> ]");
+
+    CompiledGrammar cg(g);
+    const CompiledGrammar::Node& root = cg.node(cg.rule(0).root);
+    ASSERT_TRUE(runner, cg.first(root).test('i'));
+    ASSERT_FALSE(runner, CompiledGrammar::nullable(root));
+
+    BNFParser p(g);
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<list>", "i,i,i", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 5u);
+    delete ast;
+}
+
+void test_compiled_smaller_than_expressions(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<letter> ::= ( 'a' ... 'z' 'A' ... 'Z' )");
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<nick-char> ::= <letter> | <digit> | '_' | '-'");
+    g.addRule("<nick> ::= <letter> { <nick-char> }");
+    g.addRule("<command> ::= 'JOIN' | 'PART' | 'PRIVMSG'");
+    g.addRule("<channel> ::= '#' <nick>");
+    g.addRule("<message> ::= ':' <nick> ' ' <command> ' ' <channel>");
+
+    CompiledGrammar cg(g);
+    // 16 bytes per node plus shared tables versus 104+ bytes per Expression
+    ASSERT_LT(runner, cg.nodeCount() * sizeof(CompiledGrammar::Node),
+              cg.nodeCount() * sizeof(Expression) / 4);
+    ASSERT_GT(runner, cg.memoryUsage(), 0u);
+}
+
+void test_parser_recompiles_after_add_rule(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<s> ::= 'a' <t>");
+    BNFParser p(g);
+
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<s>", "ab", consumed);
+    ASSERT_NULL(runner, ast);
+
+    g.addRule("<t> ::= 'b'");
+    ast = p.parse("<s>", "ab", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 2u);
+    delete ast;
+}
+
+void test_compiled_children_contiguous(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<s> ::= 'a' [ 'b' | 'c' ] 'd'");
+    g.addRule("<t> ::= 'x' 'y'");
+
+    CompiledGrammar cg(g);
+    // <s>: seq(3) 'a' opt alt(2) 'b' 'c' 'd'; <t>: seq(2) 'x' 'y'
+    ASSERT_EQ(runner, cg.nodeCount(), 10u);
+    ASSERT_EQ(runner, cg.edgeCount(), 7u);
+
+    const CompiledGrammar::Node& s = cg.node(cg.rule(0).root);
+    ASSERT_EQ(runner, cg.rule(0).root, 0u);
+    ASSERT_EQ(runner, s.a, 0u);
+    ASSERT_EQ(runner, cg.childCount(s), 3u);
+
+    // Nodes and edges both follow preorder: children come right after
+    // their parent, and the nested alternative's edges after the sequence's
+    ASSERT_EQ(runner, cg.child(s, 0), 1u);
+    ASSERT_EQ(runner, cg.child(s, 1), 2u);
+    ASSERT_EQ(runner, cg.child(s, 2), 6u);
+    const CompiledGrammar::Node& opt = cg.node(cg.child(s, 1));
+    ASSERT_EQ(runner, opt.a, 3u);
+    const CompiledGrammar::Node& alt = cg.node(opt.a);
+    ASSERT_EQ(runner, alt.a, 3u);
+    ASSERT_EQ(runner, cg.childCount(alt), 2u);
+    ASSERT_EQ(runner, cg.child(alt, 0), 4u);
+    ASSERT_EQ(runner, cg.child(alt, 1), 5u);
+
+    const CompiledGrammar::Node& t = cg.node(cg.rule(1).root);
+    ASSERT_EQ(runner, cg.rule(1).root, 7u);
+    ASSERT_EQ(runner, t.a, 5u);
+    ASSERT_EQ(runner, cg.child(t, 0), 8u);
+    ASSERT_EQ(runner, cg.child(t, 1), 9u);
+}
+
+int main() {
+    TestSuite suite("Compiled Grammar Test Suite");
+    suite.addTest("Node Size", test_compiled_node_size);
+    suite.addTest("Payloads", test_compiled_payloads);
+    suite.addTest("Bitmap Dedup", test_compiled_bitmap_dedup);
+    suite.addTest("FIRST and Nullable", test_compiled_first_and_nullable);
+    suite.addTest("Interned Sharing", test_compiled_keeps_interned_sharing);
+    suite.addTest("Recursive Rule", test_compiled_recursive_rule);
+    suite.addTest("Smaller than Expressions", test_compiled_smaller_than_expressions);
+    suite.addTest("Recompile after addRule", test_parser_recompiles_after_add_rule);
+    suite.addTest("Contiguous Children", test_compiled_children_contiguous);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
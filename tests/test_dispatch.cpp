@@ -0,0 +1,181 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/ParseMemo.hpp"
+#include <cstdlib>
+
+static void buildMessageGrammar(Grammar& g) {
+    g.addRule("<letter> ::= ( 'A' ... 'Z' 'a' ... 'z' )");
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<word> ::= <letter> { <letter> }");
+    g.addRule("<number> ::= <digit> { <digit> }");
+    g.addRule("<header> ::= <word> ':' <number>");
+    g.addRule("<ping> ::= 'PING ' <number>");
+    g.addRule("<login> ::= 'LOGIN ' <word> ' ' <word>");
+    g.addRule("<event> ::= <header> ' ' <word>");
+    g.addRule("<metric> ::= <header> ' ' <number>");
+    g.addRule("<note> ::= [ '#' ] <word>");
+}
+
+// What parseAny replaces: try each rule until one returns a tree
+static size_t firstMatch(const BNFParser& p, const std::vector<std::string>& rules,
+                         const std::string& input, size_t& consumed, std::string& tree) {
+    for (size_t i = 0; i < rules.size(); ++i) {
+        ASTNode* ast = p.parse(rules[i], input, consumed);
+        if (ast) {
+            tree = formatAST(ast);
+            delete ast;
+            return i;
+        }
+    }
+    consumed = 0;
+    tree = "~";
+    return rules.size();
+}
+
+static std::vector<std::string> messageRules() {
+    std::vector<std::string> rules;
+    rules.push_back("<ping>");
+    rules.push_back("<login>");
+    rules.push_back("<event>");
+    rules.push_back("<metric>");
+    rules.push_back("<note>");
+    return rules;
+}
+
+void test_parse_memo(TestRunner& runner) {
+    ParseMemo memo;
+    size_t end = 0;
+    ASSERT_TRUE(runner, memo.find(3, 10, false, end) == ParseMemo::UNKNOWN);
+    memo.store(3, 10, false, true, 14);
+    memo.store(3, 10, true, false, 0);
+    ASSERT_TRUE(runner, memo.find(3, 10, false, end) == ParseMemo::MATCHED);
+    ASSERT_EQ(runner, end, 14u);
+    ASSERT_TRUE(runner, memo.find(3, 10, true, end) == ParseMemo::FAILED);
+
+    // Growing keeps every entry
+    for (unsigned int r = 0; r < 50; ++r)
+        for (size_t pos = 0; pos < 20; ++pos)
+            memo.store(r, pos, false, r % 2 == 0, pos + r);
+    bool kept = true;
+    for (unsigned int r = 0; r < 50; ++r)
+        for (size_t pos = 0; pos < 20; ++pos) {
+            ParseMemo::Result res = memo.find(r, pos, false, end);
+            if (res != (r % 2 == 0 ? ParseMemo::MATCHED : ParseMemo::FAILED)) kept = false;
+            if (res == ParseMemo::MATCHED && end != pos + r) kept = false;
+        }
+    ASSERT_TRUE(runner, kept);
+
+    memo.clear();
+    ASSERT_EQ(runner, memo.size(), 0u);
+    ASSERT_TRUE(runner, memo.find(3, 10, false, end) == ParseMemo::UNKNOWN);
+}
+
+void test_dispatch_picks_first_matching_rule(TestRunner& runner) {
+    Grammar g;
+    buildMessageGrammar(g);
+    BNFParser p(g);
+    std::vector<std::string> rules = messageRules();
+
+    size_t consumed = 0, which = 0;
+    ASTNode* ast = p.parseAny(rules, "PING 42", consumed, which);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, which, 0u);
+    ASSERT_EQ(runner, consumed, 7u);
+    delete ast;
+
+    // <event> and <metric> share <header>; the first that matches wins
+    ast = p.parseAny(rules, "cpu:3 97", consumed, which);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, which, 3u);
+    delete ast;
+    ast = p.parseAny(rules, "cpu:3 high", consumed, which);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, which, 2u);
+    delete ast;
+
+    // Only <note> is left when <header> fails
+    ast = p.parseAny(rules, "hello world", consumed, which);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, which, 4u);
+    ASSERT_EQ(runner, consumed, 5u);
+    delete ast;
+
+    ASSERT_NULL(runner, p.parseAny(rules, "42", consumed, which));
+    ASSERT_EQ(runner, which, rules.size());
+    ASSERT_EQ(runner, consumed, 0u);
+}
+
+void test_dispatch_with_skip_and_tokens(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<ws> ::= ( ' ' )");
+    g.addRule("@<ident> ::= ( 'a' ... 'z' ) { ( 'a' ... 'z' ) }");
+    g.addRule("<assign> ::= <ident> '=' <ident>");
+    g.addRule("<call> ::= <ident> '(' ')'");
+    g.setSkipRule("<ws>");
+    BNFParser p(g);
+
+    std::vector<std::string> rules;
+    rules.push_back("<assign>");
+    rules.push_back("<ident>");
+    rules.push_back("<call>");
+
+    size_t consumed = 0, which = 0;
+    ASTNode* ast = p.parseAny(rules, "  f ( )", consumed, which);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, which, 2u);
+    delete ast;
+
+    // A token start rule is matched as written, so leading blanks rule it out
+    ast = p.parseAny(rules, "abc", consumed, which);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, which, 1u);
+    delete ast;
+    ast = p.parseAny(rules, " abc", consumed, which);
+    ASSERT_NULL(runner, ast);
+}
+
+void test_dispatch_agrees_with_sequential_parse(TestRunner& runner) {
+    Grammar g;
+    buildMessageGrammar(g);
+    BNFParser p(g);
+
+    const char* samples[] = { "PING ", "LOGIN ", "cpu:", "mem:", "#", "x", "7", " ", ":" };
+    const std::string filler = "aZ09: #";
+    bool same = true;
+    std::srand(90);
+    for (int i = 0; i < 400 && same; ++i) {
+        std::string text;
+        size_t parts = std::rand() % 4;
+        for (size_t j = 0; j < parts; ++j) {
+            text += samples[std::rand() % 9];
+            size_t len = std::rand() % 4;
+            for (size_t k = 0; k < len; ++k)
+                text += filler[std::rand() % filler.size()];
+        }
+        // Random subsets in random order
+        std::vector<std::string> all = messageRules();
+        std::vector<std::string> rules;
+        for (size_t k = 0; k < all.size(); ++k)
+            if (std::rand() % 3) rules.push_back(all[std::rand() % all.size()]);
+
+        size_t expectedConsumed = 0, consumed = 0, which = 0;
+        std::string expectedTree;
+        size_t expected = firstMatch(p, rules, text, expectedConsumed, expectedTree);
+        ASTNode* ast = p.parseAny(rules, text, consumed, which);
+        if (which != expected || consumed != expectedConsumed || formatAST(ast) != expectedTree) same = false;
+        delete ast;
+    }
+    ASSERT_TRUE(runner, same);
+}
+
+int main() {
+    TestSuite suite("Dispatch Test Suite");
+    suite.addTest("Parse Memo", test_parse_memo);
+    suite.addTest("Picks First Matching Rule", test_dispatch_picks_first_matching_rule);
+    suite.addTest("Skip Rule and Tokens", test_dispatch_with_skip_and_tokens);
+    suite.addTest("Agrees With Sequential Parse", test_dispatch_agrees_with_sequential_parse);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
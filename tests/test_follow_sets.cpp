@@ -0,0 +1,131 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include "../include/BNFParser.hpp"
+
+void test_follow_sequence(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<s> ::= 'a' [ 'b' ] { 'c' } 'd'");
+
+    CompiledGrammar cg(g);
+    const CompiledGrammar::Node& s = cg.node(cg.rule(0).root);
+    unsigned int a = cg.child(s, 0);
+    unsigned int opt = cg.child(s, 1);
+    unsigned int rep = cg.child(s, 2);
+    unsigned int d = cg.child(s, 3);
+    std::vector<std::bitset<256> > follow;
+    std::vector<bool> atEnd;
+    cg.followSets(std::vector<unsigned int>(1, 0), follow, atEnd);
+
+    // After 'a' come the optional, the repetition or 'd'
+    ASSERT_TRUE(runner, follow[a].test('b'));
+    ASSERT_TRUE(runner, follow[a].test('c'));
+    ASSERT_TRUE(runner, follow[a].test('d'));
+    ASSERT_EQ(runner, follow[a].count(), 3u);
+
+    ASSERT_FALSE(runner, follow[opt].test('b'));
+    ASSERT_TRUE(runner, follow[opt].test('c'));
+    ASSERT_TRUE(runner, follow[opt].test('d'));
+
+    // The body of a repetition can be followed by itself
+    unsigned int body = cg.node(rep).a;
+    ASSERT_TRUE(runner, follow[body].test('c'));
+    ASSERT_TRUE(runner, follow[body].test('d'));
+    ASSERT_FALSE(runner, follow[rep].test('c'));
+
+    ASSERT_TRUE(runner, follow[d].none());
+    ASSERT_TRUE(runner, atEnd[d]);
+    ASSERT_FALSE(runner, atEnd[a]);
+}
+
+void test_follow_through_rules(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<item> ::= 'x' | 'y'");
+    g.addRule("<list> ::= <item> { ',' <item> } ';'");
+
+    CompiledGrammar cg(g);
+    unsigned int item = cg.rule(cg.findRule("<item>")).root;
+    unsigned int list = cg.rule(cg.findRule("<list>")).root;
+    std::vector<std::bitset<256> > follow;
+    std::vector<bool> atEnd;
+    cg.followSets(std::vector<unsigned int>(1, cg.findRule("<list>")), follow, atEnd);
+    ASSERT_TRUE(runner, follow[item].test(','));
+    ASSERT_TRUE(runner, follow[item].test(';'));
+    ASSERT_FALSE(runner, follow[item].test('x'));
+    ASSERT_TRUE(runner, atEnd[list]);
+    // <item> is always followed by ',' or ';' inside <list>
+    ASSERT_FALSE(runner, atEnd[item]);
+
+    // Unless parses can also start from it
+    std::vector<unsigned int> starts;
+    starts.push_back(cg.findRule("<list>"));
+    starts.push_back(cg.findRule("<item>"));
+    cg.followSets(starts, follow, atEnd);
+    ASSERT_TRUE(runner, atEnd[item]);
+    ASSERT_TRUE(runner, follow[item].test(','));
+}
+
+void test_follow_on_demand(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<s> ::= 'a' 'b'");
+
+    // Only the FIRST sets {a} and {b} are stored; FOLLOW sets are not
+    CompiledGrammar cg(g);
+    ASSERT_EQ(runner, cg.bitmapCount(), 2u);
+
+    std::vector<std::bitset<256> > follow;
+    std::vector<bool> atEnd;
+    cg.followSets(std::vector<unsigned int>(1, 0), follow, atEnd);
+    ASSERT_EQ(runner, follow.size(), cg.nodeCount());
+    ASSERT_EQ(runner, atEnd.size(), cg.nodeCount());
+    unsigned int a = cg.child(cg.node(cg.rule(0).root), 0);
+    ASSERT_TRUE(runner, follow[a].test('b'));
+    ASSERT_EQ(runner, follow[a].count(), 1u);
+    ASSERT_FALSE(runner, atEnd[a]);
+    ASSERT_EQ(runner, cg.bitmapCount(), 2u);
+
+    // Without start rules nothing is followed by the end of input
+    cg.followSets(std::vector<unsigned int>(), follow, atEnd);
+    ASSERT_FALSE(runner, atEnd[cg.rule(0).root]);
+    ASSERT_TRUE(runner, follow[a].test('b'));
+}
+
+void test_follow_parse_results(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<s> ::= 'a' [ 'b' ] { 'c' } 'd'");
+    g.addRule("<e> ::= { [ 'x' ] } 'y'");
+
+    BNFParser p(g);
+    const char* inputs[] = { "ad", "abd", "accd", "abccd", "ab", "a" };
+    size_t expected[] = { 2, 3, 4, 5, 0, 0 };
+    for (size_t i = 0; i < 6; ++i) {
+        size_t consumed = 0;
+        ASTNode* ast = p.parse("<s>", inputs[i], consumed);
+        if (expected[i]) {
+            ASSERT_NOT_NULL(runner, ast);
+            ASSERT_EQ(runner, consumed, expected[i]);
+        } else {
+            ASSERT_NULL(runner, ast);
+        }
+        delete ast;
+    }
+
+    // A nullable body stops the repetition without building an empty item
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<e>", "xxy", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 3u);
+    ASSERT_EQ(runner, ast->children[0]->children.size(), 2u);
+    delete ast;
+}
+
+int main() {
+    TestSuite suite("FOLLOW Set Test Suite");
+    suite.addTest("Sequence", test_follow_sequence);
+    suite.addTest("Through Rules", test_follow_through_rules);
+    suite.addTest("On Demand", test_follow_on_demand);
+    suite.addTest("Parse Results", test_follow_parse_results);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,106 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include <cstdlib>
+
+static void buildListGrammar(Grammar& g) {
+    g.addRule("<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<word> ::= <letter> { <letter> }");
+    g.addRule("<number> ::= <digit> { <digit> } [ '.' <digit> { <digit> } ]");
+    g.addRule("<keyword> ::= 'in' | 'int' | 'interface'");
+    g.addRule("<item> ::= <keyword> | <word> | <number>");
+    g.addRule("<list> ::= <item> { ',' <item> }");
+    g.addRule("<call> ::= <word> '(' [ <list> ] ')'");
+}
+
+void test_full_match_accepts_whole_input(TestRunner& runner) {
+    Grammar g;
+    buildListGrammar(g);
+    BNFParser p(g);
+
+    ASTNode* ast = p.parseFull("<list>", "abc,12.5,int");
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, ast->matched, std::string("abc,12.5,int"));
+    delete ast;
+
+    ASSERT_TRUE(runner, p.matchFull("<call>", "f(a,1)"));
+    ASSERT_TRUE(runner, p.matchFull("<call>", "f()"));
+    ASSERT_TRUE(runner, p.matchFull("<number>", "3.25"));
+}
+
+void test_full_match_rejects_prefixes(TestRunner& runner) {
+    Grammar g;
+    buildListGrammar(g);
+    BNFParser p(g);
+
+    // parse() accepts each of these as a prefix match
+    const char* rules[] = { "<list>", "<number>", "<call>", "<list>", "<item>" };
+    const char* inputs[] = { "a,b,", "12.", "f(a) ", "in,", "interfaces!" };
+    for (size_t i = 0; i < 5; ++i) {
+        std::string rule = rules[i];
+        size_t consumed = 0;
+        ASTNode* prefix = p.parse(rule, inputs[i], consumed);
+        ASSERT_NOT_NULL(runner, prefix);
+        delete prefix;
+        ASSERT_NULL(runner, p.parseFull(rule, inputs[i]));
+        ASSERT_FALSE(runner, p.matchFull(rule, inputs[i]));
+    }
+    ASSERT_FALSE(runner, p.matchFull("<list>", ""));
+}
+
+void test_full_match_keeps_longest_match(TestRunner& runner) {
+    Grammar g;
+    buildListGrammar(g);
+    BNFParser p(g);
+
+    // The branch that reaches the end wins, as it does in parse()
+    ASTNode* ast = p.parseFull("<keyword>", "int");
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, formatAST(ast), std::string("<alt>[int](int[int]())"));
+    delete ast;
+
+    // Greedy repetition is not undone to reach the end
+    g.addRule("<greedy> ::= { 'a' } 'a'");
+    ASSERT_FALSE(runner, p.matchFull("<greedy>", "aaa"));
+}
+
+void test_full_match_agrees_with_parse(TestRunner& runner) {
+    Grammar g;
+    buildListGrammar(g);
+    g.addRule("<pair> ::= <item> '=' <item> | <item>");
+    BNFParser p(g);
+
+    const char* rules[] = { "<list>", "<call>", "<item>", "<pair>", "<number>" };
+    const std::string alphabet = "aint1.,=()f";
+    bool same = true;
+    std::srand(89);
+    for (int i = 0; i < 400 && same; ++i) {
+        std::string text;
+        size_t len = std::rand() % 12;
+        for (size_t j = 0; j < len; ++j)
+            text += alphabet[std::rand() % alphabet.size()];
+        for (size_t r = 0; r < 5; ++r) {
+            size_t consumed = 0;
+            ASTNode* prefix = p.parse(rules[r], text, consumed);
+            std::string expected = consumed == text.size() ? formatAST(prefix) : "~";
+            ASTNode* full = p.parseFull(rules[r], text);
+            bool matched = p.matchFull(rules[r], text);
+            if (formatAST(full) != expected || matched != (full != 0)) same = false;
+            delete prefix;
+            delete full;
+        }
+    }
+    ASSERT_TRUE(runner, same);
+}
+
+int main() {
+    TestSuite suite("Full Match Test Suite");
+    suite.addTest("Accepts Whole Input", test_full_match_accepts_whole_input);
+    suite.addTest("Rejects Prefixes", test_full_match_rejects_prefixes);
+    suite.addTest("Keeps Longest Match", test_full_match_keeps_longest_match);
+    suite.addTest("Agrees With Parse", test_full_match_agrees_with_parse);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
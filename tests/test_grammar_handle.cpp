@@ -0,0 +1,90 @@
+#include "../include/TestFramework.hpp"
+#include "../include/GrammarHandle.hpp"
+#include "../include/BNFParser.hpp"
+
+static Grammar* greetingGrammar(const std::string& word) {
+    Grammar* g = new Grammar();
+    g->addRule("<name> ::= ( 'a' ... 'z' ) { ( 'a' ... 'z' ) }");
+    g->addRule("<greeting> ::= '" + word + " ' <name>");
+    return g;
+}
+
+static bool accepts(const BNFParser& p, const std::string& input) {
+    ASTNode* ast = p.parseFull("<greeting>", input);
+    bool ok = ast != 0;
+    delete ast;
+    return ok;
+}
+
+void test_empty_handle(TestRunner& runner) {
+    GrammarHandle handle;
+    GrammarHandle::Snapshot s(handle);
+    ASSERT_FALSE(runner, s.valid());
+    ASSERT_EQ(runner, s.number(), 0ul);
+    ASSERT_EQ(runner, handle.currentNumber(), 0ul);
+    ASSERT_EQ(runner, handle.retiredCount(), 0u);
+}
+
+void test_new_parses_see_new_version(TestRunner& runner) {
+    GrammarHandle handle;
+    unsigned long v1 = handle.publish(greetingGrammar("hello"));
+    ASSERT_EQ(runner, v1, 1ul);
+
+    GrammarHandle::Snapshot first(handle);
+    ASSERT_TRUE(runner, first.valid());
+    ASSERT_EQ(runner, first.number(), 1ul);
+    BNFParser oldParser(first);
+    ASSERT_TRUE(runner, accepts(oldParser, "hello bob"));
+
+    unsigned long v2 = handle.publish(greetingGrammar("hi"));
+    ASSERT_EQ(runner, v2, 2ul);
+    ASSERT_EQ(runner, handle.currentNumber(), 2ul);
+
+    // A parser started before the swap keeps its version
+    ASSERT_TRUE(runner, accepts(oldParser, "hello bob"));
+    ASSERT_FALSE(runner, accepts(oldParser, "hi bob"));
+
+    GrammarHandle::Snapshot second(handle);
+    BNFParser newParser(second);
+    ASSERT_TRUE(runner, accepts(newParser, "hi bob"));
+    ASSERT_FALSE(runner, accepts(newParser, "hello bob"));
+    ASSERT_TRUE(runner, &newParser.compiledGrammar() == &second.compiled());
+}
+
+void test_retired_versions_reclaimed(TestRunner& runner) {
+    GrammarHandle handle;
+    handle.publish(greetingGrammar("a"));
+    {
+        GrammarHandle::Snapshot pin(handle);
+        GrammarHandle::Snapshot copy(pin);
+        handle.publish(greetingGrammar("b"));
+        // Version 1 is still pinned twice
+        ASSERT_EQ(runner, handle.retiredCount(), 1u);
+        size_t freed = handle.reclaim();
+        ASSERT_EQ(runner, freed, 0u);
+
+        GrammarHandle::Snapshot other(handle);
+        copy = other;
+        ASSERT_EQ(runner, copy.number(), 2ul);
+        freed = handle.reclaim();
+        ASSERT_EQ(runner, freed, 0u);
+    }
+    size_t freed = handle.reclaim();
+    ASSERT_EQ(runner, freed, 1u);
+    ASSERT_EQ(runner, handle.retiredCount(), 0u);
+
+    // Unpinned versions are reclaimed by the next publish
+    handle.publish(greetingGrammar("c"));
+    ASSERT_EQ(runner, handle.retiredCount(), 0u);
+    ASSERT_EQ(runner, handle.currentNumber(), 3ul);
+}
+
+int main() {
+    TestSuite suite("Grammar Handle Test Suite");
+    suite.addTest("Empty Handle", test_empty_handle);
+    suite.addTest("New Parses See New Version", test_new_parses_see_new_version);
+    suite.addTest("Retired Versions Reclaimed", test_retired_versions_reclaimed);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
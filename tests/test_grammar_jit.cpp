@@ -0,0 +1,157 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/GrammarHandle.hpp"
+#include "../include/GrammarJit.hpp"
+#include <cstdlib>
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(BNF_NO_JIT)
+static const bool HAVE_JIT = true;
+#else
+static const bool HAVE_JIT = false;
+#endif
+
+static void buildRequestGrammar(Grammar& g) {
+    g.addRule("<d> ::= ( '0' ... '9' )");
+    g.addRule("<date> ::= <d> <d> <d> <d> '-' <d> <d> '-' <d> <d>");
+    g.addRule("<time> ::= <d> <d> ':' <d> <d>");
+    g.addRule("<stamp> ::= <date> | <date> 'T' <time> | <time>");
+    g.addRule("<method> ::= 'GET' | 'POST' | 'HEAD' | 'DELETE'");
+    g.addRule("<path> ::= '/' { ( 'a' ... 'z' '0' ... '9' '/' '.' ) }");
+    g.addRule("<line> ::= <method> ' ' <path> ' HTTP/1.1' [ ' ' <stamp> ]");
+}
+
+// Same result as the interpreter: match, length and full match
+static bool agrees(const GrammarJit& jit, const BNFParser& p, const std::string& rule, const std::string& input) {
+    size_t expected = 0, consumed = 0;
+    bool matched = p.match(rule, input, expected);
+    if (jit.match(rule, input, consumed) != matched) return false;
+    if (matched && consumed != expected) return false;
+    return jit.matchFull(rule, input) == p.matchFull(rule, input);
+}
+
+void test_native_rules(TestRunner& runner) {
+    Grammar g;
+    buildRequestGrammar(g);
+    GrammarJit jit(g);
+    ASSERT_EQ(runner, jit.available(), HAVE_JIT);
+    ASSERT_EQ(runner, jit.native("<line>"), HAVE_JIT);
+    ASSERT_FALSE(runner, jit.native("<missing>"));
+    if (HAVE_JIT) {
+        ASSERT_TRUE(runner, jit.codeSize() > 0);
+        ASSERT_EQ(runner, jit.fallbackReason("<line>"), std::string());
+    }
+
+    size_t consumed = 0;
+    ASSERT_TRUE(runner, jit.match("<stamp>", "2024-05-06T07:08", consumed));
+    ASSERT_EQ(runner, consumed, 16u);
+    // The longest branch wins, as in the interpreter
+    ASSERT_TRUE(runner, jit.match("<stamp>", "2024-05-06T07", consumed));
+    ASSERT_EQ(runner, consumed, 10u);
+    ASSERT_TRUE(runner, jit.matchFull("<line>", "GET /index.html HTTP/1.1 12:30"));
+    ASSERT_FALSE(runner, jit.matchFull("<line>", "PUT /index.html HTTP/1.1"));
+    ASSERT_FALSE(runner, jit.match("<line>", "GET /index.html HTTP/1.", consumed));
+    ASSERT_FALSE(runner, jit.match("<missing>", "GET", consumed));
+}
+
+void test_jump_table_alternatives(TestRunner& runner) {
+    Grammar g;
+    buildRequestGrammar(g);
+    g.addRule("<op> ::= '+' | '-' | '*' '*' | '*' | '/'");
+    g.addRule("<cmd> ::= 'get' ' ' <path> | 'put' ' ' <path> | 'del' ' ' <path> | 'stat'");
+    BNFParser p(g);
+    GrammarJit jit(g);
+
+    const char* ops[] = { "+", "-", "**", "*", "/", "%", "", "*/" };
+    for (size_t i = 0; i < 8; ++i)
+        ASSERT_TRUE(runner, agrees(jit, p, "<op>", ops[i]));
+    const char* cmds[] = { "get /a", "put /b/c", "del /", "stat", "sta", "get", "x", "delete" };
+    for (size_t i = 0; i < 8; ++i)
+        ASSERT_TRUE(runner, agrees(jit, p, "<cmd>", cmds[i]));
+    const char* methods[] = { "GET", "POST", "HEAD", "DELETE", "GETS", "DEL", "" };
+    for (size_t i = 0; i < 7; ++i)
+        ASSERT_TRUE(runner, agrees(jit, p, "<method>", methods[i]));
+}
+
+void test_differential(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<a> ::= 'ab' | 'a' | ( 'a' ... 'c' ) 'c'");
+    g.addRule("<b> ::= { <a> } [ 'x' ] ( ^ 'a' 'b' )");
+    g.addRule("<c> ::= !'ab' <a> <b> | &'b' ( 'b' ... 'c' ) { 'c' } | 'abcabcabc'");
+    g.addRule("<d> ::= { <c> | 'x' } 'y' | <b> <b>");
+    g.addRule("<e> ::= 'a' <e> | 'b' | 'c' 'x' | 'x'");
+    BNFParser p(g);
+    GrammarJit jit(g);
+
+    const char* rules[] = { "<a>", "<b>", "<c>", "<d>", "<e>" };
+    const std::string alphabet = "abcxy ";
+    bool same = true;
+    std::srand(96);
+    for (int i = 0; i < 2000 && same; ++i) {
+        std::string text;
+        size_t len = std::rand() % 12;
+        for (size_t j = 0; j < len; ++j)
+            text += alphabet[std::rand() % alphabet.size()];
+        for (size_t r = 0; r < 5; ++r)
+            if (!agrees(jit, p, rules[r], text)) same = false;
+    }
+    ASSERT_TRUE(runner, same);
+}
+
+void test_fallback_to_interpreter(TestRunner& runner) {
+    Grammar g;
+    buildRequestGrammar(g);
+    g.addRule("<header> ::= <word> ':' <value>");
+    g.addRule("<word> ::= ( 'a' ... 'z' ) { ( 'a' ... 'z' ) }");
+    BNFParser p(g);
+    GrammarJit jit(g);
+
+    // <value> is never defined: <header> and nothing else falls back
+    ASSERT_FALSE(runner, jit.native("<header>"));
+    ASSERT_FALSE(runner, jit.fallbackReason("<header>").empty());
+    ASSERT_EQ(runner, jit.native("<word>"), HAVE_JIT);
+    ASSERT_TRUE(runner, agrees(jit, p, "<header>", "host:x"));
+    ASSERT_TRUE(runner, agrees(jit, p, "<word>", "host:x"));
+
+    // With a skip rule everything is interpreted
+    Grammar spaced;
+    buildRequestGrammar(spaced);
+    spaced.addRule("<ws> ::= ( 0x20 )");
+    spaced.setSkipRule("<ws>");
+    BNFParser sp(spaced);
+    GrammarJit sjit(spaced);
+    ASSERT_FALSE(runner, sjit.available());
+    ASSERT_FALSE(runner, sjit.native("<stamp>"));
+    ASSERT_FALSE(runner, sjit.fallbackReason("<stamp>").empty());
+    ASSERT_TRUE(runner, agrees(sjit, sp, "<line>", "GET /  HTTP/1.1 "));
+    ASSERT_TRUE(runner, agrees(sjit, sp, "<stamp>", "07:08 "));
+}
+
+void test_snapshot(TestRunner& runner) {
+    Grammar* g = new Grammar();
+    buildRequestGrammar(*g);
+    GrammarHandle handle;
+    handle.publish(g);
+    GrammarHandle::Snapshot snapshot(handle);
+    GrammarJit jit(snapshot);
+
+    // A later version does not affect the one the JIT was built from
+    Grammar* next = new Grammar();
+    next->addRule("<line> ::= 'x'");
+    handle.publish(next);
+    ASSERT_EQ(runner, jit.native("<line>"), HAVE_JIT);
+    ASSERT_TRUE(runner, jit.matchFull("<line>", "HEAD / HTTP/1.1"));
+    ASSERT_FALSE(runner, jit.matchFull("<line>", "x"));
+}
+
+int main() {
+    TestSuite suite("Grammar JIT Test Suite");
+    suite.addTest("Native Rules", test_native_rules);
+    suite.addTest("Jump Table Alternatives", test_jump_table_alternatives);
+    suite.addTest("Differential", test_differential);
+    suite.addTest("Fallback To Interpreter", test_fallback_to_interpreter);
+    suite.addTest("Snapshot", test_snapshot);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
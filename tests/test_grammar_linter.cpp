@@ -0,0 +1,104 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/GrammarLinter.hpp"
+#include "../include/BNFParser.hpp"
+#include <sstream>
+
+static size_t countKind(const GrammarLinter& lint, LintWarning::Kind kind) {
+    size_t n = 0;
+    for (size_t i = 0; i < lint.warnings().size(); ++i)
+        if (lint.warnings()[i].kind == kind) ++n;
+    return n;
+}
+
+void test_clean_grammar(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<word> ::= <letter> { <letter> | <digit> }");
+    g.addRule("<number> ::= <digit> { <digit> }");
+    g.addRule("<item> ::= <word> | <number>");
+    g.addRule("<list> ::= <item> { ',' <item> }");
+
+    GrammarLinter lint(g);
+    ASSERT_TRUE(runner, lint.warnings().empty());
+    ASSERT_TRUE(runner, lint.complexity("<list>") == GrammarLinter::LINEAR);
+    ASSERT_TRUE(runner, lint.complexity("<missing>") == GrammarLinter::LINEAR);
+}
+
+void test_nested_repetition(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<a> ::= ( 'a' ... 'c' )");
+    g.addRule("<runs> ::= { { <a> } <a> }");
+    g.addRule("<as> ::= { <a> }");
+    g.addRule("<split> ::= { <as> ';' }");
+    g.addRule("<hidden> ::= { <as> <a> }");
+
+    GrammarLinter lint(g);
+    ASSERT_EQ(runner, countKind(lint, LintWarning::NESTED_REPETITION), 2u);
+    ASSERT_EQ(runner, lint.warnings()[0].rule, std::string("<runs>"));
+    // Reached through <as>
+    ASSERT_EQ(runner, lint.warnings()[1].rule, std::string("<hidden>"));
+    // Greedy repetition does not backtrack, so no super-linear estimate
+    ASSERT_TRUE(runner, lint.complexity("<runs>") == GrammarLinter::LINEAR);
+
+    // What the warning means here: the trailing <a> never gets a byte
+    BNFParser p(g);
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<runs>", "abc", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 0u);
+    delete ast;
+}
+
+void test_overlapping_branches_under_repetition(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<word> ::= <letter> { <letter> }");
+    g.addRule("<shout> ::= <word> '!'");
+    g.addRule("<text> ::= { <word> ' ' | <shout> ' ' }");
+    g.addRule("<codes> ::= { 'ab' | 'ac' }");
+    g.addRule("<once> ::= <word> | <shout>");
+
+    GrammarLinter lint(g);
+    ASSERT_EQ(runner, countKind(lint, LintWarning::OVERLAPPING_BRANCHES), 2u);
+    ASSERT_TRUE(runner, lint.complexity("<text>") == GrammarLinter::QUADRATIC);
+    // Bounded branches only cost a constant per iteration
+    ASSERT_TRUE(runner, lint.complexity("<codes>") == GrammarLinter::LINEAR);
+    // Not under a repetition
+    ASSERT_TRUE(runner, lint.complexity("<once>") == GrammarLinter::LINEAR);
+}
+
+void test_recursive_branches(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<num> ::= ( '0' ... '9' )");
+    g.addRule("<term> ::= '(' <expr> ')' | <num>");
+    g.addRule("<expr> ::= <term> '+' <expr> | <term>");
+    g.addRule("<stmt> ::= <expr> ';'");
+    g.addRule("<safe> ::= '(' <safe> ')' | <num>");
+
+    GrammarLinter lint(g);
+    ASSERT_EQ(runner, countKind(lint, LintWarning::RECURSIVE_BRANCHES), 1u);
+    ASSERT_TRUE(runner, lint.complexity("<expr>") == GrammarLinter::EXPONENTIAL);
+    // Inherited by every rule that uses it
+    ASSERT_TRUE(runner, lint.complexity("<stmt>") == GrammarLinter::EXPONENTIAL);
+    ASSERT_TRUE(runner, lint.complexity("<term>") == GrammarLinter::EXPONENTIAL);
+    ASSERT_TRUE(runner, lint.complexity("<safe>") == GrammarLinter::LINEAR);
+
+    std::ostringstream out;
+    lint.print(out);
+    ASSERT_TRUE(runner, out.str().find("<expr>: branches 1 and 2 can both start with '('") != std::string::npos);
+    ASSERT_TRUE(runner, out.str().find("<stmt>: worst case O(k^n)") != std::string::npos);
+    ASSERT_EQ(runner, std::string(GrammarLinter::describe(GrammarLinter::QUADRATIC)), std::string("O(n^2)"));
+}
+
+int main() {
+    TestSuite suite("Grammar Linter Test Suite");
+    suite.addTest("Clean Grammar", test_clean_grammar);
+    suite.addTest("Nested Repetition", test_nested_repetition);
+    suite.addTest("Overlapping Branches Under Repetition", test_overlapping_branches_under_repetition);
+    suite.addTest("Recursive Branches", test_recursive_branches);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
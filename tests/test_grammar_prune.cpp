@@ -0,0 +1,154 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include "../include/GrammarHandle.hpp"
+#include <cstdlib>
+
+static void buildShared(Grammar& g) {
+    g.addRule("<d> ::= ( '0' ... '9' )");
+    g.addRule("<num> ::= <d> { <d> } [ '.' <d> { <d> } ]");
+    g.addRule("~<letter> ::= 'a' ... 'z'");
+    g.addRule("@<word> ::= <letter> { <letter> }");
+    g.addRule("<value> ::= <num> | <word> | '(' <list> ')'");
+    g.addRule("<list> ::= <value> { ',' <value> }");
+    g.addRule("<assign> ::= <word> '=' <value> | !'=' <word>");
+    g.addRule("<header> ::= <word> ':' <text>");
+    g.addRule("<text> ::= { ( ^ 0x0A ) }");
+    g.addRule("<unused> ::= <header> <missing>");
+    g.addRule("<num> ::= 'hidden'");
+    g.addRule("<ws> ::= ( 0x20 0x09 )");
+    g.setSkipRule("<ws>");
+}
+
+static std::vector<std::string> names(const Grammar& g) {
+    std::vector<std::string> out;
+    for (size_t i = 0; i < g.getRules().size(); ++i)
+        out.push_back(g.getRules()[i]->name);
+    return out;
+}
+
+void test_reachable_rules(TestRunner& runner) {
+    Grammar g;
+    buildShared(g);
+    std::set<const Rule*> reached;
+    g.reachableRules(std::vector<std::string>(1, "<assign>"), reached);
+    // <assign>, <word>, <letter>, <value>, <num>, <d>, <list>
+    ASSERT_EQ(runner, reached.size(), 7u);
+    ASSERT_TRUE(runner, reached.count(g.getRule("<list>")) == 1);
+    ASSERT_TRUE(runner, reached.count(g.getRule("<header>")) == 0);
+    ASSERT_TRUE(runner, reached.count(g.getRules()[10]) == 0);
+
+    std::set<const Rule*> none;
+    g.reachableRules(std::vector<std::string>(1, "<missing>"), none);
+    ASSERT_TRUE(runner, none.empty());
+}
+
+void test_keeps_reachable_rules_in_order(TestRunner& runner) {
+    Grammar g;
+    buildShared(g);
+    Grammar pruned;
+    std::vector<std::string> starts;
+    starts.push_back("<header>");
+    starts.push_back("<nothing>");
+    pruned.addReachableRules(g, starts);
+
+    std::vector<std::string> got = names(pruned);
+    ASSERT_EQ(runner, got.size(), 5u);
+    ASSERT_EQ(runner, got[0], std::string("<letter>"));
+    ASSERT_EQ(runner, got[1], std::string("<word>"));
+    ASSERT_EQ(runner, got[2], std::string("<header>"));
+    ASSERT_EQ(runner, got[3], std::string("<text>"));
+    ASSERT_EQ(runner, got[4], std::string("<ws>"));
+    ASSERT_EQ(runner, pruned.getSkipRule(), std::string("<ws>"));
+    ASSERT_TRUE(runner, pruned.getRule("<letter>")->transparent);
+    ASSERT_TRUE(runner, pruned.getRule("<word>")->token);
+    ASSERT_EQ(runner, pruned.getRevision(), 6ul);
+
+    // Undefined references stay undefined; the hidden <num> is not copied
+    Grammar unused;
+    unused.addReachableRules(g, std::vector<std::string>(1, "<unused>"));
+    ASSERT_EQ(runner, unused.getRules().size(), 6u);
+    ASSERT_TRUE(runner, unused.getRule("<missing>") == 0);
+    Grammar numbers;
+    numbers.addReachableRules(g, std::vector<std::string>(1, "<num>"));
+    ASSERT_EQ(runner, numbers.getRules().size(), 3u);
+    BNFParser p(numbers);
+    ASSERT_TRUE(runner, p.matchFull("<num>", "3.14"));
+    ASSERT_FALSE(runner, p.matchFull("<num>", "hidden"));
+}
+
+void test_same_parses(TestRunner& runner) {
+    Grammar g;
+    buildShared(g);
+    Grammar pruned;
+    pruned.addReachableRules(g, std::vector<std::string>(1, "<assign>"));
+    BNFParser full(g);
+    BNFParser small(pruned);
+    ASSERT_TRUE(runner, small.compiledGrammar().nodeCount() < full.compiledGrammar().nodeCount());
+
+    const char* rules[] = { "<assign>", "<value>", "<list>", "<num>" };
+    const std::string alphabet = "ab1.=(), ";
+    bool same = true;
+    std::srand(100);
+    for (int i = 0; i < 2000 && same; ++i) {
+        std::string text;
+        size_t len = std::rand() % 12;
+        for (size_t j = 0; j < len; ++j)
+            text += alphabet[std::rand() % alphabet.size()];
+        const char* rule = rules[std::rand() % 4];
+        size_t a = 0, b = 0;
+        if (full.match(rule, text, a) != small.match(rule, text, b) || a != b) same = false;
+        if (full.matchFull(rule, text) != small.matchFull(rule, text)) same = false;
+    }
+    ASSERT_TRUE(runner, same);
+    ASSERT_TRUE(runner, small.matchFull("<assign>", "x = ( 1 , y , 2.5 )"));
+    ASSERT_FALSE(runner, small.matchFull("<header>", "x: y"));
+}
+
+void test_copies_are_independent(TestRunner& runner) {
+    Grammar* g = new Grammar();
+    buildShared(*g);
+    ExpressionInterner sourceInterner;
+    Grammar* shared = new Grammar();
+    shared->setInterner(&sourceInterner);
+    buildShared(*shared);
+
+    // Into an arena, and from an interned source into a plain grammar
+    Arena arena;
+    Grammar* pruned = new Grammar();
+    pruned->setArena(&arena);
+    pruned->addReachableRules(*g, std::vector<std::string>(1, "<list>"));
+    Grammar plain;
+    plain.addReachableRules(*shared, std::vector<std::string>(1, "<list>"));
+    delete g;
+    delete shared;
+
+    GrammarHandle handle;
+    handle.publish(pruned);
+    GrammarHandle::Snapshot snapshot(handle);
+    BNFParser p(snapshot);
+    ASSERT_TRUE(runner, p.matchFull("<list>", "1, (ab, 2)"));
+    ASSERT_FALSE(runner, p.matchFull("<list>", "1,,2"));
+    BNFParser q(plain);
+    ASSERT_TRUE(runner, q.matchFull("<list>", "1, (ab, 2)"));
+
+    // Interning the copies shares them again
+    ExpressionInterner interner;
+    Grammar interned;
+    interned.setInterner(&interner);
+    interned.addReachableRules(plain, std::vector<std::string>(1, "<list>"));
+    ASSERT_EQ(runner, interned.getRule("<num>")->rootExpr->children[1]->children[0],
+              interned.getRule("<num>")->rootExpr->children[0]);
+}
+
+int main() {
+    TestSuite suite("Grammar Prune Test Suite");
+    suite.addTest("Reachable Rules", test_reachable_rules);
+    suite.addTest("Keeps Reachable Rules In Order", test_keeps_reachable_rules_in_order);
+    suite.addTest("Same Parses", test_same_parses);
+    suite.addTest("Copies Are Independent", test_copies_are_independent);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
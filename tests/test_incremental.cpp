@@ -0,0 +1,218 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/IncrementalParser.hpp"
+#include <sstream>
+#include <string>
+
+static void buildConfigGrammar(Grammar& g) {
+    g.addRule("<letter> ::= ( 'a' ... 'z' 'A' ... 'Z' '_' )");
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<ws> ::= { ' ' }");
+    g.addRule("<key> ::= <letter> { <letter> | <digit> }");
+    g.addRule("<number> ::= <digit> { <digit> }");
+    g.addRule("<value> ::= <number> | <key>");
+    g.addRule("<line> ::= <key> <ws> '=' <ws> <value> ( 0x0A )");
+    g.addRule("<doc> ::= { <line> }");
+}
+
+static void buildStatementGrammar(Grammar& g) {
+    g.addRule("<ws> ::= ( ' ' 0x0A )");
+    g.addRule("<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("@<ident> ::= <letter> { <letter> }");
+    g.addRule("@<num> ::= <digit> { <digit> }");
+    g.addRule("<assign> ::= <ident> '=' <num> ';'");
+    g.addRule("<doc> ::= { <assign> }");
+    g.setSkipRule("<ws>");
+}
+
+static std::string buildDocument(int lines) {
+    std::ostringstream oss;
+    for (int i = 0; i < lines; ++i)
+        oss << "key" << i << " = " << (i * 7) << "\n";
+    return oss.str();
+}
+
+// Reparse result must be identical to a from-scratch parse of the same text
+static void checkAgainstFullParse(TestRunner& runner, const BNFParser& p,
+                                  const IncrementalParser& inc, size_t consumed) {
+    size_t fullConsumed = 0;
+    ASTNode* full = p.parse("<doc>", inc.text(), fullConsumed);
+    ASSERT_EQ(runner, consumed, fullConsumed);
+    ASSERT_EQ(runner, formatAST(inc.tree()), formatAST(full));
+    delete full;
+}
+
+void test_incremental_initial_parse(TestRunner& runner) {
+    Grammar g;
+    buildConfigGrammar(g);
+    BNFParser p(g);
+    IncrementalParser inc(p, "<doc>");
+
+    std::string doc = buildDocument(10);
+    size_t consumed = 0;
+    const ASTNode* tree = inc.parse(doc, consumed);
+    ASSERT_NOT_NULL(runner, tree);
+    ASSERT_EQ(runner, consumed, doc.size());
+    ASSERT_EQ(runner, inc.reusedCount(), 0u);
+    checkAgainstFullParse(runner, p, inc, consumed);
+}
+
+void test_incremental_edit_value(TestRunner& runner) {
+    Grammar g;
+    buildConfigGrammar(g);
+    BNFParser p(g);
+    IncrementalParser inc(p, "<doc>");
+
+    std::string doc = buildDocument(40);
+    size_t consumed = 0;
+    inc.parse(doc, consumed);
+
+    // Replace the value of key20 ("140") with "99"
+    size_t at = doc.find("key20 = ") + 8;
+    const ASTNode* tree = inc.reparse(TextEdit(at, 3, "99"), consumed);
+    ASSERT_NOT_NULL(runner, tree);
+    ASSERT_EQ(runner, consumed, inc.text().size());
+    ASSERT_TRUE(runner, inc.text().find("key20 = 99\n") != std::string::npos);
+    // Every other line is reused as a whole
+    ASSERT_GE(runner, inc.reusedCount(), 39u);
+    checkAgainstFullParse(runner, p, inc, consumed);
+}
+
+void test_incremental_insert_and_delete_lines(TestRunner& runner) {
+    Grammar g;
+    buildConfigGrammar(g);
+    BNFParser p(g);
+    IncrementalParser inc(p, "<doc>");
+
+    std::string doc = buildDocument(30);
+    size_t consumed = 0;
+    inc.parse(doc, consumed);
+
+    size_t at = inc.text().find("key10");
+    inc.reparse(TextEdit(at, 0, "inserted = 1\n"), consumed);
+    ASSERT_EQ(runner, consumed, inc.text().size());
+    ASSERT_GT(runner, inc.reusedCount(), 0u);
+    checkAgainstFullParse(runner, p, inc, consumed);
+
+    at = inc.text().find("key3 ");
+    size_t len = inc.text().find('\n', at) + 1 - at;
+    inc.reparse(TextEdit(at, len, ""), consumed);
+    ASSERT_EQ(runner, consumed, inc.text().size());
+    ASSERT_GT(runner, inc.reusedCount(), 0u);
+    checkAgainstFullParse(runner, p, inc, consumed);
+}
+
+void test_incremental_edits_at_boundaries(TestRunner& runner) {
+    Grammar g;
+    buildConfigGrammar(g);
+    BNFParser p(g);
+    IncrementalParser inc(p, "<doc>");
+
+    size_t consumed = 0;
+    inc.parse(buildDocument(5), consumed);
+
+    // Appending touches the end-of-input check of the last line only
+    inc.reparse(TextEdit(inc.text().size(), 0, "tail = 5\n"), consumed);
+    ASSERT_EQ(runner, consumed, inc.text().size());
+    checkAgainstFullParse(runner, p, inc, consumed);
+
+    inc.reparse(TextEdit(0, 0, "head = 0\n"), consumed);
+    ASSERT_EQ(runner, consumed, inc.text().size());
+    checkAgainstFullParse(runner, p, inc, consumed);
+
+    // Extending a key in place changes the token it belongs to
+    inc.reparse(TextEdit(4, 0, "er"), consumed);
+    ASSERT_TRUE(runner, inc.text().find("header = 0") != std::string::npos);
+    checkAgainstFullParse(runner, p, inc, consumed);
+}
+
+void test_incremental_broken_then_fixed(TestRunner& runner) {
+    Grammar g;
+    buildConfigGrammar(g);
+    BNFParser p(g);
+    IncrementalParser inc(p, "<doc>");
+
+    std::string doc = buildDocument(8);
+    size_t consumed = 0;
+    inc.parse(doc, consumed);
+
+    // Breaking line 4 makes the repetition stop early
+    size_t at = inc.text().find("key4 =") + 5;
+    inc.reparse(TextEdit(at, 1, "!"), consumed);
+    ASSERT_LT(runner, consumed, inc.text().size());
+    checkAgainstFullParse(runner, p, inc, consumed);
+
+    // Repairing it brings the whole document back
+    inc.reparse(TextEdit(at, 1, "="), consumed);
+    ASSERT_EQ(runner, consumed, inc.text().size());
+    ASSERT_EQ(runner, inc.text(), doc);
+    checkAgainstFullParse(runner, p, inc, consumed);
+}
+
+void test_incremental_many_small_edits(TestRunner& runner) {
+    Grammar g;
+    buildConfigGrammar(g);
+    BNFParser p(g);
+    IncrementalParser inc(p, "<doc>");
+
+    size_t consumed = 0;
+    inc.parse(buildDocument(20), consumed);
+
+    // Type a new value character by character, as an editor would
+    size_t at = inc.text().find("key12 = ") + 8;
+    inc.reparse(TextEdit(at, 2, ""), consumed);
+    checkAgainstFullParse(runner, p, inc, consumed);
+    const char* typed = "abc123";
+    for (size_t i = 0; typed[i]; ++i) {
+        inc.reparse(TextEdit(at + i, 0, std::string(1, typed[i])), consumed);
+        checkAgainstFullParse(runner, p, inc, consumed);
+    }
+    ASSERT_TRUE(runner, inc.text().find("key12 = abc123\n") != std::string::npos);
+    ASSERT_EQ(runner, consumed, inc.text().size());
+}
+
+void test_incremental_skipped_whitespace(TestRunner& runner) {
+    Grammar g;
+    buildStatementGrammar(g);
+    BNFParser p(g);
+    IncrementalParser inc(p, "<doc>");
+
+    // Every statement after the first starts with skipped whitespace that is
+    // consumed by its node but not part of its text
+    std::string doc = "a = 1;\n   b = 22;\n   c = 333;\n   d = 4;\n";
+    size_t consumed = 0;
+    inc.parse(doc, consumed);
+    checkAgainstFullParse(runner, p, inc, consumed);
+
+    // The trailing newline is left unconsumed
+    inc.reparse(TextEdit(4, 1, "9"), consumed);
+    ASSERT_EQ(runner, consumed, inc.text().size() - 1);
+    ASSERT_GE(runner, inc.reusedCount(), 3u);
+    checkAgainstFullParse(runner, p, inc, consumed);
+
+    // Edits inside the skipped runs and after the last statement
+    size_t at = inc.text().find("c =");
+    inc.reparse(TextEdit(at - 2, 2, "\n\n\n"), consumed);
+    checkAgainstFullParse(runner, p, inc, consumed);
+    inc.reparse(TextEdit(inc.text().size(), 0, "  e = 55;  "), consumed);
+    checkAgainstFullParse(runner, p, inc, consumed);
+    inc.reparse(TextEdit(at, 1, "cc"), consumed);
+    ASSERT_EQ(runner, consumed, inc.text().size() - 2);
+    checkAgainstFullParse(runner, p, inc, consumed);
+}
+
+int main() {
+    TestSuite suite("Incremental Reparse Test Suite");
+    suite.addTest("Initial Parse", test_incremental_initial_parse);
+    suite.addTest("Edit Value", test_incremental_edit_value);
+    suite.addTest("Insert and Delete Lines", test_incremental_insert_and_delete_lines);
+    suite.addTest("Edits at Boundaries", test_incremental_edits_at_boundaries);
+    suite.addTest("Broken then Fixed", test_incremental_broken_then_fixed);
+    suite.addTest("Many Small Edits", test_incremental_many_small_edits);
+    suite.addTest("Skipped Whitespace", test_incremental_skipped_whitespace);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
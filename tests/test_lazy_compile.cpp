@@ -0,0 +1,190 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/GrammarHandle.hpp"
+#include <cstdlib>
+
+static void buildGrammar(Grammar& g) {
+    g.addRule("<d> ::= ( '0' ... '9' )");
+    g.addRule("<num> ::= <d> { <d> }");
+    g.addRule("<sum> ::= <num> { '+' <num> }");
+    g.addRule("<word> ::= ( 'a' ... 'z' ) { ( 'a' ... 'z' ) }");
+    g.addRule("<pair> ::= <word> '=' <sum> | <word>");
+    g.addRule("<list> ::= <pair> { ',' <pair> }");
+    g.addRule("<ws> ::= ( 0x20 )");
+    g.setSkipRule("<ws>");
+}
+
+void test_subset_compile(TestRunner& runner) {
+    Grammar g;
+    buildGrammar(g);
+    CompiledGrammar full(g);
+    std::vector<std::string> start(1, "<sum>");
+    CompiledGrammar subset(g, start);
+
+    // <sum>, <num>, <d> and the skip rule
+    ASSERT_EQ(runner, subset.ruleCount(), 4u);
+    ASSERT_TRUE(runner, subset.nodeCount() < full.nodeCount());
+    ASSERT_TRUE(runner, subset.findRule("<d>") != CompiledGrammar::NO_RULE);
+    ASSERT_TRUE(runner, subset.findRule("<ws>") != CompiledGrammar::NO_RULE);
+    ASSERT_EQ(runner, subset.findRule("<word>"), CompiledGrammar::NO_RULE);
+    ASSERT_EQ(runner, subset.findRule("<list>"), CompiledGrammar::NO_RULE);
+}
+
+void test_add_start_rule_reuses_nodes(TestRunner& runner) {
+    Grammar g;
+    buildGrammar(g);
+    CompiledGrammar cg(g, std::vector<std::string>(1, "<num>"));
+    std::vector<CompiledGrammar::Node> before;
+    for (unsigned int id = 0; id < cg.nodeCount(); ++id)
+        before.push_back(cg.node(id));
+    unsigned int num = cg.findRule("<num>");
+    unsigned int d = cg.findRule("<d>");
+    size_t edges = cg.edgeCount();
+
+    ASSERT_TRUE(runner, cg.addStartRule(g, "<sum>"));
+    ASSERT_EQ(runner, cg.ruleCount(), 4u);
+    ASSERT_TRUE(runner, cg.nodeCount() > before.size());
+    // Earlier rules and nodes keep their numbers and tables
+    ASSERT_EQ(runner, cg.findRule("<num>"), num);
+    ASSERT_EQ(runner, cg.findRule("<d>"), d);
+    bool same = true;
+    for (unsigned int id = 0; id < before.size(); ++id) {
+        const CompiledGrammar::Node& n = cg.node(id);
+        same = same && n.kind == before[id].kind && n.flags == before[id].flags && n.a == before[id].a
+               && n.b == before[id].b && n.first == before[id].first && n.minLen == before[id].minLen;
+    }
+    ASSERT_TRUE(runner, same);
+    ASSERT_TRUE(runner, cg.edgeCount() > edges);
+
+    // Only <sum>'s own nodes were added: as many as compiling both at once
+    std::vector<std::string> both;
+    both.push_back("<num>");
+    both.push_back("<sum>");
+    CompiledGrammar fresh(g, both);
+    ASSERT_EQ(runner, cg.nodeCount(), fresh.nodeCount());
+    unsigned int sum = cg.rule(cg.findRule("<sum>")).root;
+    unsigned int freshSum = fresh.rule(fresh.findRule("<sum>")).root;
+    ASSERT_EQ(runner, cg.minLength(sum), fresh.minLength(freshSum));
+    ASSERT_EQ(runner, cg.maxLength(sum), fresh.maxLength(freshSum));
+    ASSERT_TRUE(runner, cg.first(cg.node(sum)) == fresh.first(fresh.node(freshSum)));
+
+    // Known rules add nothing, unknown ones are refused
+    size_t nodes = cg.nodeCount();
+    ASSERT_TRUE(runner, cg.addStartRule(g, "<d>"));
+    ASSERT_FALSE(runner, cg.addStartRule(g, "<missing>"));
+    ASSERT_EQ(runner, cg.nodeCount(), nodes);
+
+    // A lazy parser grows its compilation instead of replacing it
+    BNFParser p(g);
+    p.compileLazily(std::vector<std::string>(1, "<num>"));
+    const CompiledGrammar* compiled = &p.compiledGrammar();
+    ASSERT_TRUE(runner, p.matchFull("<sum>", "1 + 2"));
+    ASSERT_TRUE(runner, p.matchFull("<list>", "a = 1 , b"));
+    ASSERT_EQ(runner, &p.compiledGrammar(), compiled);
+    ASSERT_EQ(runner, p.compiledGrammar().ruleCount(), 7u);
+}
+
+void test_lazy_parser_matches_full(TestRunner& runner) {
+    Grammar g;
+    buildGrammar(g);
+    BNFParser full(g);
+    BNFParser lazy(g);
+    lazy.compileLazily(std::vector<std::string>(1, "<num>"));
+    ASSERT_EQ(runner, lazy.compiledGrammar().ruleCount(), 3u);
+
+    const char* rules[] = { "<num>", "<word>", "<sum>", "<pair>", "<list>" };
+    const std::string alphabet = "ab1+=, ";
+    bool same = true;
+    std::srand(98);
+    for (int i = 0; i < 1000 && same; ++i) {
+        std::string text;
+        size_t len = std::rand() % 10;
+        for (size_t j = 0; j < len; ++j)
+            text += alphabet[std::rand() % alphabet.size()];
+        const char* rule = rules[std::rand() % 5];
+        if (full.matchFull(rule, text) != lazy.matchFull(rule, text)) same = false;
+        size_t a = 0, b = 0;
+        ASTNode* x = full.parse(rule, text, a);
+        ASTNode* y = lazy.parse(rule, text, b);
+        if ((x == 0) != (y == 0) || a != b) same = false;
+        delete x;
+        delete y;
+    }
+    ASSERT_TRUE(runner, same);
+    // Every rule is reachable from <list>, which was reached
+    ASSERT_EQ(runner, lazy.compiledGrammar().ruleCount(), full.compiledGrammar().ruleCount());
+}
+
+void test_lazy_snapshot(TestRunner& runner) {
+    Grammar* g = new Grammar();
+    buildGrammar(*g);
+    GrammarHandle handle;
+    handle.publishLazy(g, std::vector<std::string>(1, "<word>"));
+    GrammarHandle::Snapshot snapshot(handle);
+    ASSERT_TRUE(runner, snapshot.lazy());
+
+    const CompiledGrammar& before = snapshot.compiled();
+    ASSERT_EQ(runner, before.ruleCount(), 2u);
+    ASSERT_EQ(runner, &snapshot.compiledFor("<word>"), &before);
+    // Unknown rules do not cause a compilation
+    ASSERT_EQ(runner, &snapshot.compiledFor("<missing>"), &before);
+
+    // A shared compilation cannot grow in place, so a miss extends a copy:
+    // <pair> brings <sum>, <num> and <d>, and the earlier rules keep their nodes
+    const CompiledGrammar& after = snapshot.compiledFor("<pair>");
+    ASSERT_TRUE(runner, &after != &before);
+    ASSERT_EQ(runner, after.ruleCount(), 6u);
+    ASSERT_TRUE(runner, after.findRule("<sum>") != CompiledGrammar::NO_RULE);
+    ASSERT_EQ(runner, after.findRule("<list>"), CompiledGrammar::NO_RULE);
+    ASSERT_EQ(runner, after.findRule("<word>"), before.findRule("<word>"));
+    bool same = true;
+    for (unsigned int id = 0; id < before.nodeCount(); ++id)
+        same = same && after.node(id).kind == before.node(id).kind && after.node(id).a == before.node(id).a
+               && after.node(id).first == before.node(id).first;
+    ASSERT_TRUE(runner, same);
+    ASSERT_EQ(runner, &snapshot.compiled(), &after);
+    ASSERT_EQ(runner, &snapshot.compiledFor("<sum>"), &after);
+    // The earlier compilation stays usable while the version is pinned
+    ASSERT_EQ(runner, before.findRule("<pair>"), CompiledGrammar::NO_RULE);
+    ASSERT_TRUE(runner, before.findRule("<word>") != CompiledGrammar::NO_RULE);
+
+    // Parsers on the snapshot extend the shared version again
+    BNFParser p(snapshot);
+    ASSERT_TRUE(runner, p.matchFull("<list>", "a = 1 + 2 , b"));
+    ASSERT_FALSE(runner, p.matchFull("<list>", "a = , b"));
+    const CompiledGrammar& last = snapshot.compiled();
+    ASSERT_TRUE(runner, &last != &after);
+    ASSERT_EQ(runner, last.ruleCount(), 7u);
+    ASSERT_EQ(runner, last.findRule("<pair>"), after.findRule("<pair>"));
+    ASSERT_EQ(runner, after.findRule("<list>"), CompiledGrammar::NO_RULE);
+
+    GrammarHandle::Snapshot copy(snapshot);
+    ASSERT_EQ(runner, &copy.compiled(), &snapshot.compiled());
+}
+
+void test_rules_added_later(TestRunner& runner) {
+    Grammar g;
+    buildGrammar(g);
+    BNFParser p(g);
+    p.compileLazily(std::vector<std::string>(1, "<list>"));
+    ASSERT_TRUE(runner, p.matchFull("<list>", "a=1,b"));
+
+    g.addRule("<assign> ::= <word> ':=' <sum> ';'");
+    ASSERT_TRUE(runner, p.matchFull("<assign>", "x := 1 + 2;"));
+    ASSERT_FALSE(runner, p.matchFull("<assign>", "x := ;"));
+    ASSERT_TRUE(runner, p.matchFull("<list>", "a=1,b"));
+}
+
+int main() {
+    TestSuite suite("Lazy Compilation Test Suite");
+    suite.addTest("Subset Compile", test_subset_compile);
+    suite.addTest("Add Start Rule Reuses Nodes", test_add_start_rule_reuses_nodes);
+    suite.addTest("Lazy Parser Matches Full", test_lazy_parser_matches_full);
+    suite.addTest("Lazy Snapshot", test_lazy_snapshot);
+    suite.addTest("Rules Added Later", test_rules_added_later);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include "../include/BNFParser.hpp"
+#include <sstream>
+
+static unsigned int rootOf(const CompiledGrammar& cg, const std::string& name) {
+    return cg.rule(cg.findRule(name)).root;
+}
+
+void test_lengths_fixed(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<date> ::= <digit> <digit> <digit> <digit> '-' <digit> <digit> '-' <digit> <digit>");
+    g.addRule("<cmd> ::= 'JOIN' | 'PRIVMSG' | 'NICK'");
+    g.addRule("<sign> ::= [ '-' ] <digit>");
+
+    CompiledGrammar cg(g);
+    ASSERT_EQ(runner, cg.minLength(rootOf(cg, "<date>")), 10u);
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<date>")), 10u);
+    ASSERT_EQ(runner, cg.minLength(rootOf(cg, "<cmd>")), 4u);
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<cmd>")), 7u);
+    ASSERT_EQ(runner, cg.minLength(rootOf(cg, "<sign>")), 1u);
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<sign>")), 2u);
+    ASSERT_EQ(runner, static_cast<unsigned int>(cg.node(rootOf(cg, "<date>")).minLen), 10u);
+}
+
+void test_lengths_unbounded(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<num> ::= <digit> { <digit> }");
+    g.addRule("<nest> ::= 'x' | '(' <nest> ')'");
+    g.addRule("<loop> ::= 'a' <loop>");
+    g.addRule("<empty-rep> ::= { [ 'a' ] }");
+
+    CompiledGrammar cg(g);
+    ASSERT_EQ(runner, cg.minLength(rootOf(cg, "<num>")), 1u);
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<num>")), CompiledGrammar::UNBOUNDED);
+    ASSERT_EQ(runner, cg.minLength(rootOf(cg, "<nest>")), 1u);
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<nest>")), CompiledGrammar::UNBOUNDED);
+    // Never terminates, so it can never match
+    ASSERT_EQ(runner, cg.minLength(rootOf(cg, "<loop>")), CompiledGrammar::UNBOUNDED);
+    ASSERT_EQ(runner, static_cast<unsigned int>(cg.node(rootOf(cg, "<loop>")).minLen), 0xFFFFu);
+    ASSERT_EQ(runner, cg.minLength(rootOf(cg, "<empty-rep>")), 0u);
+}
+
+void test_lengths_cycles(TestRunner& runner) {
+    Grammar g;
+    // Recursion that consumes nothing keeps a bounded maximum
+    g.addRule("<a> ::= <b> | 'xy'");
+    g.addRule("<b> ::= [ <a> ]");
+    // A predicate operand matches nothing, so this is not a cycle that consumes input
+    g.addRule("<p> ::= 'q' | &<p> 'z'");
+    // Two references around the cycle double its length
+    g.addRule("<twice> ::= '' | <twice> <twice> | 'k'");
+
+    CompiledGrammar cg(g);
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<a>")), 2u);
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<b>")), 2u);
+    ASSERT_EQ(runner, cg.minLength(rootOf(cg, "<b>")), 0u);
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<p>")), 1u);
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<twice>")), CompiledGrammar::UNBOUNDED);
+}
+
+void test_lengths_long_chain(TestRunner& runner) {
+    // Each rule extends the previous one; the lengths still come out in one pass
+    const unsigned int count = 5000;
+    Grammar g;
+    g.addRule("<r0> ::= 'c'");
+    for (unsigned int i = 1; i < count; ++i) {
+        std::ostringstream rule;
+        rule << "<r" << i << "> ::= <r" << i - 1 << "> 'b' | 'c'";
+        g.addRule(rule.str());
+    }
+    g.addRule("<list> ::= <r0> | <r0> ',' <list>");
+
+    CompiledGrammar cg(g);
+    std::ostringstream last;
+    last << "<r" << count - 1 << ">";
+    unsigned int root = rootOf(cg, last.str());
+    ASSERT_EQ(runner, cg.minLength(root), 1u);
+    ASSERT_EQ(runner, cg.maxLength(root), count);
+    ASSERT_TRUE(runner, cg.first(cg.node(root)).test('c'));
+    ASSERT_FALSE(runner, cg.first(cg.node(root)).test('b'));
+    ASSERT_EQ(runner, cg.maxLength(rootOf(cg, "<list>")), CompiledGrammar::UNBOUNDED);
+}
+
+void test_lengths_skip_keeps_results(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<long> ::= <digit> <digit> <digit> <digit> <digit> <digit>");
+    g.addRule("<s> ::= <long> | <digit> <digit> | <digit>");
+    g.addRule("<list> ::= { <long> } { <digit> }");
+
+    BNFParser p(g);
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<s>", "12345", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 2u);
+    delete ast;
+
+    ast = p.parse("<s>", "123456", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 6u);
+    delete ast;
+
+    // The first repetition stops once fewer than six bytes are left
+    ast = p.parse("<list>", "1234567890", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 10u);
+    ASSERT_EQ(runner, ast->children[0]->children.size(), 1u);
+    ASSERT_EQ(runner, ast->children[1]->children.size(), 4u);
+    delete ast;
+}
+
+void test_parse_full(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<date> ::= <digit> <digit> <digit> <digit> '-' <digit> <digit> '-' <digit> <digit>");
+    g.addRule("<num> ::= <digit> { <digit> }");
+
+    BNFParser p(g);
+    ASTNode* ast = p.parseFull("<date>", "2024-05-17");
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, ast->matched, std::string("2024-05-17"));
+    delete ast;
+
+    // Too long and too short are rejected by length alone
+    ASSERT_NULL(runner, p.parseFull("<date>", "2024-05-17T10:00"));
+    ASSERT_NULL(runner, p.parseFull("<date>", "2024-05"));
+    ASSERT_NULL(runner, p.parseFull("<num>", ""));
+
+    // A prefix match is not a full match
+    ASSERT_NULL(runner, p.parseFull("<num>", "123x"));
+    ast = p.parseFull("<num>", "123");
+    ASSERT_NOT_NULL(runner, ast);
+    delete ast;
+}
+
+int main() {
+    TestSuite suite("Length Bounds Test Suite");
+    suite.addTest("Fixed Lengths", test_lengths_fixed);
+    suite.addTest("Unbounded Lengths", test_lengths_unbounded);
+    suite.addTest("Cycles", test_lengths_cycles);
+    suite.addTest("Long Rule Chain", test_lengths_long_chain);
+    suite.addTest("Skipping Keeps Results", test_lengths_skip_keeps_results);
+    suite.addTest("Full Match", test_parse_full);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+
+static void buildStatementGrammar(Grammar& g) {
+    g.addRule("<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<name> ::= <letter> { <letter> }");
+    g.addRule("<num> ::= <digit> { <digit> }");
+    g.addRule("<call> ::= <name> '(' ')'");
+    g.addRule("<assign> ::= <name> '=' <name>");
+    g.addRule("<stmt> ::= <call> | <assign>");
+}
+
+static void buildExprGrammar(Grammar& g) {
+    g.addRule("<num> ::= ( '0' ... '9' )");
+    g.addRule("<term> ::= '(' <expr> ')' | <num>");
+    g.addRule("<expr> ::= <term> '+' <expr> | <term>");
+}
+
+static unsigned long treeSize(const ASTNode* n) {
+    if (!n) return 0;
+    unsigned long size = 1;
+    for (size_t i = 0; i < n->children.size(); ++i)
+        size += treeSize(n->children[i]);
+    return size;
+}
+
+static std::string nested(size_t depth) {
+    return std::string(depth, '(') + "1" + std::string(depth, ')');
+}
+
+void test_stats_of_deterministic_parse(TestRunner& runner) {
+    Grammar g;
+    buildStatementGrammar(g);
+    BNFParser p(g);
+    ParseStats stats;
+    p.collectStats(&stats);
+
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<num>", "12345", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    unsigned long size = treeSize(ast);
+    ASSERT_EQ(runner, stats.nodesCreated, size);
+    ASSERT_EQ(runner, stats.nodesDiscarded, 0ul);
+    ASSERT_EQ(runner, stats.backtrackedBytes, 0ul);
+    ASSERT_TRUE(runner, stats.expressions >= 5);
+    ASSERT_TRUE(runner, stats.maxDepth >= 3);
+    delete ast;
+}
+
+void test_stats_count_backtracking(TestRunner& runner) {
+    Grammar g;
+    buildStatementGrammar(g);
+    BNFParser p(g);
+    ParseStats stats;
+    p.collectStats(&stats);
+
+    // <call> matches "abc", fails at '=' and gives the name back
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<stmt>", "abc=d", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, stats.backtrackedBytes, 3ul);
+    ASSERT_TRUE(runner, stats.nodesDiscarded > 0);
+    unsigned long size = treeSize(ast);
+    ASSERT_EQ(runner, stats.nodesCreated - stats.nodesDiscarded, size);
+    delete ast;
+
+    // A failed parse discards everything it built
+    ast = p.parse("<stmt>", "abc+", consumed);
+    ASSERT_NULL(runner, ast);
+    ASSERT_EQ(runner, stats.nodesCreated, stats.nodesDiscarded);
+    ASSERT_EQ(runner, stats.backtrackedBytes, 6ul);
+}
+
+void test_stats_reset_per_call(TestRunner& runner) {
+    Grammar g;
+    buildStatementGrammar(g);
+    BNFParser p(g);
+    ParseStats stats;
+    p.collectStats(&stats);
+
+    size_t consumed = 0;
+    delete p.parse("<stmt>", "abc=d", consumed);
+    ASSERT_TRUE(runner, p.matchFull("<stmt>", "f()"));
+    ASSERT_EQ(runner, stats.nodesCreated, 0ul);
+    ASSERT_EQ(runner, stats.backtrackedBytes, 0ul);
+    ASSERT_TRUE(runner, stats.expressions > 0);
+
+    // A full match that stops short gives its bytes back
+    ASSERT_FALSE(runner, p.matchFull("<num>", "12a"));
+    ASSERT_EQ(runner, stats.backtrackedBytes, 2ul);
+
+    std::vector<SearchMatch> matches;
+    p.search("<num>", "a1b22", matches);
+    ASSERT_EQ(runner, matches.size(), 2u);
+    ASSERT_EQ(runner, stats.nodesCreated, 0ul);
+
+    p.collectStats(0);
+    unsigned long expressions = stats.expressions;
+    delete p.parse("<stmt>", "abc=d", consumed);
+    ASSERT_EQ(runner, stats.expressions, expressions);
+}
+
+void test_stats_flag_pathological_input(TestRunner& runner) {
+    Grammar g;
+    buildExprGrammar(g);
+    BNFParser p(g);
+    ParseStats stats;
+    p.collectStats(&stats);
+
+    size_t consumed = 0;
+    delete p.parse("<expr>", nested(8), consumed);
+    unsigned long shallow = stats.expressions;
+    unsigned int shallowDepth = stats.maxDepth;
+    delete p.parse("<expr>", nested(10), consumed);
+    unsigned long deep = stats.expressions;
+
+    // Each nesting level doubles the work: two levels quadruple it
+    ASSERT_TRUE(runner, deep > 3 * shallow);
+    ASSERT_TRUE(runner, stats.maxDepth > shallowDepth);
+    ASSERT_TRUE(runner, stats.backtrackedBytes > 10 * consumed);
+
+    // With the retried rules memoized the work grows with the input
+    p.memoize(BNFParser::MEMO_REENTRANT);
+    delete p.parse("<expr>", nested(8), consumed);
+    shallow = stats.expressions;
+    delete p.parse("<expr>", nested(10), consumed);
+    deep = stats.expressions;
+    ASSERT_TRUE(runner, deep < 2 * shallow);
+}
+
+int main() {
+    TestSuite suite("Parse Stats Test Suite");
+    suite.addTest("Deterministic Parse", test_stats_of_deterministic_parse);
+    suite.addTest("Count Backtracking", test_stats_count_backtracking);
+    suite.addTest("Reset Per Call", test_stats_reset_per_call);
+    suite.addTest("Flag Pathological Input", test_stats_flag_pathological_input);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
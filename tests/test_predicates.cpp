@@ -0,0 +1,131 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFTokenizer.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/SemanticActions.hpp"
+
+static bool treeHasNull(const ASTNode* n) {
+    for (size_t i = 0; i < n->children.size(); ++i)
+        if (!n->children[i] || treeHasNull(n->children[i])) return true;
+    return false;
+}
+
+static void buildIdentifierGrammar(Grammar& g) {
+    g.addRule("~<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<word> ::= <letter> { <letter> }");
+    g.addRule("<reserved> ::= 'if' | 'else' | 'while'");
+    g.addRule("<keyword> ::= <reserved> !<letter>");
+    g.addRule("<ident> ::= !<keyword> <word>");
+}
+
+void test_predicate_tokens_and_grammar(TestRunner& runner) {
+    BNFTokenizer tz("& ! <a>");
+    Token amp = tz.next();
+    Token bang = tz.next();
+    Token sym = tz.next();
+    ASSERT_EQ(runner, amp.type, Token::TOK_AMPERSAND);
+    ASSERT_EQ(runner, bang.type, Token::TOK_BANG);
+    ASSERT_EQ(runner, sym.type, Token::TOK_SYMBOL);
+
+    Grammar g;
+    g.addRule("<s> ::= &'a' !<b> 'a'");
+    Rule* r = g.getRule("<s>");
+    ASSERT_NOT_NULL(runner, r);
+    ASSERT_EQ(runner, r->rootExpr->type, Expression::EXPR_SEQUENCE);
+    ASSERT_EQ(runner, r->rootExpr->children[0]->type, Expression::EXPR_AND_PREDICATE);
+    ASSERT_EQ(runner, r->rootExpr->children[1]->type, Expression::EXPR_NOT_PREDICATE);
+    ASSERT_EQ(runner, r->rootExpr->children[1]->children[0]->type, Expression::EXPR_SYMBOL);
+}
+
+void test_not_predicate_rejects_keywords(TestRunner& runner) {
+    Grammar g;
+    buildIdentifierGrammar(g);
+    BNFParser p(g);
+
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<ident>", "count", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 5u);
+    // The predicate leaves no node behind: only the <word> remains
+    ASSERT_EQ(runner, ast->children.size(), 1u);
+    ASSERT_EQ(runner, ast->children[0]->symbol, std::string("<word>"));
+    ASSERT_FALSE(runner, treeHasNull(ast));
+    delete ast;
+
+    ASSERT_NULL(runner, p.parse("<ident>", "while", consumed));
+    ASSERT_NULL(runner, p.parse("<ident>", "if", consumed));
+
+    // Keyword prefixes are fine identifiers
+    ast = p.parse("<ident>", "iffy", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 4u);
+    delete ast;
+}
+
+void test_and_predicate_consumes_nothing(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("<num> ::= <digit> { <digit> }");
+    g.addRule("<price> ::= <num> '$'");
+    g.addRule("<priced> ::= &<price> <num>");
+
+    BNFParser p(g);
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<priced>", "25$", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 2u);
+    ASSERT_EQ(runner, ast->matched, std::string("25"));
+    delete ast;
+
+    ASSERT_NULL(runner, p.parse("<priced>", "25", consumed));
+    ASSERT_NULL(runner, p.parse("<priced>", "25E", consumed));
+}
+
+void test_predicate_at_end_of_input(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<anything> ::= ( ^ )");
+    g.addRule("<line> ::= 'end' !<anything>");
+
+    BNFParser p(g);
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<line>", "end", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 3u);
+    delete ast;
+    ASSERT_NULL(runner, p.parse("<line>", "ends", consumed));
+}
+
+static SemanticValue countCall(const ActionMatch&, void* userData) {
+    ++*static_cast<int*>(userData);
+    return SemanticValue(1);
+}
+
+void test_predicate_runs_no_actions(TestRunner& runner) {
+    Grammar g;
+    buildIdentifierGrammar(g);
+    BNFParser p(g);
+
+    int keywordCalls = 0;
+    int wordCalls = 0;
+    SemanticActions actions;
+    actions.on("<keyword>", countCall, &keywordCalls);
+    actions.on("<word>", countCall, &wordCalls);
+
+    SemanticValue result;
+    size_t consumed = 0;
+    ASSERT_TRUE(runner, p.parseWithActions("<ident>", "value", actions, result, consumed));
+    ASSERT_EQ(runner, keywordCalls, 0);
+    ASSERT_EQ(runner, wordCalls, 1);
+}
+
+int main() {
+    TestSuite suite("Predicate Test Suite");
+    suite.addTest("Tokens and Grammar", test_predicate_tokens_and_grammar);
+    suite.addTest("Not-Predicate Rejects Keywords", test_not_predicate_rejects_keywords);
+    suite.addTest("And-Predicate Consumes Nothing", test_and_predicate_consumes_nothing);
+    suite.addTest("Predicate at End of Input", test_predicate_at_end_of_input);
+    suite.addTest("Predicate Runs No Actions", test_predicate_runs_no_actions);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include "../include/LiteralFinder.hpp"
+#include <cstdlib>
+
+static std::string required(const CompiledGrammar& cg, const std::string& rule) {
+    return cg.requiredLiteral(cg.findRule(rule));
+}
+
+static void buildIrcGrammar(Grammar& g) {
+    g.addRule("<letter> ::= ( 'a' ... 'z' 'A' ... 'Z' )");
+    g.addRule("<nick> ::= <letter> { <letter> }");
+    g.addRule("<target> ::= '#' <nick> | <nick>");
+    g.addRule("<text> ::= { ( ^ 0x0A ) }");
+    g.addRule("<privmsg> ::= ':' <nick> ' PRIVMSG ' <target> ' :' <text>");
+    g.addRule("<host-char> ::= ( 'a' ... 'z' '.' )");
+    g.addRule("<scheme> ::= 'http' | 'https'");
+    g.addRule("<any-scheme> ::= <scheme> | 'ftp'");
+    g.addRule("<url> ::= <any-scheme> '://' <host-char> { <host-char> }");
+    g.addRule("<short> ::= 'ab' [ 'cdefgh' ]");
+}
+
+void test_literal_finder(TestRunner& runner) {
+    const char* needles[] = { "x", "ab", "://", "PRIVMSG", "aaab" };
+    bool same = true;
+    std::srand(88);
+    for (size_t n = 0; n < 5; ++n) {
+        LiteralFinder finder(needles[n]);
+        for (int round = 0; round < 300 && same; ++round) {
+            std::string text;
+            size_t len = std::rand() % 90;
+            for (size_t i = 0; i < len; ++i)
+                text += "abx:/PRIVMSG"[std::rand() % 12];
+            if (std::rand() % 4 == 0) text.insert(text.size() / 3, needles[n]);
+            size_t start = text.empty() ? 0 : std::rand() % text.size();
+            size_t expected = text.find(needles[n], start);
+            if (expected == std::string::npos) expected = text.size();
+            if (finder.find(text.data(), start, text.size()) != expected) same = false;
+        }
+    }
+    ASSERT_TRUE(runner, same);
+
+    // Occurrences must end before the bound
+    LiteralFinder abc("abc");
+    ASSERT_EQ(runner, abc.find("xxabc", 0, 4), 4u);
+    ASSERT_EQ(runner, abc.find("xxabc", 0, 5), 2u);
+    ASSERT_EQ(runner, LiteralFinder("").find("abc", 0, 3), 3u);
+}
+
+void test_required_literal_analysis(TestRunner& runner) {
+    Grammar g;
+    buildIrcGrammar(g);
+    CompiledGrammar cg(g);
+
+    ASSERT_EQ(runner, required(cg, "<privmsg>"), std::string(" PRIVMSG "));
+    ASSERT_EQ(runner, required(cg, "<url>"), std::string("://"));
+    // Shared by both alternatives
+    ASSERT_EQ(runner, required(cg, "<scheme>"), std::string("http"));
+    ASSERT_EQ(runner, required(cg, "<short>"), std::string("ab"));
+    // Only the '#' branch has a literal
+    ASSERT_EQ(runner, required(cg, "<target>"), std::string(""));
+    ASSERT_EQ(runner, required(cg, "<text>"), std::string(""));
+}
+
+void test_required_literal_recursion(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<list> ::= '(' <items> ')'");
+    g.addRule("<items> ::= <list> | 'x' | <items> ',' <items>");
+    CompiledGrammar cg(g);
+    ASSERT_EQ(runner, required(cg, "<list>").size(), 1u);
+    ASSERT_EQ(runner, required(cg, "<items>"), std::string(""));
+}
+
+void test_prefiltered_search(TestRunner& runner) {
+    Grammar g;
+    buildIrcGrammar(g);
+    BNFParser p(g);
+
+    std::string log;
+    for (int i = 0; i < 50; ++i)
+        log += ":alice JOIN #chan\n:bob PART #chan\n";
+    log += ":carol PRIVMSG #chan :see http://x.org\n";
+    std::vector<SearchMatch> m;
+    size_t found = p.search("<privmsg>", log, m);
+    ASSERT_EQ(runner, found, 1u);
+    ASSERT_EQ(runner, log.substr(m[0].start, 7), std::string(":carol "));
+    found = p.search("<url>", log, m);
+    ASSERT_EQ(runner, found, 1u);
+    ASSERT_EQ(runner, log.substr(m[0].start, m[0].length), std::string("http://x.org"));
+
+    // Random text, checked against trying every offset
+    const std::string alphabet = "htpsf:/ab.xP";
+    const char* rules[] = { "<url>", "<short>", "<scheme>" };
+    bool same = true;
+    std::srand(880);
+    for (int round = 0; round < 300 && same; ++round) {
+        std::string text;
+        size_t len = std::rand() % 50;
+        for (size_t i = 0; i < len; ++i)
+            text += alphabet[std::rand() % alphabet.size()];
+        for (size_t r = 0; r < 3; ++r) {
+            p.search(rules[r], text, m);
+            size_t pos = 0;
+            size_t k = 0;
+            while (pos < text.size()) {
+                size_t consumed = 0;
+                ASTNode* ast = p.parse(rules[r], text.substr(pos), consumed);
+                bool matched = ast != 0 && consumed > 0;
+                delete ast;
+                if (matched) {
+                    if (k >= m.size() || m[k].start != pos || m[k].length != consumed) same = false;
+                    ++k;
+                    pos += consumed;
+                } else {
+                    ++pos;
+                }
+            }
+            if (k != m.size()) same = false;
+        }
+    }
+    ASSERT_TRUE(runner, same);
+}
+
+int main() {
+    TestSuite suite("Required Literal Test Suite");
+    suite.addTest("Literal Finder", test_literal_finder);
+    suite.addTest("Required Literal Analysis", test_required_literal_analysis);
+    suite.addTest("Recursive Rules", test_required_literal_recursion);
+    suite.addTest("Prefiltered Search", test_prefiltered_search);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/ByteSet.hpp"
+#include <cstdlib>
+
+static void buildUrlGrammar(Grammar& g) {
+    g.addRule("<alpha> ::= ( 'a' ... 'z' 'A' ... 'Z' )");
+    g.addRule("<host-char> ::= ( 'a' ... 'z' '0' ... '9' '.' '-' )");
+    g.addRule("<scheme> ::= 'http' [ 's' ]");
+    g.addRule("<url> ::= <scheme> '://' <host-char> { <host-char> }");
+    g.addRule("<mention> ::= '@' <alpha> { <alpha> }");
+}
+
+// Reference implementation: try every offset
+static std::vector<SearchMatch> naiveSearch(const BNFParser& p, const std::string& rule,
+                                            const std::string& input) {
+    std::vector<SearchMatch> out;
+    size_t pos = 0;
+    while (pos < input.size()) {
+        size_t consumed = 0;
+        ASTNode* ast = p.parse(rule, input.substr(pos), consumed);
+        bool matched = ast != 0;
+        delete ast;
+        if (matched && consumed > 0) {
+            SearchMatch m;
+            m.start = pos;
+            m.length = consumed;
+            out.push_back(m);
+            pos += consumed;
+        } else {
+            ++pos;
+        }
+    }
+    return out;
+}
+
+static bool sameMatches(const std::vector<SearchMatch>& a, const std::vector<SearchMatch>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].start != b[i].start || a[i].length != b[i].length) return false;
+    }
+    return true;
+}
+
+void test_byte_set_find(TestRunner& runner) {
+    std::bitset<256> at;
+    at.set('@');
+    std::bitset<256> word;
+    for (int c = 'a'; c <= 'z'; ++c) word.set(c);
+    for (int c = '0'; c <= '9'; ++c) word.set(c);
+    std::bitset<256> scattered;  // more ranges than the vector path takes
+    for (int c = 'a'; c <= 'z'; c += 2) scattered.set(c);
+
+    const std::bitset<256>* sets[] = { &at, &word, &scattered };
+    bool same = true;
+    std::srand(87);
+    for (size_t s = 0; s < 3; ++s) {
+        ByteSet bytes(*sets[s]);
+        for (int round = 0; round < 200 && same; ++round) {
+            std::string text;
+            size_t len = std::rand() % 80;
+            for (size_t i = 0; i < len; ++i)
+                text += static_cast<char>(std::rand() % 8 == 0 ? "@a7q"[std::rand() % 4] : ' ' + std::rand() % 16);
+            size_t start = len ? std::rand() % len : 0;
+            size_t expected = start;
+            while (expected < len && !sets[s]->test(static_cast<unsigned char>(text[expected]))) ++expected;
+            if (bytes.find(text.data(), start, len) != expected) same = false;
+        }
+    }
+    ASSERT_TRUE(runner, same);
+    ASSERT_EQ(runner, ByteSet().find("abc", 0, 3), 3u);
+}
+
+void test_search_finds_all_matches(TestRunner& runner) {
+    Grammar g;
+    buildUrlGrammar(g);
+    BNFParser p(g);
+
+    const std::string text = "see https://example.org and http://a-b.net, ping @Alice or @bob.";
+    std::vector<SearchMatch> urls;
+    size_t found = p.search("<url>", text, urls);
+    ASSERT_EQ(runner, found, 2u);
+    ASSERT_EQ(runner, text.substr(urls[0].start, urls[0].length), std::string("https://example.org"));
+    ASSERT_EQ(runner, text.substr(urls[1].start, urls[1].length), std::string("http://a-b.net"));
+
+    std::vector<SearchMatch> mentions;
+    p.search("<mention>", text, mentions);
+    ASSERT_EQ(runner, mentions.size(), 2u);
+    ASSERT_EQ(runner, text.substr(mentions[1].start, mentions[1].length), std::string("@bob"));
+
+    // "http:" without "//" is not a match
+    found = p.search("<url>", "http: no, http:/x", urls);
+    ASSERT_EQ(runner, found, 0u);
+    ASSERT_TRUE(runner, urls.empty());
+}
+
+void test_search_matches_are_non_overlapping(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<pair> ::= 'ab' | 'ba'");
+    g.addRule("<maybe> ::= [ 'x' ]");
+    BNFParser p(g);
+
+    std::vector<SearchMatch> m;
+    p.search("<pair>", "abab-bab", m);
+    ASSERT_EQ(runner, m.size(), 3u);
+    ASSERT_EQ(runner, m[2].start, 5u);
+
+    // Empty matches are never reported
+    p.search("<maybe>", "axxa", m);
+    ASSERT_EQ(runner, m.size(), 2u);
+    ASSERT_EQ(runner, m[0].start, 1u);
+}
+
+void test_search_agrees_with_parse(TestRunner& runner) {
+    Grammar g;
+    buildUrlGrammar(g);
+    g.addRule("<word> ::= <alpha> { <alpha> } [ '-' <alpha> ]");
+    BNFParser p(g);
+
+    const char* rules[] = { "<url>", "<mention>", "<word>", "<scheme>" };
+    const std::string alphabet = "htps:/@aZ-. 1";
+    bool same = true;
+    std::srand(870);
+    for (int i = 0; i < 300 && same; ++i) {
+        std::string text;
+        size_t len = std::rand() % 40;
+        for (size_t j = 0; j < len; ++j)
+            text += alphabet[std::rand() % alphabet.size()];
+        if (std::rand() % 3 == 0) text.insert(text.size() / 2, "http://x.y");
+        for (size_t r = 0; r < 4; ++r) {
+            std::vector<SearchMatch> fast;
+            p.search(rules[r], text, fast);
+            if (!sameMatches(fast, naiveSearch(p, rules[r], text))) same = false;
+        }
+    }
+    ASSERT_TRUE(runner, same);
+}
+
+int main() {
+    TestSuite suite("Search Test Suite");
+    suite.addTest("ByteSet Find", test_byte_set_find);
+    suite.addTest("Finds All Matches", test_search_finds_all_matches);
+    suite.addTest("Non-overlapping Matches", test_search_matches_are_non_overlapping);
+    suite.addTest("Agrees With Parse", test_search_agrees_with_parse);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/BranchProfile.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include <cstdlib>
+
+static void buildExprGrammar(Grammar& g) {
+    g.addRule("<num> ::= ( '0' ... '9' ) { ( '0' ... '9' ) }");
+    g.addRule("<term> ::= '(' <expr> ')' | <num>");
+    g.addRule("<expr> ::= <term> '+' <expr> | <term>");
+}
+
+static bool reentrant(const BNFParser& p, const std::string& rule) {
+    const CompiledGrammar& cg = p.compiledGrammar();
+    return cg.rule(cg.findRule(rule)).reentrant;
+}
+
+static const MemoRuleStats* findStats(const std::vector<MemoRuleStats>& stats, const std::string& rule) {
+    for (size_t i = 0; i < stats.size(); ++i)
+        if (stats[i].rule == rule) return &stats[i];
+    return 0;
+}
+
+void test_reentrant_rules_marked(TestRunner& runner) {
+    Grammar g;
+    buildExprGrammar(g);
+    g.addRule("<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<item> ::= <letter> { <letter> }");
+    g.addRule("<list> ::= { <item> ',' } <item>");
+    g.addRule("<key> ::= <item>");
+    g.addRule("<pair> ::= <key> '=' <num> | <key> ':' <item> | <num>");
+    BNFParser p(g);
+
+    // Both <expr> branches start with <term>
+    ASSERT_TRUE(runner, reentrant(p, "<term>"));
+    ASSERT_FALSE(runner, reentrant(p, "<expr>"));
+    // The failed last repetition is followed by <item> at the same position
+    ASSERT_TRUE(runner, reentrant(p, "<item>"));
+    ASSERT_FALSE(runner, reentrant(p, "<letter>"));
+    // Shared prefix of overlapping branches, but not what follows it
+    ASSERT_TRUE(runner, reentrant(p, "<key>"));
+    ASSERT_FALSE(runner, reentrant(p, "<num>"));
+}
+
+void test_memoized_results_unchanged(TestRunner& runner) {
+    Grammar g;
+    buildExprGrammar(g);
+    g.addRule("<list> ::= { <expr> ',' } <expr>");
+    BNFParser plain(g);
+    BNFParser selective(g);
+    BNFParser all(g);
+    selective.memoize(BNFParser::MEMO_REENTRANT);
+    all.memoize(BNFParser::MEMO_ALL);
+    BNFParser* memoized[] = { &selective, &all };
+
+    const char* rules[] = { "<expr>", "<list>", "<term>" };
+    const std::string alphabet = "(()+12,";
+    bool same = true;
+    std::srand(94);
+    for (int i = 0; i < 300 && same; ++i) {
+        std::string text;
+        size_t len = std::rand() % 14;
+        for (size_t j = 0; j < len; ++j)
+            text += alphabet[std::rand() % alphabet.size()];
+        for (size_t r = 0; r < 3; ++r) {
+            size_t c1 = 0;
+            ASTNode* expected = plain.parse(rules[r], text, c1);
+            bool full = plain.matchFull(rules[r], text);
+            for (size_t k = 0; k < 2; ++k) {
+                size_t c2 = 0;
+                ASTNode* ast = memoized[k]->parse(rules[r], text, c2);
+                if (c1 != c2 || formatAST(ast) != formatAST(expected)) same = false;
+                if (memoized[k]->matchFull(rules[r], text) != full) same = false;
+                delete ast;
+            }
+            delete expected;
+        }
+    }
+    ASSERT_TRUE(runner, same);
+}
+
+void test_nested_input_in_linear_work(TestRunner& runner) {
+    Grammar g;
+    buildExprGrammar(g);
+    BNFParser p(g);
+    p.memoize(BNFParser::MEMO_REENTRANT);
+
+    // Without a memo every level parses its <term> twice: 2^300 times
+    const size_t depth = 300;
+    std::string text = std::string(depth, '(') + "1+2" + std::string(depth, ')');
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<expr>", text, consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, text.size());
+    delete ast;
+
+    std::vector<MemoRuleStats> stats;
+    p.memoReport(stats);
+    ASSERT_EQ(runner, stats.size(), 1u);
+    ASSERT_EQ(runner, stats[0].rule, std::string("<term>"));
+    ASSERT_TRUE(runner, stats[0].hits > 0);
+    ASSERT_TRUE(runner, stats[0].lookups < 8 * depth);
+}
+
+void test_memo_report_per_rule(TestRunner& runner) {
+    Grammar g;
+    buildExprGrammar(g);
+    BNFParser p(g);
+    p.memoize(BNFParser::MEMO_ALL);
+    size_t consumed = 0;
+    delete p.parse("<expr>", "((1+2)+(3))+4", consumed);
+
+    // <term> is looked up again where <expr> tried it; <num> never is
+    std::vector<MemoRuleStats> stats;
+    p.memoReport(stats);
+    ASSERT_EQ(runner, stats.size(), 3u);
+    const MemoRuleStats* term = findStats(stats, "<term>");
+    const MemoRuleStats* num = findStats(stats, "<num>");
+    ASSERT_NOT_NULL(runner, term);
+    ASSERT_NOT_NULL(runner, num);
+    ASSERT_TRUE(runner, term->hits > 0);
+    ASSERT_TRUE(runner, term->stored <= term->lookups);
+    ASSERT_EQ(runner, num->hits, 0ul);
+
+    // Memoize only what the sample showed hits for
+    std::vector<std::string> rules;
+    rules.push_back("<term>");
+    rules.push_back("<missing>");
+    p.memoizeRules(rules);
+    ASTNode* ast = p.parse("<expr>", "((1+2)+(3))+4", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 13u);
+    delete ast;
+    p.memoReport(stats);
+    ASSERT_EQ(runner, stats.size(), 1u);
+    ASSERT_EQ(runner, stats[0].rule, std::string("<term>"));
+
+    p.resetMemoStats();
+    p.memoReport(stats);
+    ASSERT_TRUE(runner, stats.empty());
+
+    // Turned off, nothing is counted
+    p.memoize(BNFParser::MEMO_OFF);
+    delete p.parse("<expr>", "1+2", consumed);
+    p.memoReport(stats);
+    ASSERT_TRUE(runner, stats.empty());
+}
+
+void test_search_with_memo(TestRunner& runner) {
+    Grammar g;
+    buildExprGrammar(g);
+    BNFParser plain(g);
+    BNFParser memoized(g);
+    memoized.memoize(BNFParser::MEMO_REENTRANT);
+
+    const std::string text = "x (1+2) y 3+((4)) z (5";
+    std::vector<SearchMatch> expected, found;
+    plain.search("<expr>", text, expected);
+    memoized.search("<expr>", text, found);
+    ASSERT_EQ(runner, found.size(), expected.size());
+    bool same = found.size() == expected.size();
+    for (size_t i = 0; same && i < found.size(); ++i)
+        same = found[i].start == expected[i].start && found[i].length == expected[i].length;
+    ASSERT_TRUE(runner, same);
+}
+
+void test_memo_counts_wins_once(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<ab> ::= 'a' | 'b'");
+    g.addRule("<s> ::= <ab> 'x' | 'a' 'y'");
+    BNFParser p(g);
+    p.memoize(BNFParser::MEMO_ALL);
+    BranchProfile profile;
+    p.recordBranches(&profile);
+
+    // Both branches of <s> can start with 'a', so the winner is recognized
+    // first and its branch parsed again to build it
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<s>", "ax", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 2u);
+    delete ast;
+
+    const CompiledGrammar& cg = p.compiledGrammar();
+    unsigned int s = cg.rule(cg.findRule("<s>")).root;
+    unsigned int inner = cg.rule(cg.findRule("<ab>")).root;
+    ASSERT_EQ(runner, profile.wins(s, 0), 1ul);
+    ASSERT_EQ(runner, profile.wins(inner, 0), 1ul);
+    ASSERT_EQ(runner, profile.total(), 2ul);
+}
+
+int main() {
+    TestSuite suite("Selective Memo Test Suite");
+    suite.addTest("Reentrant Rules Marked", test_reentrant_rules_marked);
+    suite.addTest("Results Unchanged", test_memoized_results_unchanged);
+    suite.addTest("Nested Input In Linear Work", test_nested_input_in_linear_work);
+    suite.addTest("Memo Report Per Rule", test_memo_report_per_rule);
+    suite.addTest("Search With Memo", test_search_with_memo);
+    suite.addTest("Memo Counts Wins Once", test_memo_counts_wins_once);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/SemanticActions.hpp"
+
+// Parse the matched digits as a decimal number; counts calls in userData
+static SemanticValue toNumber(const ActionMatch& m, void* userData) {
+    if (userData) ++*static_cast<int*>(userData);
+    long v = 0;
+    const char* p = m.begin();
+    for (size_t i = 0; i < m.length; ++i)
+        v = v * 10 + (p[i] - '0');
+    return SemanticValue(v);
+}
+
+static SemanticValue sum(const ActionMatch& m, void*) {
+    long total = 0;
+    for (size_t i = 0; i < m.count; ++i)
+        total += m.values[i].integer;
+    return SemanticValue(total);
+}
+
+static SemanticValue countValues(const ActionMatch& m, void*) {
+    return SemanticValue(static_cast<long>(m.count));
+}
+
+static void buildNumberGrammar(Grammar& g) {
+    g.addRule("~<digit> ::= ( '0' ... '9' )");
+    g.addRule("<num> ::= <digit> { <digit> }");
+    g.addRule("<list> ::= <num> { ',' <num> }");
+}
+
+void test_actions_fold_values(TestRunner& runner) {
+    Grammar g;
+    buildNumberGrammar(g);
+    BNFParser p(g);
+
+    SemanticActions actions;
+    actions.on("<num>", toNumber);
+    actions.on("<list>", sum);
+
+    SemanticValue result;
+    size_t consumed = 0;
+    ASSERT_TRUE(runner, p.parseWithActions("<list>", "12,30,400", actions, result, consumed));
+    ASSERT_EQ(runner, consumed, 9u);
+    ASSERT_EQ(runner, result.integer, 442L);
+
+    // Without an action on the start rule the last value is the result
+    SemanticActions numbersOnly;
+    numbersOnly.on("<num>", toNumber);
+    ASSERT_TRUE(runner, p.parseWithActions("<list>", "7,8", numbersOnly, result, consumed));
+    ASSERT_EQ(runner, result.integer, 8L);
+
+    ASSERT_FALSE(runner, p.parseWithActions("<list>", "x", actions, result, consumed));
+    ASSERT_EQ(runner, consumed, 0u);
+}
+
+void test_actions_skip_failed_sequence(TestRunner& runner) {
+    Grammar g;
+    buildNumberGrammar(g);
+    g.addRule("<s> ::= <num> 'x' | <num> 'y'");
+    BNFParser p(g);
+
+    int calls = 0;
+    SemanticActions actions;
+    actions.on("<num>", toNumber, &calls);
+
+    SemanticValue result;
+    size_t consumed = 0;
+    ASSERT_TRUE(runner, p.parseWithActions("<s>", "42y", actions, result, consumed));
+    ASSERT_EQ(runner, result.integer, 42L);
+    // The first branch matched <num> before failing on 'x'
+    ASSERT_EQ(runner, calls, 1);
+}
+
+void test_actions_longest_alternative_wins(TestRunner& runner) {
+    Grammar g;
+    buildNumberGrammar(g);
+    g.addRule("<short> ::= <num>");
+    g.addRule("<long> ::= <num> '.' <num>");
+    g.addRule("<value> ::= <short> | <long>");
+    BNFParser p(g);
+
+    int calls = 0;
+    SemanticActions actions;
+    actions.on("<num>", toNumber, &calls);
+    actions.on("<short>", countValues);
+    actions.on("<long>", sum);
+
+    SemanticValue result;
+    size_t consumed = 0;
+    ASSERT_TRUE(runner, p.parseWithActions("<value>", "3.25", actions, result, consumed));
+    ASSERT_EQ(runner, consumed, 4u);
+    ASSERT_EQ(runner, result.integer, 28L);
+    ASSERT_EQ(runner, calls, 2);
+}
+
+void test_actions_partial_repetition(TestRunner& runner) {
+    Grammar g;
+    buildNumberGrammar(g);
+    g.addRule("<items> ::= { <num> ';' }");
+    BNFParser p(g);
+
+    int calls = 0;
+    SemanticActions actions;
+    actions.on("<num>", toNumber, &calls);
+    actions.on("<items>", countValues);
+
+    SemanticValue result;
+    size_t consumed = 0;
+    ASSERT_TRUE(runner, p.parseWithActions("<items>", "1;2;3", actions, result, consumed));
+    ASSERT_EQ(runner, consumed, 4u);
+    ASSERT_EQ(runner, result.integer, 2L);
+    ASSERT_EQ(runner, calls, 2);
+}
+
+void test_actions_pass_through_rules(TestRunner& runner) {
+    Grammar g;
+    buildNumberGrammar(g);
+    g.addRule("<inner> ::= <num> ',' <num>");
+    g.addRule("<pair> ::= '(' <inner> ')'");
+    g.addRule("<pairs> ::= <pair> { <pair> }");
+    BNFParser p(g);
+
+    SemanticActions actions;
+    actions.on("<num>", toNumber);
+    actions.on("<pair>", countValues);
+    actions.on("<pairs>", sum);
+
+    SemanticValue result;
+    size_t consumed = 0;
+    ASSERT_TRUE(runner, p.parseWithActions("<pairs>", "(1,2)(3,4)(5,6)", actions, result, consumed));
+    ASSERT_EQ(runner, result.integer, 6L);
+}
+
+int main() {
+    TestSuite suite("Semantic Action Test Suite");
+    suite.addTest("Fold Values", test_actions_fold_values);
+    suite.addTest("Skip Failed Sequence", test_actions_skip_failed_sequence);
+    suite.addTest("Longest Alternative Wins", test_actions_longest_alternative_wins);
+    suite.addTest("Partial Repetition", test_actions_partial_repetition);
+    suite.addTest("Pass-through Rules", test_actions_pass_through_rules);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
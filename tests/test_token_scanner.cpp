@@ -0,0 +1,291 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/CompiledGrammar.hpp"
+#include "../include/TokenScanner.hpp"
+#include "../include/IncrementalParser.hpp"
+#include "../include/SemanticActions.hpp"
+#include <cstdlib>
+
+static void buildLexicalRules(Grammar& g) {
+    g.addRule("<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("@<ident> ::= <letter> { <letter> | <digit> }");
+    g.addRule("@<num> ::= <digit> { <digit> }");
+    g.addRule("<assign> ::= <ident> '=' <num>");
+}
+
+void test_token_rule_flag(TestRunner& runner) {
+    Grammar g;
+    g.addRule("@<a> ::= 'a'");
+    g.addRule("~@<b> ::= 'b'");
+    g.addRule("<c> ::= <a> <b>");
+
+    Rule* a = g.getRule("<a>");
+    Rule* b = g.getRule("<b>");
+    ASSERT_NOT_NULL(runner, a);
+    ASSERT_NOT_NULL(runner, b);
+    ASSERT_TRUE(runner, a->token);
+    ASSERT_FALSE(runner, a->transparent);
+    ASSERT_TRUE(runner, b->token);
+    ASSERT_TRUE(runner, b->transparent);
+    ASSERT_FALSE(runner, g.getRule("<c>")->token);
+
+    CompiledGrammar cg(g);
+    ASSERT_NOT_NULL(runner, cg.scanner(cg.findRule("<a>")));
+    ASSERT_NULL(runner, cg.scanner(cg.findRule("<c>")));
+    const CompiledGrammar::Node& seq = cg.node(cg.rule(cg.findRule("<c>")).root);
+    ASSERT_TRUE(runner, (cg.node(cg.child(seq, 0)).flags & CompiledGrammar::FLAG_TOKEN) != 0);
+}
+
+void test_deterministic_scanner(TestRunner& runner) {
+    Grammar g;
+    buildLexicalRules(g);
+    CompiledGrammar cg(g);
+
+    const TokenScanner* ident = cg.scanner(cg.findRule("<ident>"));
+    ASSERT_NOT_NULL(runner, ident);
+    ASSERT_TRUE(runner, ident->deterministic());
+    ASSERT_TRUE(runner, ident->fallbackReason().empty());
+    // Start state plus one state per class occurrence
+    ASSERT_EQ(runner, ident->stateCount(), 4u);
+
+    size_t inspected = 0;
+    ASSERT_EQ(runner, ident->match("ab1+", 0, inspected), 3u);
+    ASSERT_EQ(runner, inspected, 4u);
+    ASSERT_EQ(runner, ident->match("x=ab1", 2, inspected), 3u);
+    ASSERT_EQ(runner, inspected, 6u);
+    ASSERT_EQ(runner, ident->match("1ab", 0, inspected), TokenScanner::NO_MATCH);
+    ASSERT_EQ(runner, inspected, 1u);
+}
+
+void test_scanner_fallbacks(TestRunner& runner) {
+    Grammar g;
+    g.addRule("@<op> ::= '=' | '=='");
+    g.addRule("@<nested> ::= '(' [ <nested> ] ')'");
+    g.addRule("@<guarded> ::= !'-' ( 'a' ... 'z' )");
+    CompiledGrammar cg(g);
+
+    const char* rules[] = { "<op>", "<nested>", "<guarded>" };
+    for (size_t i = 0; i < 3; ++i) {
+        const TokenScanner* s = cg.scanner(cg.findRule(rules[i]));
+        ASSERT_NOT_NULL(runner, s);
+        ASSERT_FALSE(runner, s->deterministic());
+        ASSERT_FALSE(runner, s->fallbackReason().empty());
+    }
+
+    // Fallback tokens are still matched by the interpreter, as leaves
+    BNFParser p(g);
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<nested>", "(())", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 4u);
+    ASSERT_EQ(runner, ast->children.size(), 3u);
+    ASSERT_EQ(runner, formatAST(ast), std::string("<seq>[(())](([(]()<opt>[()](<nested>[()]()))[)]())"));
+    delete ast;
+
+    ast = p.parse("<op>", "==", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 2u);
+    delete ast;
+}
+
+void test_tokens_are_leaves(TestRunner& runner) {
+    Grammar g;
+    buildLexicalRules(g);
+    BNFParser p(g);
+
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<assign>", "x1=42;", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 5u);
+    ASSERT_EQ(runner, formatAST(ast), std::string("<seq>[x1=42](<ident>[x1]()=[=]()<num>[42]())"));
+    delete ast;
+
+    ASSERT_NULL(runner, p.parse("<assign>", "1x=42", consumed));
+}
+
+// Token and plain versions of the same rules must accept the same prefixes
+void test_tokens_match_interpreter(TestRunner& runner) {
+    const char* bodies[] = {
+        "<letter> { <letter> | <digit> }",
+        "[ '-' ] <digit> { <digit> } [ '.' <digit> { <digit> } ]",
+        "'a' { 'b' 'c' } [ 'd' ]",
+        "{ 'ab' }",
+        "'x' | 'y' 'z' | { 'w' }",
+        "[ 'a' ] [ 'b' ] 'c'",
+        "'a' | 'ab'",
+        "( 'a' 'b' 'c' ) { ( 'x' 'y' ) | <digit> }"
+    };
+    const std::string alphabet = "abcdwxyz-.019,";
+
+    std::srand(84);
+    for (size_t b = 0; b < sizeof(bodies) / sizeof(bodies[0]); ++b) {
+        Grammar plain;
+        Grammar tokens;
+        Grammar* grammars[] = { &plain, &tokens };
+        for (int k = 0; k < 2; ++k) {
+            grammars[k]->addRule("<letter> ::= ( 'a' ... 'z' )");
+            grammars[k]->addRule("<digit> ::= ( '0' ... '9' )");
+            grammars[k]->addRule(std::string(k ? "@" : "") + "<tok> ::= " + bodies[b]);
+            grammars[k]->addRule("<list> ::= { <tok> ',' }");
+        }
+        BNFParser pp(plain);
+        BNFParser tp(tokens);
+
+        bool same = true;
+        for (int i = 0; i < 300 && same; ++i) {
+            std::string input;
+            size_t len = std::rand() % 10;
+            for (size_t j = 0; j < len; ++j)
+                input += alphabet[std::rand() % alphabet.size()];
+
+            const char* starts[] = { "<tok>", "<list>" };
+            for (int s = 0; s < 2; ++s) {
+                size_t pc = 0, tc = 0;
+                ASTNode* pa = pp.parse(starts[s], input, pc);
+                ASTNode* ta = tp.parse(starts[s], input, tc);
+                if ((pa == 0) != (ta == 0) || pc != tc || (pa && pa->matched != ta->matched))
+                    same = false;
+                delete pa;
+                delete ta;
+            }
+        }
+        ASSERT_TRUE(runner, same);
+    }
+}
+
+void test_token_incremental_reparse(TestRunner& runner) {
+    Grammar g;
+    buildLexicalRules(g);
+    g.addRule("<stmts> ::= { <assign> ';' }");
+    BNFParser p(g);
+
+    IncrementalParser inc(p, "<stmts>");
+    size_t consumed = 0;
+    ASSERT_NOT_NULL(runner, inc.parse("ab=1;cd=2;ef=3;", consumed));
+
+    // Extend a token at its end, where the scanner stopped
+    const ASTNode* tree = inc.reparse(TextEdit(7, 0, "7"), consumed);
+    ASSERT_NOT_NULL(runner, tree);
+    size_t fresh = 0;
+    ASTNode* expected = p.parse("<stmts>", inc.text(), fresh);
+    ASSERT_NOT_NULL(runner, expected);
+    ASSERT_EQ(runner, consumed, fresh);
+    ASSERT_EQ(runner, formatAST(tree), formatAST(expected));
+    ASSERT_TRUE(runner, inc.reusedCount() > 0);
+    delete expected;
+}
+
+static SemanticValue countCall(const ActionMatch&, void* userData) {
+    ++*static_cast<int*>(userData);
+    return SemanticValue(1);
+}
+
+void test_token_actions_are_atomic(TestRunner& runner) {
+    Grammar g;
+    buildLexicalRules(g);
+    g.addRule("@<word> ::= <letter> { <letter> } | <letter> '!'");
+    g.addRule("<words> ::= { <word> ' ' }");
+    BNFParser p(g);
+
+    int identCalls = 0;
+    int letterCalls = 0;
+    int wordCalls = 0;
+    SemanticActions actions;
+    actions.on("<ident>", countCall, &identCalls);
+    actions.on("<letter>", countCall, &letterCalls);
+    actions.on("<word>", countCall, &wordCalls);
+
+    SemanticValue result;
+    size_t consumed = 0;
+    ASSERT_TRUE(runner, p.parseWithActions("<assign>", "abc=1", actions, result, consumed));
+    ASSERT_EQ(runner, identCalls, 1);
+    // Rules inside a token never run their actions, scanned or interpreted
+    ASSERT_TRUE(runner, p.parseWithActions("<words>", "ab c! ", actions, result, consumed));
+    ASSERT_EQ(runner, consumed, 6u);
+    ASSERT_EQ(runner, wordCalls, 2);
+    ASSERT_EQ(runner, letterCalls, 0);
+}
+
+// Batches give what one match() per input gives, whatever their lengths
+void test_batch_matches_single(TestRunner& runner) {
+    Grammar g;
+    buildLexicalRules(g);
+    g.addRule("@<real> ::= [ '-' ] <digit> { <digit> } [ '.' <digit> { <digit> } ]");
+    g.addRule("@<blank> ::= { ' ' }");
+    CompiledGrammar cg(g);
+
+    const char* rules[] = { "<ident>", "<real>", "<blank>" };
+    const std::string alphabet = "ab09-. +";
+    std::srand(97);
+    for (size_t r = 0; r < 3; ++r) {
+        const TokenScanner* s = cg.scanner(cg.findRule(rules[r]));
+        ASSERT_TRUE(runner, s->deterministic());
+
+        std::vector<std::string> inputs;
+        for (int i = 0; i < 500; ++i) {
+            std::string input;
+            size_t len = std::rand() % 4 ? std::rand() % 8 : std::rand() % 40;
+            for (size_t j = 0; j < len; ++j)
+                input += alphabet[std::rand() % alphabet.size()];
+            inputs.push_back(input);
+        }
+        std::vector<size_t> lengths;
+        s->matchBatch(inputs, lengths);
+        ASSERT_EQ(runner, lengths.size(), inputs.size());
+        bool same = true;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            size_t inspected = 0;
+            if (lengths[i] != s->match(inputs[i], 0, inspected)) same = false;
+        }
+        ASSERT_TRUE(runner, same);
+    }
+
+    // Fewer inputs than lanes, and none
+    const TokenScanner* num = cg.scanner(cg.findRule("<num>"));
+    std::vector<std::string> few;
+    few.push_back("123x");
+    few.push_back("");
+    few.push_back("x1");
+    std::vector<size_t> lengths;
+    num->matchBatch(few, lengths);
+    ASSERT_EQ(runner, lengths.size(), 3u);
+    ASSERT_EQ(runner, lengths[0], 3u);
+    ASSERT_EQ(runner, lengths[1], TokenScanner::NO_MATCH);
+    ASSERT_EQ(runner, lengths[2], TokenScanner::NO_MATCH);
+    num->matchBatch(std::vector<std::string>(), lengths);
+    ASSERT_TRUE(runner, lengths.empty());
+
+    // Long inputs whose token is a short prefix, next to short ones
+    std::vector<std::string> mixed;
+    for (int i = 0; i < 40; ++i)
+        mixed.push_back(i % 3 ? std::string(i % 5 + 1, '7') + std::string(5000, 'x') : "42");
+    num->matchBatch(mixed, lengths);
+    bool prefixes = true;
+    for (int i = 0; i < 40; ++i)
+        if (lengths[i] != (i % 3 ? size_t(i % 5 + 1) : 2u)) prefixes = false;
+    ASSERT_TRUE(runner, prefixes);
+
+    // Without a table nothing matches
+    Grammar f;
+    f.addRule("@<op> ::= '=' | '=='");
+    CompiledGrammar fcg(f);
+    fcg.scanner(fcg.findRule("<op>"))->matchBatch(few, lengths);
+    ASSERT_EQ(runner, lengths[0], TokenScanner::NO_MATCH);
+}
+
+int main() {
+    TestSuite suite("Token Scanner Test Suite");
+    suite.addTest("Token Rule Flag", test_token_rule_flag);
+    suite.addTest("Deterministic Scanner", test_deterministic_scanner);
+    suite.addTest("Scanner Fallbacks", test_scanner_fallbacks);
+    suite.addTest("Tokens Are Leaves", test_tokens_are_leaves);
+    suite.addTest("Tokens Match Interpreter", test_tokens_match_interpreter);
+    suite.addTest("Incremental Reparse", test_token_incremental_reparse);
+    suite.addTest("Token Actions Are Atomic", test_token_actions_are_atomic);
+    suite.addTest("Batch Matches Single", test_batch_matches_single);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
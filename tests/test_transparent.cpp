@@ -0,0 +1,130 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/IncrementalParser.hpp"
+
+static size_t countNodes(const ASTNode* n) {
+    if (!n) return 0;
+    size_t total = 1;
+    for (size_t i = 0; i < n->children.size(); ++i)
+        total += countNodes(n->children[i]);
+    return total;
+}
+
+static bool containsSymbol(const ASTNode* n, const std::string& symbol) {
+    if (!n) return false;
+    if (n->symbol == symbol) return true;
+    for (size_t i = 0; i < n->children.size(); ++i)
+        if (containsSymbol(n->children[i], symbol)) return true;
+    return false;
+}
+
+static void buildNickGrammar(Grammar& g, bool transparent) {
+    std::string mark = transparent ? "~" : "";
+    g.addRule(mark + "<letter> ::= ( 'a' ... 'z' 'A' ... 'Z' )");
+    g.addRule(mark + "<digit> ::= ( '0' ... '9' )");
+    g.addRule(mark + "<nick-char> ::= <letter> | <digit> | '_' | '-'");
+    g.addRule("<nick> ::= <letter> { <nick-char> }");
+    g.addRule("<channel> ::= '#' <nick>");
+    g.addRule("<join> ::= 'JOIN' ' ' <channel> { ',' <channel> }");
+}
+
+void test_transparent_annotation(TestRunner& runner) {
+    Grammar g;
+    g.addRule("~<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<word> ::= <letter> { <letter> }");
+
+    Rule* letter = g.getRule("<letter>");
+    ASSERT_NOT_NULL(runner, letter);
+    ASSERT_TRUE(runner, letter->transparent);
+    ASSERT_FALSE(runner, g.getRule("<word>")->transparent);
+}
+
+void test_transparent_same_text_fewer_nodes(TestRunner& runner) {
+    Grammar plain;
+    buildNickGrammar(plain, false);
+    Grammar light;
+    buildNickGrammar(light, true);
+    BNFParser p1(plain);
+    BNFParser p2(light);
+
+    std::string input = "JOIN #general,#dev-team_42,#x";
+    size_t c1 = 0, c2 = 0;
+    ASTNode* a1 = p1.parse("<join>", input, c1);
+    ASTNode* a2 = p2.parse("<join>", input, c2);
+    ASSERT_NOT_NULL(runner, a1);
+    ASSERT_NOT_NULL(runner, a2);
+    ASSERT_EQ(runner, c1, input.size());
+    ASSERT_EQ(runner, c2, input.size());
+    ASSERT_EQ(runner, a1->matched, a2->matched);
+
+    ASSERT_TRUE(runner, containsSymbol(a1, "<letter>"));
+    ASSERT_FALSE(runner, containsSymbol(a2, "<letter>"));
+    ASSERT_FALSE(runner, containsSymbol(a2, "<nick-char>"));
+    ASSERT_TRUE(runner, containsSymbol(a2, "<nick>"));
+    ASSERT_LT(runner, countNodes(a2) * 3, countNodes(a1));
+
+    delete a1;
+    delete a2;
+}
+
+void test_transparent_span_joins_parent(TestRunner& runner) {
+    Grammar g;
+    g.addRule("~<digit> ::= ( '0' ... '9' )");
+    g.addRule("<num> ::= <digit> { <digit> }");
+    g.addRule("<pair> ::= <num> ',' <num>");
+
+    BNFParser p(g);
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<pair>", "12,345", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 6u);
+    ASSERT_EQ(runner, ast->symbol, std::string("<seq>"));
+    ASSERT_EQ(runner, ast->children.size(), 3u);
+
+    const ASTNode* num = ast->children[2];
+    ASSERT_EQ(runner, num->symbol, std::string("<num>"));
+    ASSERT_EQ(runner, num->matched, std::string("345"));
+    // <num>'s sequence only keeps the (empty-bodied) repetition node
+    ASSERT_EQ(runner, num->children[0]->children.size(), 1u);
+    ASSERT_EQ(runner, num->children[0]->children[0]->matched, std::string("45"));
+    ASSERT_TRUE(runner, num->children[0]->children[0]->children.empty());
+    delete ast;
+}
+
+void test_transparent_with_incremental(TestRunner& runner) {
+    Grammar g;
+    g.addRule("~<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("~<digit> ::= ( '0' ... '9' )");
+    g.addRule("<key> ::= <letter> { <letter> | <digit> }");
+    g.addRule("<line> ::= <key> '=' <key> ( 0x0A )");
+    g.addRule("<doc> ::= { <line> }");
+
+    BNFParser p(g);
+    IncrementalParser inc(p, "<doc>");
+    size_t consumed = 0;
+    inc.parse("a=b\ncc=d1\ne=f\n", consumed);
+    ASSERT_EQ(runner, consumed, 14u);
+
+    inc.reparse(TextEdit(5, 0, "x9"), consumed);
+    ASSERT_EQ(runner, inc.text(), std::string("a=b\ncx9c=d1\ne=f\n"));
+    ASSERT_EQ(runner, consumed, inc.text().size());
+    ASSERT_GT(runner, inc.reusedCount(), 0u);
+
+    size_t full = 0;
+    ASTNode* ast = p.parse("<doc>", inc.text(), full);
+    ASSERT_EQ(runner, full, consumed);
+    ASSERT_EQ(runner, countNodes(ast), countNodes(inc.tree()));
+    delete ast;
+}
+
+int main() {
+    TestSuite suite("Transparent Rule Test Suite");
+    suite.addTest("Annotation", test_transparent_annotation);
+    suite.addTest("Same Text, Fewer Nodes", test_transparent_same_text_fewer_nodes);
+    suite.addTest("Span Joins Parent", test_transparent_span_joins_parent);
+    suite.addTest("With Incremental", test_transparent_with_incremental);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}
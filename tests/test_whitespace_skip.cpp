@@ -0,0 +1,163 @@
+#include "../include/TestFramework.hpp"
+#include "../include/Grammar.hpp"
+#include "../include/BNFParser.hpp"
+#include "../include/ByteSet.hpp"
+#include "../include/SemanticActions.hpp"
+#include <cstdlib>
+
+static void buildAssignmentGrammar(Grammar& g) {
+    g.addRule("<ws> ::= ( ' ' 0x09 0x0A 0x0D )");
+    g.addRule("<letter> ::= ( 'a' ... 'z' )");
+    g.addRule("<digit> ::= ( '0' ... '9' )");
+    g.addRule("@<ident> ::= <letter> { <letter> | <digit> }");
+    g.addRule("@<num> ::= <digit> { <digit> }");
+    g.addRule("<value> ::= <num> | <ident>");
+    g.addRule("<assign> ::= <ident> '=' <value> [ '+' <value> ] ';'");
+    g.addRule("<block> ::= '{' { <assign> } '}'");
+    g.setSkipRule("<ws>");
+}
+
+static size_t naiveSpan(const std::bitset<256>& bits, const std::string& s, size_t pos) {
+    while (pos < s.size() && bits.test(static_cast<unsigned char>(s[pos]))) ++pos;
+    return pos;
+}
+
+void test_byte_set_span(TestRunner& runner) {
+    std::bitset<256> ws;
+    ws.set(' ');
+    ws.set('\t');
+    ws.set('\n');
+    std::bitset<256> wide;
+    for (int c = 'a'; c <= 'z'; ++c) wide.set(c);
+
+    ByteSet small(ws);
+    ByteSet large(wide);
+    ASSERT_EQ(runner, small.size(), 3u);
+    ASSERT_EQ(runner, large.size(), 26u);
+    ASSERT_TRUE(runner, ByteSet().empty());
+    ASSERT_EQ(runner, ByteSet().span("  x", 0, 3), 0u);
+
+    // Runs of every length up to several vector widths, stopped at every offset
+    const std::string fill = " \t\nabcdefghij";
+    bool same = true;
+    std::srand(85);
+    for (size_t len = 0; len < 70 && same; ++len) {
+        std::string s;
+        for (size_t i = 0; i < len; ++i)
+            s += fill[std::rand() % 3];
+        std::string t = s;
+        for (size_t i = 0; i < len; ++i)
+            t[i] = static_cast<char>('a' + std::rand() % 26);
+        s += "x;";
+        t += ";x";
+        for (size_t start = 0; start <= len; start += 7) {
+            if (small.span(s.data(), start, s.size()) != naiveSpan(ws, s, start)) same = false;
+            if (large.span(t.data(), start, t.size()) != naiveSpan(wide, t, start)) same = false;
+            // The end bound is honoured
+            if (small.span(s.data(), start, len) != (len > start ? len : start)) same = false;
+        }
+    }
+    ASSERT_TRUE(runner, same);
+}
+
+void test_skip_between_tokens(TestRunner& runner) {
+    Grammar g;
+    buildAssignmentGrammar(g);
+    BNFParser p(g);
+
+    size_t consumed = 0;
+    ASTNode* ast = p.parse("<assign>", "  count =\t12 +\n step ;  ", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    // Trailing skip bytes are not consumed
+    ASSERT_EQ(runner, consumed, 22u);
+    ASSERT_EQ(runner, ast->matched, std::string("count =\t12 +\n step ;"));
+    ASSERT_EQ(runner, ast->children.size(), 5u);
+    ASSERT_EQ(runner, ast->children[0]->matched, std::string("count"));
+    ASSERT_EQ(runner, ast->children[2]->matched, std::string("12"));
+    ASSERT_EQ(runner, ast->children[3]->matched, std::string("+\n step"));
+    delete ast;
+
+    // Same tree without any skip bytes
+    ast = p.parse("<assign>", "count=12+step;", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 14u);
+    delete ast;
+
+    ASSERT_NULL(runner, p.parse("<assign>", "count = 12 + ", consumed));
+}
+
+void test_tokens_are_not_split(TestRunner& runner) {
+    Grammar g;
+    buildAssignmentGrammar(g);
+    BNFParser p(g);
+
+    size_t consumed = 0;
+    // "co unt" is two identifiers, and <assign> needs '=' after the first
+    ASSERT_NULL(runner, p.parse("<assign>", "co unt = 1;", consumed));
+    // A token start rule is matched as written
+    ASSERT_NULL(runner, p.parse("<ident>", " abc", consumed));
+    ASTNode* ast = p.parse("<ident>", "abc ", consumed);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, consumed, 3u);
+    delete ast;
+}
+
+void test_skip_with_repetition_and_full_match(TestRunner& runner) {
+    Grammar g;
+    buildAssignmentGrammar(g);
+    BNFParser p(g);
+
+    const std::string text = "{\n  a = 1;\n  b = a + 2;\n}\n";
+    ASTNode* ast = p.parseFull("<block>", text);
+    ASSERT_NOT_NULL(runner, ast);
+    ASSERT_EQ(runner, ast->children.size(), 3u);
+    ASSERT_EQ(runner, ast->children[1]->children.size(), 2u);
+    delete ast;
+
+    // Skipping lifts the maximum length, but not the minimum
+    ASSERT_NULL(runner, p.parseFull("<block>", "{"));
+    ASSERT_NULL(runner, p.parseFull("<block>", text + "x"));
+}
+
+static SemanticValue textLength(const ActionMatch& m, void*) {
+    return SemanticValue(static_cast<long>(m.length));
+}
+
+void test_skip_rule_validation(TestRunner& runner) {
+    Grammar g;
+    g.addRule("<blank> ::= ' ' | ( 0x09 )");
+    g.addRule("<pair> ::= 'a' 'b'");
+    g.setSkipRule("<blank>");
+    BNFParser p(g);
+    ASSERT_NOT_NULL(runner, p.compiledGrammar().skipSet());
+    ASSERT_TRUE(runner, p.compiledGrammar().skipSet()->test(' '));
+    ASSERT_TRUE(runner, p.compiledGrammar().skipSet()->test('\t'));
+
+    // Actions see the text without the skipped bytes
+    SemanticActions actions;
+    actions.on("<pair>", textLength);
+    g.addRule("<pairs> ::= <pair> { <pair> }");
+    SemanticValue result;
+    size_t consumed = 0;
+    ASSERT_TRUE(runner, p.parseWithActions("<pairs>", " \ta  b", actions, result, consumed));
+    ASSERT_EQ(runner, result.integer, 4L);
+
+    // A rule that can match more than one byte cannot be the skip rule
+    g.setSkipRule("<pair>");
+    ASSERT_NULL(runner, p.compiledGrammar().skipSet());
+    g.setSkipRule("");
+    ASSERT_NULL(runner, p.compiledGrammar().skipSet());
+    ASSERT_NULL(runner, p.parse("<pair>", "a b", consumed));
+}
+
+int main() {
+    TestSuite suite("Whitespace Skip Test Suite");
+    suite.addTest("ByteSet Span", test_byte_set_span);
+    suite.addTest("Skip Between Tokens", test_skip_between_tokens);
+    suite.addTest("Tokens Are Not Split", test_tokens_are_not_split);
+    suite.addTest("Repetition and Full Match", test_skip_with_repetition_and_full_match);
+    suite.addTest("Skip Rule Validation", test_skip_rule_validation);
+    TestRunner results = suite.run();
+    results.printSummary();
+    return results.allPassed() ? 0 : 1;
+}